@@ -0,0 +1,475 @@
+/* OpenArcanum ArtViewer directory browser */
+
+#include "app/ArtBrowser.h"
+
+#include "artviewer_vulkan.h"
+#include "formats/art.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+
+
+namespace
+{
+	// Thumbnails are rendered at most this big, the grid can show them smaller
+	const int MaxThumbnailSize = 128;
+
+	// Rows above and below the visible ones whose thumbnails are loaded ahead of time
+	const int PrefetchRows = 2;
+
+	// While scrolling, also prefetch the rows that will be on screen this far ahead, up to a limit
+	const float ScrollLookaheadSeconds = 0.5f;
+	const int   MaxLookaheadRows = 24;
+
+	// Scan results are handed over in chunks so a huge directory fills in while it is read
+	const size_t ScanChunk = 1024;
+
+	struct ThumbnailImage
+	{
+		int                   width = 0;
+		int                   height = 0;
+		std::vector<uint32_t> pixels;     // empty when the file could not be read
+	};
+
+	bool IsArtFile(const std::filesystem::path& path)
+	{
+		std::string ext = path.extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return ext == ".art";
+	}
+
+	// First frame with palette 0, nearest-neighbour scaled down to fit the thumbnail size
+	std::vector<uint32_t> BuildThumbnail(ArtFile& art, int& width, int& height)
+	{
+		width = height = 0;
+		if (art.frame_data.empty())
+			return {};
+
+		ArtFrame& frame = art.frame_data[0];
+		int fw = (int)frame.header.width;
+		int fh = (int)frame.header.height;
+		if (fw <= 0 || fh <= 0)
+			return {};
+
+		int scale = std::max((fw + MaxThumbnailSize - 1) / MaxThumbnailSize, (fh + MaxThumbnailSize - 1) / MaxThumbnailSize);
+		width = std::max(1, fw / scale);
+		height = std::max(1, fh / scale);
+
+		uint32_t lut[256];
+		for (int i = 0; i < 256; i++)
+		{
+			if (!art.palette_data.empty())
+			{
+				COLOR_4B c = art.palette_data[0].colors[i];
+				lut[i] = 0xFF000000u | (c.b << 16) | (c.g << 8) | c.r;
+			}
+			else
+				lut[i] = 0xFF000000u | (i << 16) | (i << 8) | i;
+		}
+		lut[0] = 0;
+
+		std::vector<uint32_t> pixels((size_t)width * height);
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				pixels[(size_t)y * width + x] = lut[frame.pixels[y * scale][x * scale]];
+
+		return pixels;
+	}
+}
+
+
+ArtBrowser::ArtBrowser(VulkanController* vkCtrl, JobSystem* jobs)
+	: mVkCtrl(vkCtrl)
+	, mJobs(jobs)
+{
+}
+
+
+ArtBrowser::~ArtBrowser()
+{
+	mScanToken.Cancel();
+	ReleaseAll();
+}
+
+
+void ArtBrowser::OpenDirectory(const std::string& path)
+{
+	ReleaseAll();
+	mEntries.clear();
+	mPendingChanges.clear();
+	mSelected = -1;
+	mDirectory = path;
+	mScanning = true;
+	snprintf(mPathInput, sizeof(mPathInput), "%s", path.c_str());
+
+	mScanToken.Cancel();
+	mScanToken = CancelToken();
+
+	JobSystem* jobs = mJobs;
+	mJobs->Submit(JobPriority::Background, mScanToken, [this, jobs, path](const CancelToken& token) -> JobSystem::Completion
+	{
+		auto chunk = std::make_shared<std::vector<BrowserEntry>>();
+		auto flush = [&]()
+		{
+			jobs->Post(token, [this, chunk]() { mEntries.insert(mEntries.end(), chunk->begin(), chunk->end()); });
+			chunk = std::make_shared<std::vector<BrowserEntry>>();
+		};
+
+		std::error_code ec;
+		for (std::filesystem::directory_iterator it(path, ec), end; !ec && it != end && !token.IsCancelled(); it.increment(ec))
+		{
+			if (!it->is_regular_file(ec) || !IsArtFile(it->path()))
+				continue;
+
+			BrowserEntry entry;
+			entry.path = it->path().string();
+			entry.name = it->path().filename().string();
+			entry.size = it->file_size(ec);
+			chunk->push_back(std::move(entry));
+
+			if (chunk->size() >= ScanChunk)
+				flush();
+		}
+
+		if (ec)
+			fprintf(stderr, "Cannot read directory %s: %s\n", path.c_str(), ec.message().c_str());
+		flush();
+
+		// Directory order is whatever the file system returns, sort once the listing is complete.
+		// Thumbnails are keyed by index, so the few loaded so far are simply requested again.
+		return [this]()
+		{
+			std::sort(mEntries.begin(), mEntries.end(), [](const BrowserEntry& a, const BrowserEntry& b) { return a.name < b.name; });
+			ReleaseAll();
+			mScanning = false;
+
+			std::vector<FileChange> changes;
+			changes.swap(mPendingChanges);
+			ApplyChanges(changes);
+		};
+	});
+}
+
+
+void ArtBrowser::ApplyChanges(const std::vector<FileChange>& changes)
+{
+	// The listing may or may not have seen these files yet; applying them afterwards is the same either way
+	if (mScanning)
+	{
+		mPendingChanges.insert(mPendingChanges.end(), changes.begin(), changes.end());
+		return;
+	}
+
+	for (const FileChange& change : changes)
+	{
+		if (!IsArtFile(change.name))
+			continue;
+
+		auto it = std::lower_bound(mEntries.begin(), mEntries.end(), change.name,
+			[](const BrowserEntry& entry, const std::string& name) { return entry.name < name; });
+		int index = (int)(it - mEntries.begin());
+		bool found = it != mEntries.end() && it->name == change.name;
+
+		if (change.removed)
+		{
+			if (found)
+			{
+				mEntries.erase(it);
+				ShiftThumbnails(index, -1);
+			}
+		}
+		else if (found)
+		{
+			// Same cell, new contents: its thumbnail is rendered again when next shown
+			it->size = change.size;
+			auto thumb = mThumbs.find(index);
+			if (thumb != mThumbs.end())
+			{
+				Release(thumb->second);
+				mThumbs.erase(thumb);
+			}
+		}
+		else
+		{
+			BrowserEntry entry;
+			entry.path = change.path;
+			entry.name = change.name;
+			entry.size = change.size;
+			mEntries.insert(it, std::move(entry));
+			ShiftThumbnails(index, +1);
+		}
+	}
+}
+
+
+int ArtBrowser::FindEntry(const std::string& name)
+{
+	auto it = std::lower_bound(mEntries.begin(), mEntries.end(), name,
+		[](const BrowserEntry& entry, const std::string& name) { return entry.name < name; });
+	return it != mEntries.end() && it->name == name ? (int)(it - mEntries.begin()) : -1;
+}
+
+
+void ArtBrowser::Select(int index)
+{
+	if (index < 0 || index >= (int)mEntries.size())
+		return;
+
+	mSelected = index;
+	mScrollToSelected = true;
+}
+
+
+bool ArtBrowser::Show(bool* open, int* activated)
+{
+	ImGui::SetNextWindowSize(ImVec2(720.0f, 540.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Browser", open))
+	{
+		ImGui::End();
+		return false;
+	}
+
+	ImGui::InputText("##dir", mPathInput, sizeof(mPathInput));
+	ImGui::SameLine();
+	if (ImGui::Button("Open") && mPathInput[0] != 0)
+		OpenDirectory(mPathInput);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(120.0f);
+	ImGui::SliderFloat("Size", &mThumbSize, 32.0f, (float)MaxThumbnailSize, "%.0f");
+
+	ImGui::Text("%d files%s, %d thumbnails resident", (int)mEntries.size(), mScanning ? " (scanning)" : "", (int)mThumbs.size());
+	ImGui::SameLine();
+	ImGui::TextDisabled("(thumbnails ready when shown: %d, not yet: %d)", mThumbHits, mThumbMisses);
+
+	bool result = false;
+
+	ImGui::BeginChild("##grid", ImVec2(0.0f, 0.0f), true);
+
+	const ImGuiStyle& style = ImGui::GetStyle();
+	const float cell_w = mThumbSize + style.ItemSpacing.x;
+	const float cell_h = mThumbSize + ImGui::GetTextLineHeightWithSpacing() + style.ItemSpacing.y;
+	const int columns = std::max(1, (int)((ImGui::GetContentRegionAvail().x + style.ItemSpacing.x) / cell_w));
+	const int count = (int)mEntries.size();
+	const int rows = (count + columns - 1) / columns;
+
+	if (mScrollToSelected && mSelected >= 0)
+	{
+		float row_y = (mSelected / columns) * cell_h;
+		if (row_y < ImGui::GetScrollY() || row_y + cell_h > ImGui::GetScrollY() + ImGui::GetWindowHeight())
+			ImGui::SetScrollY(row_y - (ImGui::GetWindowHeight() - cell_h) * 0.5f);
+		mScrollToSelected = false;
+	}
+
+	if (mPendingScrollRows != 0.0f)
+	{
+		ImGui::SetScrollY(std::min(ImGui::GetScrollY() + mPendingScrollRows * cell_h, ImGui::GetScrollMaxY()));
+		mPendingScrollRows = 0.0f;
+	}
+
+	// Smoothed scroll speed in rows per second, decides how far ahead to prefetch
+	float delta_time = ImGui::GetIO().DeltaTime;
+	if (delta_time > 0.0f)
+	{
+		float velocity = (ImGui::GetScrollY() - mLastScrollY) / cell_h / delta_time;
+		mScrollVelocity += (velocity - mScrollVelocity) * std::min(1.0f, delta_time * 8.0f);
+	}
+	mLastScrollY = ImGui::GetScrollY();
+
+	// ImGuiListClipper in 2D: rows are the clipped items, each row lays out its cells
+	int first_row = rows, last_row = -1;
+	ImGuiListClipper clipper(rows, cell_h);
+	while (clipper.Step())
+	{
+		first_row = std::min(first_row, clipper.DisplayStart);
+		last_row = std::max(last_row, clipper.DisplayEnd - 1);
+
+		for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
+			for (int col = 0; col < columns; col++)
+			{
+				int index = row * columns + col;
+				if (index >= count)
+					break;
+				if (col > 0)
+					ImGui::SameLine();
+
+				Thumbnail& thumb = Touch(index, JobPriority::Visible);
+
+				// Counts cells as they come into view: was the thumbnail there in time?
+				if (thumb.lastVisible != ImGui::GetFrameCount() - 1)
+				{
+					if (thumb.state == ThumbState::Loading)
+						mThumbMisses++;
+					else
+						mThumbHits++;
+				}
+				thumb.lastVisible = ImGui::GetFrameCount();
+
+				ImGui::PushID(index);
+				ImGui::BeginGroup();
+
+				ImVec2 pos = ImGui::GetCursorScreenPos();
+				if (ImGui::Selectable("##cell", mSelected == index, ImGuiSelectableFlags_AllowDoubleClick, ImVec2(mThumbSize, mThumbSize)))
+				{
+					mSelected = index;
+					if (ImGui::IsMouseDoubleClicked(0))
+					{
+						*activated = index;
+						result = true;
+					}
+				}
+				if (ImGui::IsItemHovered())
+					ImGui::SetTooltip("%s\n%llu bytes", mEntries[index].name.c_str(), (unsigned long long)mEntries[index].size);
+
+				ImDrawList* draw_list = ImGui::GetWindowDrawList();
+				if (thumb.state == ThumbState::Ready)
+				{
+					// Fit without upscaling past the native size, pixel art stays crisp at integer steps
+					float w = (float)thumb.texture->width, h = (float)thumb.texture->height;
+					float scale = std::min(mThumbSize / std::max(w, h), 1.0f);
+					ImVec2 a(pos.x + (mThumbSize - w * scale) * 0.5f, pos.y + (mThumbSize - h * scale) * 0.5f);
+					draw_list->AddImage(thumb.texture->GetTexID(), a, ImVec2(a.x + w * scale, a.y + h * scale));
+				}
+				else
+				{
+					ImU32 col = thumb.state == ThumbState::Failed ? IM_COL32(160, 60, 60, 255) : ImGui::GetColorU32(ImGuiCol_FrameBg);
+					draw_list->AddRectFilled(ImVec2(pos.x + 4.0f, pos.y + 4.0f), ImVec2(pos.x + mThumbSize - 4.0f, pos.y + mThumbSize - 4.0f), col);
+				}
+
+				ImGui::PushClipRect(ImGui::GetCursorScreenPos(), ImVec2(pos.x + mThumbSize, pos.y + cell_h), true);
+				ImGui::TextUnformatted(mEntries[index].name.c_str());
+				ImGui::PopClipRect();
+
+				ImGui::EndGroup();
+				ImGui::PopID();
+			}
+	}
+
+	// Cells just outside the view come after the visible ones, so they never delay what is on screen.
+	// The side we are scrolling towards gets the extra rows.
+	if (last_row >= first_row)
+	{
+		int lookahead = std::min(MaxLookaheadRows, (int)(std::fabs(mScrollVelocity) * ScrollLookaheadSeconds));
+		int below = PrefetchRows + (mScrollVelocity > 0.0f ? lookahead : 0);
+		int above = PrefetchRows + (mScrollVelocity < 0.0f ? lookahead : 0);
+		for (int d = 1; d <= std::max(below, above); d++)
+			for (int row : { d <= below ? last_row + d : -1, d <= above ? first_row - d : -1 })
+				if (row >= 0 && row < rows)
+					for (int col = 0; col < columns && row * columns + col < count; col++)
+						Touch(row * columns + col, JobPriority::Prefetch);
+	}
+
+	ImGui::EndChild();
+	ImGui::End();
+
+	ReleaseUntouched();
+
+	return result;
+}
+
+
+auto ArtBrowser::Touch(int index, JobPriority priority) -> Thumbnail&
+{
+	Thumbnail& thumb = mThumbs[index];
+	thumb.lastTouched = ImGui::GetFrameCount();
+	if (thumb.state != ThumbState::Loading || priority >= thumb.priority)
+		return thumb;
+
+	// First request, or a prefetched cell scrolled into view before its job ran: queue it in the better lane
+	thumb.token.Cancel();
+	thumb.token = CancelToken();
+	thumb.priority = priority;
+
+	std::string path = mEntries[index].path;
+	mJobs->Submit(priority, thumb.token, [this, index, path](const CancelToken&) -> JobSystem::Completion
+	{
+		auto image = std::make_shared<ThumbnailImage>();
+		try
+		{
+			ArtFile art;
+			art.LoadArt(path);
+			AV_TRACE_SCOPE("BuildThumbnail");
+			image->pixels = BuildThumbnail(art, image->width, image->height);
+		}
+		catch (MissingFile&)
+		{
+		}
+		catch (std::exception&)
+		{
+			image->pixels.clear();
+		}
+
+		return [this, index, image]()
+		{
+			auto it = mThumbs.find(index);
+			if (it == mThumbs.end())
+				return;
+
+			Thumbnail& thumb = it->second;
+			if (!image->pixels.empty())
+				thumb.texture = mVkCtrl->CreateTexture(image->width, image->height, VK_FORMAT_R8G8B8A8_UNORM, image->pixels.data());
+			thumb.state = thumb.texture ? ThumbState::Ready : ThumbState::Failed;
+		};
+	});
+
+	return thumb;
+}
+
+
+void ArtBrowser::Release(Thumbnail& thumb)
+{
+	// Texture is freed once the GPU is done with it, a job still queued is skipped
+	thumb.token.Cancel();
+	mVkCtrl->DestroyTexture(thumb.texture);
+	thumb.texture = nullptr;
+}
+
+
+void ArtBrowser::ReleaseAll()
+{
+	for (auto& it : mThumbs)
+		Release(it.second);
+	mThumbs.clear();
+}
+
+
+void ArtBrowser::ShiftThumbnails(int index, int delta)
+{
+	// Thumbnails are keyed by entry index, the ones after an inserted or removed entry move with it.
+	// A job still loading would complete into the old index, so it is dropped and requested again.
+	std::unordered_map<int, Thumbnail> moved;
+	for (auto& it : mThumbs)
+	{
+		if (it.first < index)
+			moved.emplace(it.first, std::move(it.second));
+		else if ((delta < 0 && it.first == index) || it.second.state == ThumbState::Loading)
+			Release(it.second);
+		else
+			moved.emplace(it.first + delta, std::move(it.second));
+	}
+	mThumbs.swap(moved);
+
+	if (mSelected >= index)
+		mSelected = delta < 0 && mSelected == index ? -1 : mSelected + delta;
+}
+
+
+void ArtBrowser::ReleaseUntouched()
+{
+	// Anything not visible or prefetched this frame goes
+	int frame = ImGui::GetFrameCount();
+	for (auto it = mThumbs.begin(); it != mThumbs.end();)
+	{
+		if (it->second.lastTouched != frame)
+		{
+			Release(it->second);
+			it = mThumbs.erase(it);
+		}
+		else
+			++it;
+	}
+}
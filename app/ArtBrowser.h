@@ -0,0 +1,94 @@
+/* OpenArcanum ArtViewer directory browser */
+
+#pragma once
+
+#include "imgui.h"
+#include "app/DirectoryWatcher.h"
+#include "app/JobSystem.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VulkanController;
+struct VulkanTexture;
+
+struct BrowserEntry
+{
+	std::string path;
+	std::string name;
+	uintmax_t   size = 0;
+};
+
+// Thumbnail grid over a directory of any size: only the visible rows are laid out, thumbnails are
+// loaded as jobs for visible and nearby cells and dropped again once scrolled away
+class ArtBrowser
+{
+public:
+	ArtBrowser(VulkanController* vkCtrl, JobSystem* jobs);
+	~ArtBrowser();
+
+	ArtBrowser(const ArtBrowser&) = delete;
+	ArtBrowser(ArtBrowser&&) = delete;
+
+	void OpenDirectory(const std::string& path);
+
+	// Returns true and sets 'activated' to the entry index when an entry was double clicked
+	bool Show(bool* open, int* activated);
+
+	// Highlights an entry and scrolls it into view, e.g. when stepping through files elsewhere
+	void Select(int index);
+
+	// Adds, updates or removes just the entries of these files, a scan in progress gets them once it is done
+	void ApplyChanges(const std::vector<FileChange>& changes);
+	// Index of the entry with this file name, -1 when there is none
+	int  FindEntry(const std::string& name);
+
+	// Applied the next time the grid is shown, as if the user had scrolled
+	void ScrollBy(float rows) { mPendingScrollRows += rows; }
+	bool IsScanning() { return mScanning; }
+
+	auto GetDirectory() -> const std::string& { return mDirectory; }
+	auto GetEntries() -> const std::vector<BrowserEntry>& { return mEntries; }
+	int  GetThumbnailCount() { return static_cast<int>(mThumbs.size()); }
+
+protected:
+	enum class ThumbState { Loading, Ready, Failed };
+
+	struct Thumbnail
+	{
+		ThumbState     state = ThumbState::Loading;
+		JobPriority    priority = JobPriority::Count;     // lane of the queued job, Count until requested
+		CancelToken    token;
+		VulkanTexture* texture = nullptr;
+		int            lastTouched = 0;
+		int            lastVisible = -1;
+	};
+
+	auto Touch(int index, JobPriority priority) -> Thumbnail&;
+	void Release(Thumbnail& thumb);
+	void ReleaseAll();
+	void ReleaseUntouched();
+	void ShiftThumbnails(int index, int delta);
+
+protected:
+	VulkanController* mVkCtrl;
+	JobSystem*        mJobs;
+
+	std::string                          mDirectory;
+	std::vector<BrowserEntry>            mEntries;
+	std::unordered_map<int, Thumbnail>   mThumbs;
+	CancelToken                          mScanToken;
+	std::vector<FileChange>              mPendingChanges;
+	char                                 mPathInput[512] = {};
+	float                                mThumbSize = 96.0f;
+	int                                  mSelected = -1;
+	bool                                 mScanning = false;
+	bool                                 mScrollToSelected = false;
+	float                                mLastScrollY = 0.0f;
+	float                                mScrollVelocity = 0.0f;     // rows per second, positive is down
+	float                                mPendingScrollRows = 0.0f;
+	int                                  mThumbHits = 0;
+	int                                  mThumbMisses = 0;
+};
@@ -0,0 +1,340 @@
+/* OpenArcanum ArtViewer animation playback */
+
+#include "app/ArtPlayback.h"
+
+#include "artviewer_sprites.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <exception>
+
+
+namespace
+{
+	// Longest wall-clock step taken at once, e.g. after the window was dragged or the loop idled
+	const double MaxAdvanceSeconds = 0.25;
+
+	// Vulkan guarantees at least this much for maxImageDimension2D
+	const int MaxAtlasSize = 4096;
+}
+
+
+ArtAnimation::~ArtAnimation()
+{
+	if (sprites != nullptr)
+		sprites->DestroySheet(sheet);
+	if (atlasTexture != nullptr)
+		store->ReleaseAtlas(atlasKey, atlasTexture);
+	if (store != nullptr)
+		store->Release(this, frames);
+}
+
+
+bool ArtAnimation::Upload(SpriteRenderer* renderer, std::string& error)
+{
+	if (sheet != nullptr)
+		return true;
+
+	// Too large for an atlas: nothing to play, the canvas shows its frames tile by tile
+	if (atlas.width == 0)
+	{
+		std::vector<uint32_t>().swap(stagedPalettes);
+		return true;
+	}
+
+	if (renderer == nullptr)
+	{
+		error = "Sprite renderer is not available";
+		return false;
+	}
+
+	if (store != nullptr)
+	{
+		atlasTexture = store->AcquireAtlas(atlasKey, atlas, frames, stagedIndices.data());
+		sheet = renderer->CreateSheet(atlasTexture, paletteCount, stagedPalettes.data());
+	}
+	else
+		sheet = renderer->CreateSheet(atlas.width, atlas.height, stagedIndices.data(), paletteCount, stagedPalettes.data());
+	sprites = renderer;
+	bytevec().swap(stagedIndices);
+	std::vector<uint32_t>().swap(stagedPalettes);
+	if (sheet == nullptr)
+	{
+		error = "Cannot create sprite sheet for " + name;
+		return false;
+	}
+	return true;
+}
+
+
+size_t ArtAnimation::GetMemorySize() const
+{
+	// Decoded pixels and RLE data on the CPU side, atlas and palette table on the GPU side. What is
+	// shared through the store is counted in full by every file using it.
+	size_t bytes = static_cast<size_t>(atlas.width) * atlas.height + static_cast<size_t>(paletteCount) * 256 * 4;
+	for (const ArtFrame& frame : art.frame_data)
+		bytes += frame.pixels.size() * frame.header.width + frame.header.size;
+
+	std::vector<const StoredFrame*> held;
+	for (const auto& frame : frames)
+		held.push_back(frame.get());
+	std::sort(held.begin(), held.end());
+	held.erase(std::unique(held.begin(), held.end()), held.end());
+	for (const StoredFrame* frame : held)
+		bytes += frame->indices.size();
+
+	return bytes + stagedIndices.size() + stagedPalettes.size() * 4;
+}
+
+
+auto ArtAnimation::GetFrameRow(int frame, int y) const -> const unsigned char*
+{
+	if (!frames.empty())
+		return frames[frame]->GetRow(y);
+	return art.frame_data[frame].pixels[y].data();
+}
+
+
+PlaybackScheduler::PlaybackScheduler(VulkanController* vkCtrl)
+	: mVkCtrl(vkCtrl)
+	, mSprites(vkCtrl->GetSprites())
+{
+}
+
+
+auto PlaybackScheduler::DecodeAnimation(const std::string& fname, std::string& error, bool trim, FrameStore* store) -> std::shared_ptr<ArtAnimation>
+{
+	AV_TRACE_SCOPE_DETAIL("DecodeAnimation", fname.c_str());
+
+	auto anim = std::make_shared<ArtAnimation>();
+	anim->path = fname;
+	anim->name = fname.substr(fname.find_last_of("/\\") + 1);
+
+	try
+	{
+		anim->art.LoadArt(fname);
+	}
+	catch (MissingFile& mf)
+	{
+		error = "Missing file : " + mf.filename;
+		return nullptr;
+	}
+	catch (std::exception& e)
+	{
+		error = "Cannot load " + anim->name + ": " + e.what();
+		return nullptr;
+	}
+
+	if (anim->art.frame_data.empty())
+	{
+		error = "No frames in " + anim->name;
+		return nullptr;
+	}
+
+	// Before packing, so the atlas and its upload shrink too
+	if (trim)
+		anim->trimmedBytes = anim->art.TrimFrames();
+
+	std::vector<uint64_t> hashes;
+	if (anim->atlas.Pack(anim->art, MaxAtlasSize))
+	{
+		anim->stagedIndices = anim->atlas.BuildIndexed(anim->art);
+		anim->atlasKey = anim->atlas.GetContentHash();
+		hashes = anim->atlas.hashes;
+	}
+	else
+	{
+		hashes = std::move(anim->atlas.hashes);
+		anim->atlas = ArtAtlas();
+	}
+
+	// The atlas is built, from here on the frames' pixels are only read through the store
+	if (store != nullptr)
+	{
+		anim->store = store;
+		anim->frames.reserve(anim->art.frame_data.size());
+		for (size_t i = 0; i < anim->art.frame_data.size(); i++)
+			anim->frames.push_back(store->Intern(anim->art.frame_data[i], hashes[i], anim.get(), static_cast<int>(i)));
+	}
+	anim->stagedPalettes = ArtAtlas::BuildPalettes(anim->art);
+	anim->paletteCount = static_cast<int>(anim->stagedPalettes.size() / 256);
+
+	anim->directions = anim->art.GetDirections();
+	anim->framesPerDirection = anim->art.GetFramesPerDirection();
+	anim->frameRate = anim->art.GetFrameRate();
+
+	return anim;
+}
+
+
+int PlaybackScheduler::AddAnimation(std::shared_ptr<ArtAnimation> anim)
+{
+	if (!anim->Upload(mSprites, mLastError))
+		return -1;
+
+	mAnimations.push_back(std::move(anim));
+	return static_cast<int>(mAnimations.size()) - 1;
+}
+
+
+bool PlaybackScheduler::ReplaceAnimation(int index, std::shared_ptr<ArtAnimation> anim)
+{
+	IM_ASSERT(index >= 0 && index < static_cast<int>(mAnimations.size()));
+	if (!anim->Upload(mSprites, mLastError))
+		return false;
+
+	// The old sheet goes with the last owner, the GPU may still be drawing from it
+	mAnimations[index] = std::move(anim);
+	const ArtAnimation& replaced = *mAnimations[index];
+	for (auto& inst : mInstances)
+		if (inst.animation == index)
+		{
+			inst.direction %= replaced.directions;
+			inst.frame = std::min(inst.frame, std::max(replaced.framesPerDirection - 1, 0));
+		}
+	return true;
+}
+
+
+int PlaybackScheduler::LoadAnimation(const std::string& fname)
+{
+	auto anim = DecodeAnimation(fname, mLastError);
+	return anim ? AddAnimation(std::move(anim)) : -1;
+}
+
+
+void PlaybackScheduler::Clear()
+{
+	mInstances.clear();
+	mAnimations.clear();
+	mAccumulator = 0.0;
+}
+
+
+int PlaybackScheduler::AddInstance(const PlaybackInstance& instance)
+{
+	IM_ASSERT(instance.animation >= 0 && instance.animation < static_cast<int>(mAnimations.size()));
+	mInstances.push_back(instance);
+	return static_cast<int>(mInstances.size()) - 1;
+}
+
+
+void PlaybackScheduler::Advance(double seconds)
+{
+	const double tick = 1.0 / TickRate;
+
+	mAccumulator += std::min(seconds, MaxAdvanceSeconds);
+	while (mAccumulator >= tick)
+	{
+		mAccumulator -= tick;
+		for (auto& inst : mInstances)
+			if (inst.playing)
+				Tick(inst, *mAnimations[inst.animation]);
+	}
+}
+
+
+void PlaybackScheduler::Tick(PlaybackInstance& inst, const ArtAnimation& anim)
+{
+	if (anim.framesPerDirection <= 1)
+		return;
+
+	inst.phase += anim.frameRate * inst.speed / TickRate;
+	while (inst.phase >= 1.0)
+	{
+		inst.phase -= 1.0;
+
+		int next = inst.frame + (inst.reverse ? -1 : 1);
+		if (next < 0 || next >= anim.framesPerDirection)
+		{
+			if (!inst.loop)
+			{
+				inst.playing = false;
+				inst.phase = 0.0;
+				return;
+			}
+			next = inst.reverse ? anim.framesPerDirection - 1 : 0;
+		}
+		inst.frame = next;
+	}
+}
+
+
+void PlaybackScheduler::Draw(ImDrawList* drawList, ImVec2 origin, float zoom)
+{
+	if (mInstances.empty())
+		return;
+
+	// Group by animation so each sheet is one instanced draw
+	mDrawOrder.resize(mInstances.size());
+	for (size_t i = 0; i < mDrawOrder.size(); i++)
+		mDrawOrder[i] = static_cast<int>(i);
+	std::stable_sort(mDrawOrder.begin(), mDrawOrder.end(),
+		[this](int a, int b) { return mInstances[a].animation < mInstances[b].animation; });
+
+	size_t first = 0;
+	while (first < mDrawOrder.size())
+	{
+		int animation = mInstances[mDrawOrder[first]].animation;
+		ArtAnimation& anim = *mAnimations[animation];
+		if (anim.sheet == nullptr)
+		{
+			while (first < mDrawOrder.size() && mInstances[mDrawOrder[first]].animation == animation)
+				first++;
+			continue;
+		}
+
+		mBatch.clear();
+		size_t last = first;
+		for (; last < mDrawOrder.size() && mInstances[mDrawOrder[last]].animation == animation; last++)
+		{
+			const PlaybackInstance& inst = mInstances[mDrawOrder[last]];
+			int index = anim.art.GetFrameIndex(inst.direction % anim.directions, inst.frame);
+			const AtlasRect& r = anim.atlas.rects[index];
+			const ARTFrameHeader& fh = anim.art.frame_data[index].header;
+
+			SpriteInstance sprite;
+			sprite.rect[0] = static_cast<float>(r.x);
+			sprite.rect[1] = static_cast<float>(r.y);
+			sprite.rect[2] = static_cast<float>(r.w);
+			sprite.rect[3] = static_cast<float>(r.h);
+			sprite.pos[0] = inst.position.x - fh.c_x;
+			sprite.pos[1] = inst.position.y - fh.c_y;
+			sprite.palette = static_cast<float>(inst.palette < anim.paletteCount ? inst.palette : 0);
+			sprite.tint = inst.tint;
+			mBatch.push_back(sprite);
+		}
+
+		mSprites->AddBatch(drawList, anim.sheet, mBatch.data(), static_cast<int>(mBatch.size()), origin, zoom);
+
+		first = last;
+	}
+}
+
+
+bool PlaybackScheduler::IsAdvancing(const PlaybackInstance& inst) const
+{
+	// Tick() leaves these alone, they would keep the render loop busy without ever stopping
+	const ArtAnimation& anim = *mAnimations[inst.animation];
+	return inst.playing && anim.framesPerDirection > 1;
+}
+
+
+bool PlaybackScheduler::IsPlaying() const
+{
+	for (auto& inst : mInstances)
+		if (IsAdvancing(inst))
+			return true;
+	return false;
+}
+
+
+int PlaybackScheduler::GetFrameRate() const
+{
+	// Fastest playing instance decides, frame pacing then shows each of its frames equally long
+	float fastest = 0.0f;
+	for (auto& inst : mInstances)
+		if (IsAdvancing(inst))
+			fastest = std::max(fastest, mAnimations[inst.animation]->frameRate * inst.speed);
+	return static_cast<int>(fastest + 0.5f);
+}
@@ -0,0 +1,128 @@
+/* OpenArcanum ArtViewer animation playback */
+
+#pragma once
+
+#include "imgui.h"
+#include "formats/art.h"
+#include "formats/atlas.h"
+#include "app/FrameStore.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class VulkanController;
+class SpriteRenderer;
+struct SpriteInstance;
+struct SpriteSheet;
+
+// ART file decoded into one indexed sprite sheet, shared by every instance playing it.
+// Held by shared_ptr: the scheduler and the prefetch cache may both keep it, the sheet goes with the last owner.
+// Decoded through a FrameStore, the frames' pixels live in the store and the atlas texture may be another file's.
+struct ArtAnimation
+{
+	ArtAnimation() = default;
+	~ArtAnimation();
+
+	ArtAnimation(const ArtAnimation&) = delete;
+	ArtAnimation& operator=(const ArtAnimation&) = delete;
+
+	std::string     name;
+	std::string     path;
+	ArtFile         art;
+	ArtAtlas        atlas;
+	SpriteSheet*    sheet = nullptr;
+	SpriteRenderer* sprites = nullptr;
+	int             paletteCount = 1;
+
+	// Set when decoded through the store: 'frames' holds the pixels, art.frame_data only headers and RLE data
+	FrameStore*     store = nullptr;
+	std::vector<std::shared_ptr<const StoredFrame>> frames;
+	uint64_t        atlasKey = 0;
+	VulkanTexture*  atlasTexture = nullptr;  // from the store, released with the animation
+
+	// Filled by DecodeAnimation(), uploaded and released by Upload()
+	bytevec               stagedIndices;
+	std::vector<uint32_t> stagedPalettes;
+
+	// Render thread only
+	bool   Upload(SpriteRenderer* renderer, std::string& error);
+	size_t GetMemorySize() const;
+
+	// Top-down row of a decoded frame, wherever it is kept
+	auto GetFrameRow(int frame, int y) const -> const unsigned char*;
+
+	int            directions = 1;
+	int            framesPerDirection = 0;
+	int            frameRate = 0;
+	size_t         trimmedBytes = 0;     // transparent margins cropped at load
+};
+
+struct PlaybackInstance
+{
+	int    animation = 0;
+	int    direction = 0;      // facing, 0 .. directions - 1
+	int    frame = 0;          // within the direction
+	int    palette = 0;
+	ImU32  tint = IM_COL32_WHITE;
+	float  speed = 1.0f;
+	bool   reverse = false;
+	bool   loop = true;
+	bool   playing = true;
+	double phase = 0.0;        // progress towards the next frame, in frames
+	ImVec2 position;           // where the frame centre point lands, relative to the draw origin
+};
+
+// Advances instances on a fixed clock independent of the render rate; the render loop only draws the current state
+class PlaybackScheduler
+{
+public:
+	explicit PlaybackScheduler(VulkanController* vkCtrl);
+
+	PlaybackScheduler(const PlaybackScheduler&) = delete;
+	PlaybackScheduler(PlaybackScheduler&&) = delete;
+
+	static const int TickRate = 240;
+
+	// File reading, decoding and atlas packing; touches no scheduler state so it can run as a job
+	static auto DecodeAnimation(const std::string& fname, std::string& error, bool trim = false, FrameStore* store = nullptr) -> std::shared_ptr<ArtAnimation>;
+
+	// Render thread: creates the sprite sheet unless already uploaded. Returns the animation index, or -1 with GetLastError() set
+	int  AddAnimation(std::shared_ptr<ArtAnimation> anim);
+	int  LoadAnimation(const std::string& fname);
+	// Swaps in a reloaded file, its instances keep playing with frames clamped to the new file
+	bool ReplaceAnimation(int index, std::shared_ptr<ArtAnimation> anim);
+	int  AddInstance(const PlaybackInstance& instance);
+	void ClearInstances() { mInstances.clear(); }
+	void Clear();
+
+	// Runs every fixed tick that fits into the elapsed wall time
+	void Advance(double seconds);
+
+	// One instanced sprite batch per animation, recorded at this point of the draw list
+	void Draw(ImDrawList* drawList, ImVec2 origin, float zoom);
+
+	// Only instances whose frame can still change count, a single-frame animation needs no redraws
+	bool IsPlaying() const;
+	int  GetFrameRate() const;
+
+	auto GetAnimations() -> std::vector<std::shared_ptr<ArtAnimation>>& { return mAnimations; }
+	auto GetInstances() -> std::vector<PlaybackInstance>& { return mInstances; }
+	auto GetLastError() -> const std::string& { return mLastError; }
+
+protected:
+	void Tick(PlaybackInstance& inst, const ArtAnimation& anim);
+	bool IsAdvancing(const PlaybackInstance& inst) const;
+
+protected:
+	VulkanController* mVkCtrl;
+	SpriteRenderer*   mSprites;
+
+	std::vector<std::shared_ptr<ArtAnimation>> mAnimations;
+	std::vector<PlaybackInstance>              mInstances;
+	std::vector<int>                           mDrawOrder;
+	std::vector<SpriteInstance>                mBatch;
+
+	double      mAccumulator = 0.0;
+	std::string mLastError;
+};
@@ -3,55 +3,125 @@
 #include "app/ArtViewer.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "imgui.h"
 #include "imgui_impl_sdl.h"
 #include "artviewer_vulkan.h"
+#include "artviewer_sprites.h"
+#include "formats/png.h"
 
+#include <math.h>
+#include <algorithm>
+#include <filesystem>
 #include <string>
 #include <vector>
 
+
+namespace
+{
+	struct PresentModeName
+	{
+		VkPresentModeKHR mode;
+		const char*      name;
+	};
+
+	const PresentModeName PresentModes[] =
+	{
+		{ VK_PRESENT_MODE_FIFO_KHR,      "fifo" },
+		{ VK_PRESENT_MODE_MAILBOX_KHR,   "mailbox" },
+		{ VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate" },
+	};
+
+	const char* GetPresentModeName(VkPresentModeKHR mode)
+	{
+		for (const auto& pm : PresentModes)
+			if (pm.mode == mode)
+				return pm.name;
+		return "other";
+	}
+
+	// Present intervals longer than this follow an idle period and say nothing about pacing
+	const float IdlePresentGapMs = 250.0f;
+
+	const uint32_t MaxSwapChainImages = 8;
+}
+
 ArtViewer::ArtViewer(int argC, char** argV)
 {
+	AV_TRACE_THREAD_NAME("main");
 	ParseInputParams(argC, argV);
 
-	// Setup SDL
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
+	// Setup SDL. Headless runs on the dummy video driver, which needs no display but cannot give a Vulkan surface
+	if (mHeadless)
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+	if (SDL_Init(mHeadless ? SDL_INIT_VIDEO | SDL_INIT_TIMER : SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER) != 0)
 	{
 		printf("Error: %s\n", SDL_GetError());
+		mExitCode = 1;
 		return;
 	}
 
+	mWakeEventType = SDL_RegisterEvents(1);
+
 	// Setup window
-	SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
+	SDL_WindowFlags window_flags = mHeadless ? SDL_WINDOW_HIDDEN : (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI);
 	SdlWindow = SDL_CreateWindow("OpenArcanum ArtViewer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
 		windowWidth, windowHeight, window_flags);
 
 	// Setup Vulkan
-	uint32_t extensions_count = 0;
-	SDL_Vulkan_GetInstanceExtensions(SdlWindow, &extensions_count, NULL);
-	const char** extensions = new const char*[extensions_count];
-	SDL_Vulkan_GetInstanceExtensions(SdlWindow, &extensions_count, extensions);
+	if (mHeadless)
+		vkCtrl = new VulkanController(nullptr, 0, true);
+	else
+	{
+		uint32_t extensions_count = 0;
+		SDL_Vulkan_GetInstanceExtensions(SdlWindow, &extensions_count, NULL);
+		const char** extensions = new const char*[extensions_count];
+		SDL_Vulkan_GetInstanceExtensions(SdlWindow, &extensions_count, extensions);
 
-	vkCtrl = new VulkanController(extensions, extensions_count);
-	delete[] extensions;
+		vkCtrl = new VulkanController(extensions, extensions_count);
+		delete[] extensions;
+	}
 
-	// Create Window Surface
-	VkSurfaceKHR surface;
-	if (SDL_Vulkan_CreateSurface(SdlWindow, vkCtrl->GetVkInstance(), &surface) == 0)
+	// Pipeline cache lives in the per-user pref dir and must exist before any pipeline is built
+	if (char* prefPath = SDL_GetPrefPath("OpenArcanum", "ArtViewer"))
 	{
-		printf("Failed to create Vulkan surface.\n");
-		return;
+		vkCtrl->LoadPipelineCache(std::string(prefPath) + "pipeline.cache");
+		SDL_free(prefPath);
 	}
 
-	// Create Framebuffers
-	int w, h;
-	SDL_GetWindowSize(SdlWindow, &w, &h);
-	vkCtrl->SetupVulkanWindow(&ImGuiVulkanWindow, surface, w, h, mMinImageCount);
+	if (mHeadless)
+	{
+		if (!vkCtrl->CreateOffscreenWindow(&ImGuiVulkanWindow, windowWidth, windowHeight, mMinImageCount))
+		{
+			printf("Failed to create offscreen images.\n");
+			mExitCode = 1;
+			return;
+		}
+	}
+	else
+	{
+		// Create Window Surface
+		VkSurfaceKHR surface;
+		if (SDL_Vulkan_CreateSurface(SdlWindow, vkCtrl->GetVkInstance(), &surface) == 0)
+		{
+			printf("Failed to create Vulkan surface.\n");
+			mExitCode = 1;
+			return;
+		}
+
+		// Create Framebuffers
+		int w, h;
+		SDL_GetWindowSize(SdlWindow, &w, &h);
+		vkCtrl->SetupVulkanWindow(&ImGuiVulkanWindow, surface, w, h, mMinImageCount, mPresentMode);
+	}
 
 	// Setup Dear ImGui context
 	IMGUI_CHECKVERSION();
+	mImGuiHeap.InstallForImGui();
 	ImGui::CreateContext();
+	if (mHeadless)
+		ImGui::GetIO().IniFilename = nullptr;     // window layout must not depend on earlier runs
 	//ImGuiIO& io = ImGui::GetIO();
 	//io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
 	//io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
@@ -68,18 +138,93 @@ ArtViewer::ArtViewer(int argC, char** argV)
 	ImGui_ImplVulkan_Init(&init_info, ImGuiVulkanWindow.RenderPass);
 
 	vkCtrl->UploadFonts(&ImGuiVulkanWindow);
+	vkCtrl->CreateSpriteRenderer(&ImGuiVulkanWindow);
+
+	mPlayback = new PlaybackScheduler(vkCtrl);
+	mJobs = new JobSystem([this]() { RequestRedraw(); });
+	mPrefetch = new Prefetcher(mJobs, vkCtrl->GetSprites(), (size_t)mPrefetchBudgetMB << 20);
+	mPrefetch->SetTrimFrames(mTrimFrames);
+	if (mDedupFrames)
+	{
+		mFrameStore = new FrameStore(vkCtrl);
+		mPrefetch->SetFrameStore(mFrameStore);
+	}
+	mBrowser = new ArtBrowser(vkCtrl, mJobs);
+	mCanvas = new TileCanvas(vkCtrl->GetSprites());
+	mSimilar = new SimilarSearch(mJobs);
+	mDiffView = new DiffView();
+	mWatcher = new DirectoryWatcher([this]() { RequestRedraw(); });
+	for (const auto& fname : mOpenFiles)
+	{
+		std::error_code ec;
+		if (std::filesystem::is_directory(fname, ec))
+			mBrowser->OpenDirectory(fname);
+		else
+			OpenFile(fname);
+	}
+
+	if (!mReplayPath.empty())
+	{
+		std::string error;
+		mReplaying = mInput.Load(mReplayPath, error);
+		if (mReplaying)
+		{
+			mRecordPath.clear();
+			mProfiler.StartRecording();
+		}
+		else
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			mExitCode = 1;
+		}
+	}
+
+	if (mHeadless && !mReplaying)
+	{
+		std::string error;
+		if (mScenarioPath.empty())
+			mScenario.SetDefault(mHeadlessFrames);
+		else if (!mScenario.Load(mScenarioPath, error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			mExitCode = 1;
+		}
+		mProfiler.StartRecording();
+	}
 }
 
 
 ArtViewer::~ArtViewer()
 {
-	// Cleanup
-	vkCtrl->VulkanError(vkDeviceWaitIdle(vkCtrl->GetVkDevice()));
+	// Cleanup, of whatever a failed setup got to
+	if (vkCtrl != nullptr)
+		vkCtrl->VulkanError(vkDeviceWaitIdle(vkCtrl->GetVkDevice()));
+
+	// Workers first, so no job or completion outlives what it points at
+	delete mWatcher;
+	delete mJobs;
+	// Sprite sheets and thumbnails own descriptor sets from the ImGui pool, which goes below
+	delete mPrefetch;
+	delete mBrowser;
+	delete mCanvas;
+	delete mSimilar;
+	delete mDiffView;
+	delete mPlayback;
+	delete mFrameStore;     // after every animation that may hold its frames
 
-	ImGui_ImplVulkan_Shutdown();
-	ImGui_ImplSDL2_Shutdown();
-	ImGui::DestroyContext();
-	ImGui_ImplVulkanH_DestroyWindow(vkCtrl->GetVkInstance(), vkCtrl->GetVkDevice(), &ImGuiVulkanWindow, vkCtrl->GetVkAllocationCallbacks());
+	if (ImGui::GetCurrentContext() != nullptr)
+	{
+		ImGui_ImplVulkan_Shutdown();
+		ImGui_ImplSDL2_Shutdown();
+		ImGui::DestroyContext();
+	}
+	if (vkCtrl != nullptr)
+	{
+		if (mHeadless)
+			vkCtrl->DestroyOffscreenWindow(&ImGuiVulkanWindow);
+		else
+			ImGui_ImplVulkanH_DestroyWindow(vkCtrl->GetVkInstance(), vkCtrl->GetVkDevice(), &ImGuiVulkanWindow, vkCtrl->GetVkAllocationCallbacks());
+	}
 
 	delete vkCtrl;
 
@@ -90,17 +235,787 @@ ArtViewer::~ArtViewer()
 
 void ArtViewer::ParseInputParams(int argC, char** argV)
 {
-	for (int i = 0; i < argC; i++)
-		fprintf(stdout, argV[i]);
+	for (int i = 1; i < argC; i++)
+	{
+		std::string arg = argV[i];
+		if (arg == "--max-fps" && i + 1 < argC)
+		{
+			mMaxFps = atoi(argV[++i]);
+			if (mMaxFps < 1)
+				mMaxFps = 1;
+		}
+		else if (arg == "--present-mode" && i + 1 < argC)
+		{
+			std::string name = argV[++i];
+			bool found = false;
+			for (const auto& pm : PresentModes)
+				if (name == pm.name)
+				{
+					mPresentMode = pm.mode;
+					found = true;
+				}
+			if (!found)
+				fprintf(stderr, "Unknown present mode %s, expected fifo, mailbox or immediate\n", name.c_str());
+		}
+		else if (arg == "--image-count" && i + 1 < argC)
+		{
+			int count = atoi(argV[++i]);
+			mMinImageCount = (uint32_t)(count < 2 ? 2 : count > (int)MaxSwapChainImages ? MaxSwapChainImages : count);
+		}
+		else if (arg == "--prefetch-mb" && i + 1 < argC)
+		{
+			mPrefetchBudgetMB = atoi(argV[++i]);
+			if (mPrefetchBudgetMB < 0)
+				mPrefetchBudgetMB = 0;
+		}
+		else if (arg == "--trim")
+			mTrimFrames = true;
+		else if (arg == "--no-dedup")
+			mDedupFrames = false;
+		else if (arg == "--no-anim-pacing")
+			mPaceToAnimation = false;
+		else if (arg == "--timing-overlay")
+			mShowPresentTiming = true;
+		else if (arg == "--profiler")
+			mShowProfiler = true;
+		else if (arg == "--profile-log")
+			mProfiler.SetLogOverBudget(true);
+		else if (arg == "--trace" && i + 1 < argC)
+		{
+			mTracePath = argV[++i];
+			mTraceOnExit = true;
+			Trace::SetEnabled(true);
+		}
+		else if (arg == "--headless")
+			mHeadless = true;
+		else if (arg == "--size" && i + 1 < argC)
+		{
+			int width = 0, height = 0;
+			if (sscanf(argV[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+			{
+				windowWidth = width;
+				windowHeight = height;
+			}
+			else
+				fprintf(stderr, "Bad size %s, expected WIDTHxHEIGHT\n", argV[i]);
+		}
+		else if (arg == "--frames" && i + 1 < argC)
+			mHeadlessFrames = std::max(atoi(argV[++i]), 1);
+		else if (arg == "--scenario" && i + 1 < argC)
+			mScenarioPath = argV[++i];
+		else if (arg == "--stats" && i + 1 < argC)
+			mStatsPath = argV[++i];
+		else if (arg == "--record" && i + 1 < argC)
+			mRecordPath = argV[++i];
+		else if (arg == "--replay" && i + 1 < argC)
+			mReplayPath = argV[++i];
+		else if (arg.compare(0, 2, "--") == 0)
+			fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+		else
+			mOpenFiles.push_back(arg);
+	}
+}
+
+
+void ArtViewer::RequestRedraw()
+{
+	if (mWakeEventType == (Uint32)-1)
+		return;
+
+	SDL_Event event = {};
+	event.type = mWakeEventType;
+	SDL_PushEvent(&event);
+}
+
+
+int ArtViewer::GetEventTimeout()
+{
+	// Headless and replayed frames are drawn back to back, nobody is waiting to see them
+	if (mHeadless || mReplaying)
+		return 0;
+
+	if (SDL_GetWindowFlags(SdlWindow) & SDL_WINDOW_MINIMIZED)
+		return mIdleTimeoutMs;
+
+	if (mRedrawFrames > 0)
+		return 0;
+
+	if (mAnimationRequested)
+	{
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (now >= mNextFrameCounter)
+			return 0;
+
+		// Round up so we never wake a fraction of a millisecond early and spin
+		Uint64 left = mNextFrameCounter - now;
+		return (int)((left * 1000 + SDL_GetPerformanceFrequency() - 1) / SDL_GetPerformanceFrequency());
+	}
+
+	return mIdleTimeoutMs;
+}
+
+
+bool ArtViewer::ShouldRenderFrame()
+{
+	if (mHeadless || mReplaying)
+		return true;
+
+	if (SDL_GetWindowFlags(SdlWindow) & SDL_WINDOW_MINIMIZED)
+		return false;
+
+	if (mRedrawFrames > 0)
+		return true;
+
+	return mAnimationRequested && SDL_GetPerformanceCounter() >= mNextFrameCounter;
+}
+
+
+int ArtViewer::GetTargetFrameRate()
+{
+	if (mPaceToAnimation && mAnimationFps > 0)
+	{
+		// Show every animation frame for the same number of presents, otherwise playback judders.
+		// An animation faster than the cap still gets one present per frame.
+		int presents = mMaxFps / mAnimationFps;
+		return mAnimationFps * (presents > 0 ? presents : 1);
+	}
+
+	return mMaxFps;
+}
+
+
+bool ArtViewer::HandleEvent(SDL_Event& event)
+{
+	ImGui_ImplSDL2_ProcessEvent(&event);
+	if (event.type == SDL_WINDOWEVENT &&
+		event.window.event == SDL_WINDOWEVENT_RESIZED && event.window.windowID == SDL_GetWindowID(SdlWindow))
+	{
+		// Note: your own application may rely on SDL_WINDOWEVENT_MINIMIZED/SDL_WINDOWEVENT_RESTORED to skip updating all-together.
+		// Here ImGui_ImplSDL2_NewFrame() will set io.DisplaySize to zero which will disable rendering but let application run.
+		// Please note that you can't Present into a minimized window.
+		mSwapChainResizeWidth = (int)event.window.data1;
+		mSwapChainResizeHeight = (int)event.window.data2;
+		mSwapChainRebuild = true;
+	}
+	if (event.type == SDL_DROPFILE)
+	{
+		OpenFile(event.drop.file);
+		SDL_free(event.drop.file);
+	}
+	if (event.type == SDL_KEYDOWN && !ImGui::GetIO().WantTextInput)
+	{
+		if (event.key.keysym.sym == SDLK_RIGHT || event.key.keysym.sym == SDLK_PAGEDOWN)
+			StepFile(+1);
+		else if (event.key.keysym.sym == SDLK_LEFT || event.key.keysym.sym == SDLK_PAGEUP)
+			StepFile(-1);
+	}
+	return event.type != SDL_QUIT;
+}
+
+
+bool ArtViewer::ReplayEvents()
+{
+	// Loading time differs between runs and builds; input that arrived after a file showed up
+	// when recording waits for it here too
+	if (mPendingOpens > 0 || mBrowser->IsScanning())
+		return true;
+
+	const RecordedFrame* frame = mInput.Next();
+	if (frame == nullptr)
+		return false;
+
+	size_t drop = 0;
+	for (SDL_Event event : frame->events)
+	{
+		if (event.type == SDL_WINDOWEVENT)
+			event.window.windowID = SDL_GetWindowID(SdlWindow);
+		if (event.type == SDL_DROPFILE)
+			event.drop.file = SDL_strdup(frame->drops[drop++].c_str());
+		if (!HandleEvent(event))
+			return false;
+
+		// The SDL backend takes modifiers from the live keyboard state
+		if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
+		{
+			ImGuiIO& io = ImGui::GetIO();
+			io.KeyShift = (event.key.keysym.mod & KMOD_SHIFT) != 0;
+			io.KeyCtrl = (event.key.keysym.mod & KMOD_CTRL) != 0;
+			io.KeyAlt = (event.key.keysym.mod & KMOD_ALT) != 0;
+			io.KeySuper = (event.key.keysym.mod & KMOD_GUI) != 0;
+		}
+	}
+
+	mReplayMousePos = frame->mousePos;
+	mReplayMouseButtons = frame->mouseButtons;
+	return true;
+}
+
+
+void ArtViewer::ReplayMouse()
+{
+	// Replaces what ImGui_ImplSDL2_NewFrame() read from SDL, and the measured frame time
+	ImGuiIO& io = ImGui::GetIO();
+	io.MousePos = mReplayMousePos;
+	for (int i = 0; i < IM_ARRAYSIZE(io.MouseDown); i++)
+		io.MouseDown[i] = (mReplayMouseButtons & (1u << i)) != 0;
+	io.DeltaTime = 1.0f / (float)GetTargetFrameRate();
+}
+
+
+void ArtViewer::RequestSwapChainRebuild()
+{
+	SDL_GetWindowSize(SdlWindow, &mSwapChainResizeWidth, &mSwapChainResizeHeight);
+	mSwapChainRebuild = true;
+}
+
+
+void ArtViewer::RecordPresent()
+{
+	Uint64 now = SDL_GetPerformanceCounter();
+	if (mLastPresentCounter != 0)
+	{
+		float interval = (float)((double)(now - mLastPresentCounter) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+		if (interval < IdlePresentGapMs)
+		{
+			mPresentIntervals[mPresentIntervalOffset] = interval;
+			mPresentIntervalOffset = (mPresentIntervalOffset + 1) % PresentHistorySize;
+			if (mPresentIntervalCount < PresentHistorySize)
+				mPresentIntervalCount++;
+		}
+	}
+	mLastPresentCounter = now;
+}
+
+
+void ArtViewer::ShowMainMenu()
+{
+	if (!ImGui::BeginMainMenuBar())
+		return;
+
+	if (ImGui::BeginMenu("View"))
+	{
+		ImGui::MenuItem("Browser", NULL, &mShowBrowser);
+		ImGui::MenuItem("Playback", NULL, &mShowPlayback);
+		ImGui::MenuItem("Canvas", NULL, &mShowCanvas);
+		ImGui::MenuItem("Duplicate frames", NULL, &mShowDuplicates, mFrameStore != nullptr);
+		ImGui::MenuItem("Similar frames", NULL, &mShowSimilar);
+		ImGui::MenuItem("Differences", NULL, &mShowDiff);
+		ImGui::MenuItem("Display settings", NULL, &mShowDisplaySettings);
+		ImGui::MenuItem("Present timing", NULL, &mShowPresentTiming);
+		ImGui::MenuItem("Profiler", NULL, &mShowProfiler);
+		ImGui::Separator();
+		bool tracing = Trace::IsEnabled();
+		if (ImGui::MenuItem("Record trace", NULL, &tracing))
+			Trace::SetEnabled(tracing);
+		if (ImGui::MenuItem("Save trace", NULL, false, ARTVIEWER_TRACE != 0))
+			Trace::WriteJson(mTracePath);
+		ImGui::Separator();
+		ImGui::MenuItem("ImGui demo", NULL, &mShowDemoWindow);
+		ImGui::EndMenu();
+	}
+
+	ImGui::EndMainMenuBar();
+}
+
+
+void ArtViewer::ShowDuplicates()
+{
+	ImGui::SetNextWindowSize(ImVec2(480.0f, 400.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Duplicate frames", &mShowDuplicates))
+	{
+		ImGui::End();
+		return;
+	}
+
+	FrameStore::Stats stats = mFrameStore->GetStats();
+	ImGui::Text("%d frames, %d unique, %.1f MB held, %.1f MB saved", stats.frames, stats.uniqueFrames,
+		stats.bytes / (1024.0 * 1024.0), stats.savedBytes / (1024.0 * 1024.0));
+	ImGui::Text("%d atlas textures, %d shared, %.1f MB of uploads saved", stats.atlases, stats.sharedAtlases,
+		stats.savedUploadBytes / (1024.0 * 1024.0));
+
+	// Grouping walks every frame held, so it only happens when asked for
+	if (ImGui::Button("Refresh") || (ImGui::IsWindowAppearing() && mDuplicateGroups.empty()))
+		mDuplicateGroups = mFrameStore->GetDuplicateGroups();
+	ImGui::SameLine();
+	ImGui::TextDisabled("%d groups of files loaded so far", (int)mDuplicateGroups.size());
+
+	ImGui::BeginChild("##groups");
+	for (const DuplicateGroup& group : mDuplicateGroups)
+	{
+		ImGui::PushID((void*)(uintptr_t)group.hash);
+		if (ImGui::TreeNode("##group", "%dx%d, %d copies", group.width, group.height, (int)group.frames.size()))
+		{
+			for (const auto& frame : group.frames)
+				ImGui::TextUnformatted(frame.c_str());
+			ImGui::TreePop();
+		}
+		ImGui::PopID();
+	}
+	ImGui::EndChild();
+
+	ImGui::End();
+}
+
+
+void ArtViewer::ShowDisplaySettings()
+{
+	if (!ImGui::Begin("Display settings", &mShowDisplaySettings, ImGuiWindowFlags_AlwaysAutoResize))
+	{
+		ImGui::End();
+		return;
+	}
+
+	if (ImGui::BeginCombo("Present mode", GetPresentModeName(mPresentMode)))
+	{
+		for (const auto& pm : PresentModes)
+			if (ImGui::Selectable(pm.name, pm.mode == mPresentMode) && pm.mode != mPresentMode)
+			{
+				mPresentMode = pm.mode;
+				vkCtrl->SelectPresentMode(&ImGuiVulkanWindow, mPresentMode);
+				RequestSwapChainRebuild();
+			}
+		ImGui::EndCombo();
+	}
+	if (ImGuiVulkanWindow.PresentMode != mPresentMode)
+		ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "Not supported, using %s", GetPresentModeName(ImGuiVulkanWindow.PresentMode));
+
+	int image_count = (int)mMinImageCount;
+	if (ImGui::SliderInt("Swapchain images", &image_count, 2, (int)MaxSwapChainImages))
+	{
+		mMinImageCount = (uint32_t)image_count;
+		RequestSwapChainRebuild();
+	}
+	ImGui::Text("Driver created %u images", ImGuiVulkanWindow.ImageCount);
+
+	ImGui::Separator();
+	ImGui::SliderInt("Max FPS", &mMaxFps, 1, 240);
+	ImGui::Checkbox("Pace to animation rate", &mPaceToAnimation);
+	if (mAnimationFps > 0)
+		ImGui::Text("Animation %d fps, presenting at %d fps", mAnimationFps, GetTargetFrameRate());
+	else
+		ImGui::TextDisabled("No animation playing");
+
+	ImGui::End();
+}
+
+
+void ArtViewer::ShowPresentTiming()
+{
+	const float pad = 10.0f;
+	const ImVec2 display = ImGui::GetIO().DisplaySize;
+	ImGui::SetNextWindowPos(ImVec2(display.x - pad, display.y - pad), ImGuiCond_Always, ImVec2(1.0f, 1.0f));
+	ImGui::SetNextWindowBgAlpha(0.35f);
+
+	ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+		ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
+	if (!ImGui::Begin("Present timing", &mShowPresentTiming, flags))
+	{
+		ImGui::End();
+		return;
+	}
+
+	float target = 1000.0f / (float)GetTargetFrameRate();
+	float mean = 0.0f, jitter = 0.0f, lo = 0.0f, hi = 0.0f;
+	if (mPresentIntervalCount > 0)
+	{
+		lo = hi = mPresentIntervals[0];
+		for (int i = 0; i < mPresentIntervalCount; i++)
+		{
+			mean += mPresentIntervals[i];
+			lo = mPresentIntervals[i] < lo ? mPresentIntervals[i] : lo;
+			hi = mPresentIntervals[i] > hi ? mPresentIntervals[i] : hi;
+		}
+		mean /= (float)mPresentIntervalCount;
+
+		for (int i = 0; i < mPresentIntervalCount; i++)
+			jitter += (mPresentIntervals[i] - mean) * (mPresentIntervals[i] - mean);
+		jitter = sqrtf(jitter / (float)mPresentIntervalCount);
+	}
+
+	ImGui::Text("%s, %u images, target %.2f ms", GetPresentModeName(ImGuiVulkanWindow.PresentMode), ImGuiVulkanWindow.ImageCount, target);
+	ImGui::Text("present-to-present %.2f ms, jitter %.2f ms", mean, jitter);
+	ImGui::Text("min %.2f ms, max %.2f ms", lo, hi);
+
+	int offset = mPresentIntervalCount < PresentHistorySize ? 0 : mPresentIntervalOffset;
+	ImGui::PlotLines("##intervals", mPresentIntervals, mPresentIntervalCount, offset, NULL, 0.0f, target * 2.0f, ImVec2(240.0f, 60.0f));
+
+	// Idle frames are not presented, keep drawing so the numbers describe steady-state pacing
+	ImGui::Checkbox("Continuous redraw", &mContinuousRedraw);
+	if (mContinuousRedraw)
+		RequestAnimationFrame();
+
+	ImGui::End();
+}
+
+
+void ArtViewer::OpenFile(const std::string& fname, bool replace)
+{
+	// Reading and decoding run on a worker unless prefetched, only the sprite sheet upload happens on this thread.
+	// When stepping quickly only the last file asked for is shown.
+	int serial = ++mOpenSerial;
+	mPendingOpens++;
+	mPrefetch->Open(fname, [this, serial, replace](std::shared_ptr<ArtAnimation> anim, const std::string& error)
+	{
+		mPendingOpens--;
+		if (replace && serial != mOpenSerial)
+			return;
+
+		if (!anim)
+		{
+			mOpenError = error;
+			fprintf(stderr, "%s\n", mOpenError.c_str());
+			return;
+		}
+
+		if (replace)
+			mPlayback->Clear();
+
+		int index = mPlayback->AddAnimation(anim);
+		if (index < 0)
+		{
+			mOpenError = mPlayback->GetLastError();
+			fprintf(stderr, "%s\n", mOpenError.c_str());
+			return;
+		}
+
+		// Frames too large for a sprite sheet can only be looked at on the canvas
+		if (anim->sheet == nullptr)
+			mShowCanvas = true;
+
+		PlaybackInstance inst;
+		inst.animation = index;
+		inst.position = ImVec2(64.0f, 96.0f);
+		mPlayback->AddInstance(inst);
+		mPlaybackAnimation = index;
+		mOpenError.clear();
+	});
+}
+
+
+void ArtViewer::ShowEntry(int index, int step)
+{
+	const auto& entries = mBrowser->GetEntries();
+	if (index < 0 || index >= (int)entries.size())
+		return;
+
+	mCurrentEntry = index;
+	mBrowser->Select(index);
+	OpenFile(entries[index].path, true);
+
+	// Most likely the user keeps going the same way, then turns back
+	std::vector<std::string> next;
+	for (int offset : { step, 2 * step, -step })
+		if (index + offset >= 0 && index + offset < (int)entries.size())
+			next.push_back(entries[index + offset].path);
+	mPrefetch->Predict(next);
+}
+
+
+void ArtViewer::StepFile(int step)
+{
+	if (mBrowser->GetEntries().empty())
+		return;
+
+	int count = (int)mBrowser->GetEntries().size();
+	int index = mCurrentEntry < 0 ? 0 : std::min(std::max(mCurrentEntry + step, 0), count - 1);
+	if (index != mCurrentEntry)
+		ShowEntry(index, step);
+}
+
+
+void ArtViewer::UpdateWatchedFiles()
+{
+	if (mWatcher->GetDirectory() != mBrowser->GetDirectory())
+		mWatcher->Watch(mBrowser->GetDirectory());
+
+	// Changes were lost: the listing is read again, cached and playing files are only updated when reported
+	std::vector<FileChange> changes;
+	if (mWatcher->Poll(changes))
+	{
+		mBrowser->OpenDirectory(mBrowser->GetDirectory());
+		mCurrentEntry = -1;
+	}
+	if (changes.empty())
+		return;
+
+	// Entries move when files come and go, stepping continues from the same file
+	std::string current;
+	if (mCurrentEntry >= 0 && mCurrentEntry < (int)mBrowser->GetEntries().size())
+		current = mBrowser->GetEntries()[mCurrentEntry].name;
+	mBrowser->ApplyChanges(changes);
+	if (!current.empty())
+		mCurrentEntry = mBrowser->FindEntry(current);
+
+	for (const FileChange& change : changes)
+	{
+		mPrefetch->Invalidate(change.path);
+		if (change.removed)
+			continue;
+
+		// Playing files are read again and swapped in, a file that no longer decodes keeps playing as it was
+		const auto& animations = mPlayback->GetAnimations();
+		if (std::none_of(animations.begin(), animations.end(), [&](const std::shared_ptr<ArtAnimation>& anim) { return anim->path == change.path; }))
+			continue;
+
+		std::string path = change.path;
+		mPendingOpens++;
+		mPrefetch->Open(path, [this, path](std::shared_ptr<ArtAnimation> anim, const std::string& error)
+		{
+			mPendingOpens--;
+			if (!anim)
+			{
+				mOpenError = error;
+				fprintf(stderr, "%s\n", mOpenError.c_str());
+				return;
+			}
+
+			const auto& animations = mPlayback->GetAnimations();
+			for (int i = 0; i < (int)animations.size(); i++)
+				if (animations[i]->path == path && animations[i] != anim && !mPlayback->ReplaceAnimation(i, anim))
+				{
+					mOpenError = mPlayback->GetLastError();
+					fprintf(stderr, "%s\n", mOpenError.c_str());
+					return;
+				}
+		});
+	}
+}
+
+
+void ArtViewer::FillGrid()
+{
+	auto& animations = mPlayback->GetAnimations();
+	if (animations.empty())
+		return;
+
+	// Stress layout: one instance per cell, staggered so they do not all show the same frame
+	const ArtAnimation& anim = *animations[mPlaybackAnimation];
+	mPlayback->ClearInstances();
+	for (int y = 0; y < mGridRows; y++)
+		for (int x = 0; x < mGridColumns; x++)
+		{
+			PlaybackInstance inst;
+			inst.animation = mPlaybackAnimation;
+			inst.direction = (x + y) % anim.directions;
+			inst.frame = anim.framesPerDirection > 0 ? (x * 3 + y * 5) % anim.framesPerDirection : 0;
+			inst.palette = (x / 4 + y) % anim.paletteCount;
+			inst.position = ImVec2(32.0f + x * 64.0f, 64.0f + y * 64.0f);
+			mPlayback->AddInstance(inst);
+		}
+}
+
+
+void ArtViewer::SetPlaying(bool playing)
+{
+	for (auto& inst : mPlayback->GetInstances())
+		inst.playing = playing;
+}
+
+
+bool ArtViewer::AdvanceScenario()
+{
+	// Captures read back the image last rendered, so there is one before any command runs
+	if (mRenderedFrames == 0)
+		return true;
+
+	if (mScenarioScroll != 0.0f)
+		mBrowser->ScrollBy(mScenarioScroll);
+
+	// Commands between two 'frames'/'wait' run before the same frame
+	for (;;)
+	{
+		if (mScenarioFrames > 0)
+		{
+			mScenarioFrames--;
+			return true;
+		}
+		if (mScenarioWaiting)
+		{
+			if (mPendingOpens > 0 || !mJobs->IsIdle() || mBrowser->IsScanning())
+				return true;
+			mScenarioWaiting = false;
+		}
+
+		const ScenarioCommand* cmd = mScenario.Next();
+		if (cmd == nullptr)
+			return false;
+
+		switch (cmd->op)
+		{
+		case ScenarioOp::Open:       OpenFile(cmd->arg); break;
+		case ScenarioOp::Dir:        mBrowser->OpenDirectory(cmd->arg); mShowBrowser = true; break;
+		case ScenarioOp::Show:       ShowEntry((int)cmd->values[0], +1); break;
+		case ScenarioOp::Next:       StepFile(+1); break;
+		case ScenarioOp::Prev:       StepFile(-1); break;
+		case ScenarioOp::Play:       SetPlaying(true); break;
+		case ScenarioOp::Pause:      SetPlaying(false); break;
+		case ScenarioOp::Zoom:       mPlaybackZoom = cmd->values[0]; break;
+		case ScenarioOp::Scroll:     mScenarioScroll = cmd->values[0]; break;
+		case ScenarioOp::Wait:       mScenarioWaiting = true; break;
+		case ScenarioOp::Frames:     mScenarioFrames = (int)cmd->values[0]; break;
+		case ScenarioOp::ResetStats: mProfiler.StartRecording(); break;
+		case ScenarioOp::Capture:
+			if (!CaptureFrame(cmd->arg))
+				mExitCode = 1;
+			break;
+		case ScenarioOp::Fill:
+			mGridColumns = std::max((int)cmd->values[0], 1);
+			mGridRows = std::max((int)cmd->values[1], 1);
+			FillGrid();
+			break;
+		}
+	}
+}
+
+
+bool ArtViewer::CaptureFrame(const std::string& fname)
+{
+	// The image last rendered to, which is the previous frame: this one has not been built yet
+	std::vector<uint32_t> pixels;
+	if (!vkCtrl->ReadbackFrame(&ImGuiVulkanWindow, pixels))
+	{
+		fprintf(stderr, "Cannot read back the frame for %s\n", fname.c_str());
+		return false;
+	}
+
+	if (!SavePNG(fname, ImGuiVulkanWindow.Width, ImGuiVulkanWindow.Height, pixels.data()))
+	{
+		fprintf(stderr, "Cannot write %s\n", fname.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+void ArtViewer::AdvancePlayback()
+{
+	// After an idle wait there is no elapsed time to catch up on
+	Uint64 now = SDL_GetPerformanceCounter();
+	double elapsed = mLastAdvanceCounter != 0 ? (double)(now - mLastAdvanceCounter) / (double)SDL_GetPerformanceFrequency() : 0.0;
+	if (mReplaying && mLastAdvanceCounter != 0)
+		elapsed = 1.0 / (double)GetTargetFrameRate();
+	mLastAdvanceCounter = mPlayback->IsPlaying() ? now : 0;
+
+	mPlayback->Advance(elapsed);
+
+	if (mPlayback->IsPlaying())
+	{
+		RequestAnimationFrame();
+		SetAnimationFrameRate(mPlayback->GetFrameRate());
+	}
+	else
+		SetAnimationFrameRate(0);
+}
+
+
+void ArtViewer::ShowPlayback()
+{
+	ImGui::SetNextWindowSize(ImVec2(640.0f, 480.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Playback", &mShowPlayback))
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::InputText("##path", mPlaybackPath, sizeof(mPlaybackPath));
+	ImGui::SameLine();
+	if (ImGui::Button("Open") && mPlaybackPath[0] != 0)
+		OpenFile(mPlaybackPath);
+
+	if (ImGui::ArrowButton("##prev", ImGuiDir_Left))
+		StepFile(-1);
+	ImGui::SameLine();
+	if (ImGui::ArrowButton("##next", ImGuiDir_Right))
+		StepFile(+1);
+	ImGui::SameLine();
+	if (mCurrentEntry >= 0)
+		ImGui::Text("%d / %d", mCurrentEntry + 1, (int)mBrowser->GetEntries().size());
+	else
+		ImGui::TextDisabled("Left/Right steps through the browser directory");
+
+	const Prefetcher::Stats& stats = mPrefetch->GetStats();
+	ImGui::TextDisabled("Prefetch: %d hits, %d late, %d misses, %d wasted, %d files / %.1f of %d MB",
+		stats.hits, stats.lateHits, stats.misses, stats.wasted, stats.entries, stats.bytes / (1024.0 * 1024.0), mPrefetchBudgetMB);
+
+	if (mPendingOpens > 0)
+		ImGui::TextDisabled("Loading %d file(s)...", mPendingOpens);
+	if (!mOpenError.empty())
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", mOpenError.c_str());
+
+	auto& animations = mPlayback->GetAnimations();
+	auto& instances = mPlayback->GetInstances();
+
+	if (!animations.empty())
+	{
+		if (ImGui::BeginCombo("Animation", animations[mPlaybackAnimation]->name.c_str()))
+		{
+			for (int i = 0; i < (int)animations.size(); i++)
+				if (ImGui::Selectable(animations[i]->name.c_str(), i == mPlaybackAnimation))
+					mPlaybackAnimation = i;
+			ImGui::EndCombo();
+		}
+		if (animations[mPlaybackAnimation]->trimmedBytes > 0)
+			ImGui::TextDisabled("Trimmed %.1f KB of transparent margins", animations[mPlaybackAnimation]->trimmedBytes / 1024.0);
+
+		// Stress layout: one instance per cell, staggered so they do not all show the same frame
+		ImGui::SliderInt("Columns", &mGridColumns, 1, 256);
+		ImGui::SliderInt("Rows", &mGridRows, 1, 256);
+		if (ImGui::Button("Fill grid"))
+			FillGrid();
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			mPlayback->ClearInstances();
+	}
+
+	if (SpriteRenderer* sprites = vkCtrl->GetSprites())
+		ImGui::Text("%d instances, last frame drew %d sprites in %d batches", (int)instances.size(), sprites->GetInstanceCount(), sprites->GetBatchCount());
+	else
+		ImGui::Text("%d instances", (int)instances.size());
+
+	// Controls apply to every instance at once
+	if (!instances.empty())
+	{
+		PlaybackInstance& first = instances.front();
+		float speed = first.speed;
+		bool reverse = first.reverse, loop = first.loop, playing = first.playing;
+		int direction = first.direction;
+
+		bool changed = ImGui::SliderFloat("Speed", &speed, 0.1f, 4.0f, "%.2fx");
+		changed |= ImGui::Checkbox("Reverse", &reverse);
+		ImGui::SameLine();
+		changed |= ImGui::Checkbox("Loop", &loop);
+		ImGui::SameLine();
+		changed |= ImGui::Checkbox("Play", &playing);
+		bool turned = ImGui::SliderInt("Direction", &direction, 0, 7);
+
+		if (changed || turned)
+			for (auto& inst : instances)
+			{
+				inst.speed = speed;
+				inst.reverse = reverse;
+				inst.loop = loop;
+				inst.playing = playing;
+				if (turned)
+					inst.direction = direction;
+			}
+	}
+	ImGui::SliderFloat("Zoom", &mPlaybackZoom, 0.25f, 4.0f, "%.2fx");
+
+	ImGui::BeginChild("##canvas", ImVec2(0.0f, 0.0f), true, ImGuiWindowFlags_HorizontalScrollbar);
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	mPlayback->Draw(ImGui::GetWindowDrawList(), origin, mPlaybackZoom);
+	ImGui::Dummy(ImVec2((32.0f + mGridColumns * 64.0f) * mPlaybackZoom, (64.0f + mGridRows * 64.0f) * mPlaybackZoom));
+	ImGui::EndChild();
+
+	ImGui::End();
 }
 
 
 int ArtViewer::Run()
 {
-	// Our state
-	bool show_demo_window = true;
-	bool show_another_window = false;
-	ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
+	// Setup, or the script or recording to run, failed already
+	if (mExitCode != 0)
+		return mExitCode;
 
 	// Main loop
 	bool done = false;
@@ -111,26 +1026,64 @@ int ArtViewer::Run()
 		// - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
 		// - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
 		// Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
+		// Nothing changed since the last frame means nothing to draw: block until input arrives, the next
+		// animation frame is due or a worker wakes us with RequestRedraw(), so an idle viewer costs no CPU/GPU.
 		SDL_Event event;
-		while (SDL_PollEvent(&event))
+		int timeout = GetEventTimeout();
+		int has_event = timeout > 0 ? SDL_WaitEventTimeout(&event, timeout) : SDL_PollEvent(&event);
+
+		// The frame is timed from here, the wait above is idle time
+		mProfiler.BeginFrame();
+		AV_TRACE_SCOPE("Frame");
 		{
-			ImGui_ImplSDL2_ProcessEvent(&event);
-			if (event.type == SDL_QUIT)
-				done = true;
-			if (event.type == SDL_WINDOWEVENT &&
-				event.window.event == SDL_WINDOWEVENT_RESIZED && event.window.windowID == SDL_GetWindowID(SdlWindow))
+			ProfileScope scope(&mProfiler, ProfileStage::EventPump);
+			for (; has_event; has_event = SDL_PollEvent(&event))
 			{
-				// Note: your own application may rely on SDL_WINDOWEVENT_MINIMIZED/SDL_WINDOWEVENT_RESTORED to skip updating all-together.
-				// Here ImGui_ImplSDL2_NewFrame() will set io.DisplaySize to zero which will disable rendering but let application run.
-				// Please note that you can't Present into a minimized window.
-				mSwapChainResizeWidth = (int)event.window.data1;
-				mSwapChainResizeHeight = (int)event.window.data2;
-				mSwapChainRebuild = true;
+				Invalidate();
+
+				// Live input would make the replay diverge, only closing the window gets through
+				if (mReplaying)
+				{
+					done |= event.type == SDL_QUIT;
+					if (event.type == SDL_DROPFILE)
+						SDL_free(event.drop.file);
+					continue;
+				}
+
+				if (!mRecordPath.empty() && event.type != mWakeEventType)
+					mInput.AddEvent(event);
+				done |= !HandleEvent(event);
 			}
+
+			if (mReplaying && !done)
+				done = !ReplayEvents();
+		}
+
+		if (done || !ShouldRenderFrame())
+			continue;
+
+		if (mRedrawFrames > 0)
+			mRedrawFrames--;
+
+		// Schedule from the previous deadline rather than from now so the cadence does not drift,
+		// unless we fell more than a frame behind
+		Uint64 now = SDL_GetPerformanceCounter();
+		Uint64 period = SDL_GetPerformanceFrequency() / (Uint64)GetTargetFrameRate();
+		mNextFrameCounter = (mNextFrameCounter + period < now) ? now + period : mNextFrameCounter + period;
+		mAnimationRequested = false;
+
+		// Playback keeps its own fixed-step clock, the frame only shows where it got to
+		{
+			ProfileScope scope(&mProfiler, ProfileStage::Update);
+			AdvancePlayback();
+			mJobs->RunCompletions();
+			UpdateWatchedFiles();
+			if (mHeadless && !mReplaying && !AdvanceScenario())
+				break;
 		}
 
 		// Resize swap chain?
-		if (mSwapChainRebuild && mSwapChainResizeWidth > 0 && mSwapChainResizeHeight > 0)
+		if (mSwapChainRebuild && !mHeadless && mSwapChainResizeWidth > 0 && mSwapChainResizeHeight > 0)
 		{
 			mSwapChainRebuild = false;
 			ImGui_ImplVulkan_SetMinImageCount(mMinImageCount);
@@ -141,58 +1094,103 @@ int ArtViewer::Run()
 		}
 
 		// Start the Dear ImGui frame
-		ImGui_ImplVulkan_NewFrame();
-		ImGui_ImplSDL2_NewFrame(SdlWindow);
-		ImGui::NewFrame();
-
-		// 1. Show the big demo window (Most of the sample code is in ImGui::ShowDemoWindow()! You can browse its code to learn more about Dear ImGui!).
-		if (show_demo_window)
-			ImGui::ShowDemoWindow(&show_demo_window);
-
-		// 2. Show a simple window that we create ourselves. We use a Begin/End pair to created a named window.
 		{
-			static float f = 0.0f;
-			static int counter = 0;
-
-			ImGui::Begin("Hello, world!");                          // Create a window called "Hello, world!" and append into it.
+			ProfileScope scope(&mProfiler, ProfileStage::NewFrame);
+			ImGui_ImplVulkan_NewFrame();
+			ImGui_ImplSDL2_NewFrame(SdlWindow);
+			if (mReplaying)
+				ReplayMouse();
+			else if (!mRecordPath.empty())
+				mInput.EndFrame(ImGui::GetIO());
+			ImGui::NewFrame();
+		}
 
-			ImGui::Text("This is some useful text.");               // Display some text (you can use a format strings too)
-			ImGui::Checkbox("Demo Window", &show_demo_window);      // Edit bools storing our window open/close state
-			ImGui::Checkbox("Another Window", &show_another_window);
+		{
+			ProfileScope scope(&mProfiler, ProfileStage::BuildUI);
+			ShowMainMenu();
+			if (mShowBrowser)
+			{
+				int activated = -1;
+				if (mBrowser->Show(&mShowBrowser, &activated))
+					ShowEntry(activated, +1);
+			}
+			if (mShowPlayback)
+				ShowPlayback();
+			if (mShowCanvas)
+			{
+				auto& animations = mPlayback->GetAnimations();
+				std::shared_ptr<ArtAnimation> anim = mPlaybackAnimation < (int)animations.size() ? animations[mPlaybackAnimation] : nullptr;
+				if (mCanvas->Show(&mShowCanvas, anim))
+					RequestAnimationFrame();
+			}
+			if (mShowSimilar)
+			{
+				// Hashing starts once the browser has the whole directory
+				if (!mBrowser->IsScanning() && !mBrowser->GetDirectory().empty())
+					mSimilar->IndexDirectory(mBrowser->GetDirectory(), mBrowser->GetEntries());
 
-			ImGui::SliderFloat("float", &f, 0.0f, 1.0f);            // Edit 1 float using a slider from 0.0f to 1.0f
-			ImGui::ColorEdit3("clear color", (float*)&clear_color); // Edit 3 floats representing a color
+				auto& animations = mPlayback->GetAnimations();
+				std::shared_ptr<ArtAnimation> anim = mPlaybackAnimation < (int)animations.size() ? animations[mPlaybackAnimation] : nullptr;
+				std::string path;
+				if (mSimilar->Show(&mShowSimilar, anim, &path))
+					OpenFile(path, true);
+			}
+			if (mShowDiff)
+				mDiffView->Show(&mShowDiff, mPlayback->GetAnimations());
+			if (mShowDuplicates && mFrameStore != nullptr)
+				ShowDuplicates();
+			if (mShowDisplaySettings)
+				ShowDisplaySettings();
+			if (mShowPresentTiming)
+				ShowPresentTiming();
 
-			if (ImGui::Button("Button"))                            // Buttons return true when clicked (most widgets return true when edited/activated)
-				counter++;
-			ImGui::SameLine();
-			ImGui::Text("counter = %d", counter);
+			if (mShowProfiler)
+				mProfiler.Show(&mShowProfiler);
 
-			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-			ImGui::End();
+			if (mShowDemoWindow)
+				ImGui::ShowDemoWindow(&mShowDemoWindow);
 		}
 
-		// 3. Show another simple window.
-		if (show_another_window)
+		// Rendering
 		{
-			ImGui::Begin("Another Window", &show_another_window);   // Pass a pointer to our bool variable (the window will have a closing button that will clear the bool when clicked)
-			ImGui::Text("Hello from another window!");
-			if (ImGui::Button("Close Me"))
-				show_another_window = false;
-			ImGui::End();
+			ProfileScope scope(&mProfiler, ProfileStage::Render);
+			ImGui::Render();
 		}
-
-		// Rendering
-		ImGui::Render();
 		ImDrawData* draw_data = ImGui::GetDrawData();
 		const bool is_minimized = (draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f);
 
 		if (!is_minimized)
 		{
-			vkCtrl->FrameRender(&ImGuiVulkanWindow, draw_data);
-			vkCtrl->FramePresent(&ImGuiVulkanWindow);
+			{
+				ProfileScope scope(&mProfiler, ProfileStage::FrameRender);
+				vkCtrl->FrameRender(&ImGuiVulkanWindow, draw_data);
+				mRenderedFrames++;
+			}
+			{
+				ProfileScope scope(&mProfiler, ProfileStage::FramePresent);
+				vkCtrl->FramePresent(&ImGuiVulkanWindow);
+			}
+			RecordPresent();
 		}
+
+		mImGuiHeap.EndFrame();
+		mProfiler.SetMemory(mImGuiHeap.GetLastFrame());
+		mProfiler.SetCacheBytes(mPrefetch->GetStats().bytes);
+		mProfiler.EndFrame(1000.0f / (float)GetTargetFrameRate(), vkCtrl->GetGpuFrameTime());
 	}
 
-	return 0;
+	if (mHeadless || mReplaying)
+		mProfiler.WriteSummary(mStatsPath);
+
+	if (!mRecordPath.empty())
+	{
+		std::string error;
+		if (!mInput.Save(mRecordPath, error))
+			fprintf(stderr, "%s\n", error.c_str());
+	}
+
+	if (mTraceOnExit)
+		Trace::WriteJson(mTracePath);
+
+	return mExitCode;
 }
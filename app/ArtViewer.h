@@ -6,6 +6,21 @@
 #include <SDL_vulkan.h>
 
 #include "artviewer_vulkan.h"
+#include "app/ArtBrowser.h"
+#include "app/ArtPlayback.h"
+#include "app/DiffView.h"
+#include "app/DirectoryWatcher.h"
+#include "app/FrameStore.h"
+#include "app/JobSystem.h"
+#include "app/Prefetcher.h"
+#include "app/Profiler.h"
+#include "app/InputRecording.h"
+#include "app/Scenario.h"
+#include "app/SimilarSearch.h"
+#include "app/TileCanvas.h"
+
+#include <string>
+#include <vector>
 
 class ArtViewer
 {
@@ -20,9 +35,52 @@ public:
 
 	int Run();
 
+	// Safe to call from any thread: wakes the main loop so finished background work gets drawn
+	void RequestRedraw();
+
+	// Called while building a frame to keep the loop drawing, at most GetTargetFrameRate() times a second
+	void RequestAnimationFrame() { mAnimationRequested = true; }
+
+	// Playback rate of the ART animation on screen, 0 when nothing plays
+	void SetAnimationFrameRate(int fps) { mAnimationFps = fps; }
+
 protected:
 	void ParseInputParams(int argC, char** argV);
 
+	// Number of frames to draw after input, ImGui needs a couple to settle hover and layout state
+	void Invalidate(int frames = 3) { mRedrawFrames = frames > mRedrawFrames ? frames : mRedrawFrames; }
+	int  GetEventTimeout();
+	bool ShouldRenderFrame();
+	int  GetTargetFrameRate();
+
+	// False on SDL_QUIT
+	bool HandleEvent(SDL_Event& event);
+	// Replay: handles the events of the next recorded frame, false once the recording is finished
+	bool ReplayEvents();
+	void ReplayMouse();
+
+	void RequestSwapChainRebuild();
+	void RecordPresent();
+
+	void ShowMainMenu();
+	void ShowDisplaySettings();
+	void ShowPresentTiming();
+	void ShowPlayback();
+	void ShowDuplicates();
+
+	// 'replace' shows only this file, as when stepping through a directory
+	void OpenFile(const std::string& fname, bool replace = false);
+	void ShowEntry(int index, int step);
+	void StepFile(int step);
+	void UpdateWatchedFiles();
+	void FillGrid();
+	void SetPlaying(bool playing);
+
+	// Headless runs: executes script commands due before this frame, false once the script is finished
+	bool AdvanceScenario();
+	bool CaptureFrame(const std::string& fname);
+	void AdvancePlayback();
+
 protected:
 	SDL_Window* SdlWindow = 0;
 	ImGui_ImplVulkanH_Window ImGuiVulkanWindow = {};
@@ -40,5 +98,104 @@ protected:
 	int  mSwapChainResizeHeight = 0;
 
 	uint32_t mMinImageCount = 2;
+	VkPresentModeKHR mPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+	Uint32 mWakeEventType = (Uint32)-1;
+	int    mMaxFps = 60;
+	int    mIdleTimeoutMs = 500;
+	int    mRedrawFrames = 1;
+	bool   mAnimationRequested = false;
+	Uint64 mNextFrameCounter = 0;
+
+	// Frame pacing: with an animation playing, present a whole number of times per animation frame
+	bool   mPaceToAnimation = true;
+	int    mAnimationFps = 0;
+
+	bool   mShowDemoWindow = false;
+	bool   mShowDisplaySettings = false;
+	bool   mShowPresentTiming = false;
+	bool   mContinuousRedraw = false;
+
+	// Headless: offscreen images instead of a swapchain, SDL on its dummy video driver, a script drives the UI
+	bool        mHeadless = false;
+	int         mHeadlessFrames = 300;
+	std::string mScenarioPath;
+	std::string mStatsPath = "-";
+	Scenario    mScenario;
+	int         mScenarioFrames = 0;       // still to draw for the current 'frames' command
+	bool        mScenarioWaiting = false;
+	float       mScenarioScroll = 0.0f;
+	int         mRenderedFrames = 0;       // a capture needs one to read back
+
+	// Of Run(): failed setup, scenario, replay or capture, so scripted runs can tell
+	int         mExitCode = 0;
+
+	// --record saves the input of the session on exit, --replay feeds it back instead of live input,
+	// drawing every frame with a fixed step and holding input while files are still loading
+	InputRecording mInput;
+	std::string    mRecordPath;
+	std::string    mReplayPath;
+	bool           mReplaying = false;
+	ImVec2         mReplayMousePos = ImVec2(-FLT_MAX, -FLT_MAX);
+	uint32_t       mReplayMouseButtons = 0;
+
+	bool   mShowProfiler = false;
+
+	FrameProfiler mProfiler;
+	PoolAllocator mImGuiHeap;     // installed before ImGui::CreateContext(), outlives DestroyContext()
+
+	// Set by --trace: recording starts right away and the trace is written there on exit
+	std::string mTracePath = "artviewer_trace.json";
+	bool   mTraceOnExit = false;
+
+	static const int PresentHistorySize = 240;
+	float  mPresentIntervals[PresentHistorySize] = {};
+	int    mPresentIntervalCount = 0;
+	int    mPresentIntervalOffset = 0;
+	Uint64 mLastPresentCounter = 0;
+
+	JobSystem*         mJobs = 0;
+
+	Prefetcher*        mPrefetch = 0;
+	int                mPrefetchBudgetMB = 256;
+	bool               mTrimFrames = false;      // --trim: crop transparent frame margins at load
+
+	// Identical frames and atlases of loaded files are kept once, --no-dedup turns it off
+	FrameStore*        mFrameStore = 0;
+	bool               mDedupFrames = true;
+	bool               mShowDuplicates = false;
+	std::vector<DuplicateGroup> mDuplicateGroups;     // as of the last refresh
+	int                mCurrentEntry = -1;
+	int                mOpenSerial = 0;
+
+	ArtBrowser*        mBrowser = 0;
+	bool               mShowBrowser = true;
+
+	// Follows the browsed directory, changed files are updated in the browser, cache and playback
+	DirectoryWatcher*  mWatcher = 0;
+
+	PlaybackScheduler* mPlayback = 0;
+	std::vector<std::string> mOpenFiles;
+	int    mPendingOpens = 0;
+	std::string mOpenError;
+	bool   mShowPlayback = true;
+	char   mPlaybackPath[512] = {};
+	int    mPlaybackAnimation = 0;
+	int    mGridColumns = 20;
+	int    mGridRows = 10;
+	float  mPlaybackZoom = 1.0f;
+	Uint64 mLastAdvanceCounter = 0;
+
+	// Current animation frame by frame, at any zoom
+	TileCanvas*        mCanvas = 0;
+	bool               mShowCanvas = false;
+
+	// Frames of the browsed directory that look like one of the current animation
+	SimilarSearch*     mSimilar = 0;
+	bool               mShowSimilar = false;
+
+	// How two of the loaded animations differ
+	DiffView*          mDiffView = 0;
+	bool               mShowDiff = false;
 
 };
\ No newline at end of file
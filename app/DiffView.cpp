@@ -0,0 +1,195 @@
+/* OpenArcanum ArtViewer comparison of two loaded files */
+
+#include "app/DiffView.h"
+
+#include "app/FrameStore.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+
+namespace
+{
+	const ImU32 ChangedTint = IM_COL32(255, 40, 40, 110);
+	const ImU32 BoxColor = IM_COL32(255, 220, 0, 255);
+	const int   UnchangedAlpha = 80;
+
+	ImU32 GetColor(const ArtFile& art, unsigned char index, int alpha)
+	{
+		if (art.palette_data.empty())
+			return IM_COL32(index, index, index, alpha);
+		const COLOR_3B& c = art.palette_data[0].colors[index];
+		return IM_COL32(c.r, c.g, c.b, alpha);
+	}
+
+	void AnimationCombo(const char* label, int* index, const std::vector<std::shared_ptr<ArtAnimation>>& animations)
+	{
+		if (!ImGui::BeginCombo(label, animations[*index]->name.c_str()))
+			return;
+		for (int i = 0; i < (int)animations.size(); i++)
+		{
+			ImGui::PushID(i);
+			if (ImGui::Selectable(animations[i]->name.c_str(), i == *index))
+				*index = i;
+			ImGui::PopID();
+		}
+		ImGui::EndCombo();
+	}
+
+	void DescribeFrame(const FrameDiff& frame, char* text, size_t size)
+	{
+		if (frame.added || frame.removed)
+			snprintf(text, size, "#%d  %s", frame.frame, frame.added ? "added" : "removed");
+		else if (frame.resized)
+			snprintf(text, size, "#%d  resized%s", frame.frame, frame.moved ? ", moved" : "");
+		else if (frame.HasPixelChanges())
+			snprintf(text, size, "#%d  %d,%d to %d,%d, %u pixels%s", frame.frame, frame.left, frame.top, frame.right, frame.bottom,
+				frame.changed, frame.moved ? ", moved" : "");
+		else
+			snprintf(text, size, "#%d  moved", frame.frame);
+	}
+}
+
+
+void DiffView::Show(bool* open, const std::vector<std::shared_ptr<ArtAnimation>>& animations)
+{
+	ImGui::SetNextWindowSize(ImVec2(560.0f, 520.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Differences", open))
+	{
+		ImGui::End();
+		return;
+	}
+
+	if (animations.size() < 2)
+	{
+		ImGui::TextDisabled("Open two files to compare them");
+		ImGui::End();
+		return;
+	}
+
+	const int count = static_cast<int>(animations.size());
+	mBeforeIndex = std::min(mBeforeIndex, count - 1);
+	mAfterIndex = std::min(mAfterIndex, count - 1);
+	AnimationCombo("Before", &mBeforeIndex, animations);
+	AnimationCombo("After", &mAfterIndex, animations);
+
+	std::shared_ptr<ArtAnimation> before = animations[mBeforeIndex];
+	std::shared_ptr<ArtAnimation> after = animations[mAfterIndex];
+	if (before != mBefore.lock() || after != mAfter.lock())
+	{
+		mBefore = before;
+		mAfter = after;
+		Compare(*before, *after);
+	}
+
+	const int frames = static_cast<int>(mDiff.frames.size()) + mDiff.same_frames;
+	if (mDiff.IsSame())
+		ImGui::Text("Same header, palettes and %d frames, compared in %.2f ms", frames, mCompareMs);
+	else
+		ImGui::Text("%d of %d frames differ, compared in %.2f ms", (int)mDiff.frames.size(), frames, mCompareMs);
+	for (const auto& field : mDiff.header)
+		ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "%s", field.c_str());
+	for (const PaletteDiff& palette : mDiff.palettes)
+		ImGui::TextColored(ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "palette %d: %d entries", palette.palette, palette.entries);
+
+	ImGui::BeginChild("##frames", ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 8.0f), true);
+	ImGuiListClipper clipper((int)mDiff.frames.size());
+	while (clipper.Step())
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			char label[128];
+			DescribeFrame(mDiff.frames[i], label, sizeof(label));
+			ImGui::PushID(i);
+			if (ImGui::Selectable(label, i == mSelected))
+				mSelected = i;
+			ImGui::PopID();
+		}
+	ImGui::EndChild();
+
+	ImGui::SliderFloat("Zoom", &mZoom, 1.0f, 16.0f, "%.0fx");
+	ImGui::SameLine();
+	ImGui::Checkbox("Show before", &mShowBefore);
+
+	if (mSelected >= 0 && mSelected < (int)mDiff.frames.size())
+		DrawFrame(*before, *after, mDiff.frames[mSelected]);
+	else
+		ImGui::TextDisabled("Select a frame to see its changed pixels");
+
+	ImGui::End();
+}
+
+
+void DiffView::Compare(const ArtAnimation& before, const ArtAnimation& after)
+{
+	AV_TRACE_SCOPE("DiffView::Compare");
+	auto start = std::chrono::steady_clock::now();
+
+	// The frame store keeps one copy of equal pixels, so frames decoded through it are the same when
+	// they share it. Without the store both files' pixels are decoded and compared as they are.
+	auto same_pixels = [&](int i)
+	{
+		if (!before.frames.empty() && !after.frames.empty())
+			return before.frames[i] == after.frames[i];
+		return before.art.frame_data[i].IsSameContent(after.art.frame_data[i]);
+	};
+	mDiff = diff_art(before.art, after.art, same_pixels,
+		[&](int i, int y) { return before.GetFrameRow(i, y); }, [&](int i, int y) { return after.GetFrameRow(i, y); });
+
+	mCompareMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	mSelected = mDiff.frames.empty() ? -1 : 0;
+}
+
+
+void DiffView::DrawFrame(const ArtAnimation& before, const ArtAnimation& after, const FrameDiff& frame)
+{
+	// Frames only one file has, or of another size, are all change
+	const bool show_before = frame.removed || (mShowBefore && !frame.added);
+	const ArtAnimation& shown = show_before ? before : after;
+	const ArtAnimation& other = show_before ? after : before;
+	const bool compare = !frame.added && !frame.removed && !frame.resized;
+	const ARTFrameHeader& fh = shown.art.frame_data[frame.frame].header;
+	const int width = static_cast<int>(fh.width);
+	const int height = static_cast<int>(fh.height);
+
+	ImGui::BeginChild("##frame", ImVec2(0.0f, 0.0f), true, ImGuiWindowFlags_HorizontalScrollbar);
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	const float zoom = mZoom;
+
+	// Only the rows in view, each cut into runs of one index that all changed or all did not
+	const int first_row = std::max(0, static_cast<int>(floorf((drawList->GetClipRectMin().y - origin.y) / zoom)));
+	const int last_row = std::min(height - 1, static_cast<int>(floorf((drawList->GetClipRectMax().y - origin.y) / zoom)));
+	for (int y = first_row; y <= last_row; y++)
+	{
+		const unsigned char* row = shown.GetFrameRow(frame.frame, y);
+		const unsigned char* other_row = compare ? other.GetFrameRow(frame.frame, y) : nullptr;
+		auto is_changed = [&](int x) { return other_row == nullptr || other_row[x] != row[x]; };
+
+		for (int x = 0; x < width;)
+		{
+			const unsigned char index = row[x];
+			const bool changed = is_changed(x);
+			int end = x + 1;
+			while (end < width && row[end] == index && is_changed(end) == changed)
+				end++;
+
+			ImVec2 p0(origin.x + x * zoom, origin.y + y * zoom);
+			ImVec2 p1(origin.x + end * zoom, origin.y + (y + 1) * zoom);
+			if (index != 0)
+				drawList->AddRectFilled(p0, p1, GetColor(shown.art, index, changed ? 255 : UnchangedAlpha));
+			if (changed)
+				drawList->AddRectFilled(p0, p1, ChangedTint);
+			x = end;
+		}
+	}
+
+	if (frame.HasPixelChanges())
+		drawList->AddRect(ImVec2(origin.x + frame.left * zoom - 1.0f, origin.y + frame.top * zoom - 1.0f),
+			ImVec2(origin.x + (frame.right + 1) * zoom + 1.0f, origin.y + (frame.bottom + 1) * zoom + 1.0f), BoxColor);
+
+	ImGui::Dummy(ImVec2(width * zoom, height * zoom));
+	ImGui::EndChild();
+}
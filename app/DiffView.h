@@ -0,0 +1,41 @@
+/* OpenArcanum ArtViewer comparison of two loaded files */
+
+#pragma once
+
+#include "imgui.h"
+#include "app/ArtPlayback.h"
+#include "formats/diff.h"
+
+#include <memory>
+#include <vector>
+
+// The header fields, palettes and frames in which one loaded animation differs from another, as diff_art()
+// finds them for --diff, and the selected frame drawn with its changed pixels highlighted. Frames decoded
+// through the frame store that share its copy are passed over, only the others are compared pixel by pixel.
+class DiffView
+{
+public:
+	DiffView() = default;
+
+	DiffView(const DiffView&) = delete;
+	DiffView(DiffView&&) = delete;
+
+	void Show(bool* open, const std::vector<std::shared_ptr<ArtAnimation>>& animations);
+
+protected:
+	void Compare(const ArtAnimation& before, const ArtAnimation& after);
+	void DrawFrame(const ArtAnimation& before, const ArtAnimation& after, const FrameDiff& frame);
+
+protected:
+	// Not kept alive by the view, a closed file is compared again
+	std::weak_ptr<ArtAnimation> mBefore;
+	std::weak_ptr<ArtAnimation> mAfter;
+	int     mBeforeIndex = 0;
+	int     mAfterIndex = 1;
+
+	ArtDiff mDiff;
+	double  mCompareMs = 0.0;
+	int     mSelected = -1;          // in mDiff.frames
+	float   mZoom = 4.0f;
+	bool    mShowBefore = false;
+};
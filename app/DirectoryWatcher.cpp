@@ -0,0 +1,203 @@
+/* OpenArcanum ArtViewer directory change notifications */
+
+#include "app/DirectoryWatcher.h"
+
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#define ARTVIEWER_INOTIFY 1
+#else
+#define ARTVIEWER_INOTIFY 0
+#endif
+
+
+namespace
+{
+	bool IsWatchedFile(const char* name)
+	{
+		const char* dot = strrchr(name, '.');
+		if (dot == nullptr)
+			return false;
+
+		std::string ext = dot;
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return ext == ".art" || ext == ".bmp";
+	}
+}
+
+
+DirectoryWatcher::DirectoryWatcher(std::function<void()> wake)
+	: mWake(std::move(wake))
+{
+}
+
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	Stop();
+}
+
+
+bool DirectoryWatcher::Watch(const std::string& directory)
+{
+	Stop();
+	mDirectory = directory;
+
+#if ARTVIEWER_INOTIFY
+	mNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mNotifyFd < 0 || pipe(mStopPipe) != 0)
+	{
+		fprintf(stderr, "Cannot watch %s: %s\n", directory.c_str(), strerror(errno));
+		Stop();
+		return false;
+	}
+
+	// Written files are reported on close, IN_MODIFY only restarts the debounce of files still being written
+	const uint32_t mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+	if (inotify_add_watch(mNotifyFd, directory.c_str(), mask) < 0)
+	{
+		fprintf(stderr, "Cannot watch %s: %s\n", directory.c_str(), strerror(errno));
+		Stop();
+		return false;
+	}
+
+	mThread = std::thread(&DirectoryWatcher::WatcherMain, this);
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void DirectoryWatcher::Stop()
+{
+#if ARTVIEWER_INOTIFY
+	if (mThread.joinable())
+	{
+		char quit = 0;
+		if (write(mStopPipe[1], &quit, 1) != 1)
+			fprintf(stderr, "Cannot stop directory watcher: %s\n", strerror(errno));
+		mThread.join();
+	}
+
+	for (int* fd : { &mNotifyFd, &mStopPipe[0], &mStopPipe[1] })
+	{
+		if (*fd >= 0)
+			close(*fd);
+		*fd = -1;
+	}
+#endif
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mReady.clear();
+	mOverflow = false;
+}
+
+
+bool DirectoryWatcher::Poll(std::vector<FileChange>& changes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	changes.insert(changes.end(), mReady.begin(), mReady.end());
+	mReady.clear();
+
+	bool overflow = mOverflow;
+	mOverflow = false;
+	return overflow;
+}
+
+
+void DirectoryWatcher::WatcherMain()
+{
+#if ARTVIEWER_INOTIFY
+	AV_TRACE_THREAD_NAME("watcher");
+
+	using Clock = std::chrono::steady_clock;
+	std::unordered_map<std::string, Clock::time_point> pending;     // file name to time of its last event
+
+	alignas(struct inotify_event) char buffer[16 * 1024];
+	while (true)
+	{
+		// Sleep until something happens or the oldest pending file has been quiet long enough
+		int timeout = -1;
+		Clock::time_point now = Clock::now();
+		for (const auto& it : pending)
+		{
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(it.second + std::chrono::milliseconds(DebounceMs) - now).count();
+			timeout = timeout < 0 ? (int)std::max<long long>(left, 0) : std::min(timeout, (int)std::max<long long>(left, 0));
+		}
+
+		pollfd fds[2] = {};
+		fds[0].fd = mNotifyFd;
+		fds[0].events = POLLIN;
+		fds[1].fd = mStopPipe[0];
+		fds[1].events = POLLIN;
+		if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+			break;
+		if (fds[1].revents != 0)
+			break;
+
+		bool overflow = false;
+		if (fds[0].revents & POLLIN)
+		{
+			ssize_t len;
+			while ((len = read(mNotifyFd, buffer, sizeof(buffer))) > 0)
+			{
+				now = Clock::now();
+				for (char* p = buffer; p < buffer + len; )
+				{
+					const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+					if (event->mask & IN_Q_OVERFLOW)
+						overflow = true;
+					else if (event->len > 0 && IsWatchedFile(event->name))
+						pending[event->name] = now;
+					p += sizeof(inotify_event) + event->len;
+				}
+			}
+		}
+
+		// Whatever state a settled file is in now is what gets reported
+		std::vector<FileChange> settled;
+		now = Clock::now();
+		for (auto it = pending.begin(); it != pending.end();)
+		{
+			if (now - it->second < std::chrono::milliseconds(DebounceMs))
+			{
+				++it;
+				continue;
+			}
+
+			FileChange change;
+			change.name = it->first;
+			change.path = (std::filesystem::path(mDirectory) / it->first).string();
+			std::error_code ec;
+			change.removed = !std::filesystem::is_regular_file(change.path, ec);
+			change.size = change.removed ? 0 : std::filesystem::file_size(change.path, ec);
+			settled.push_back(std::move(change));
+			it = pending.erase(it);
+		}
+
+		if (settled.empty() && !overflow)
+			continue;
+
+		AV_TRACE_INSTANT("Directory changed", mDirectory.c_str());
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mReady.insert(mReady.end(), settled.begin(), settled.end());
+			mOverflow |= overflow;
+		}
+		mWake();
+	}
+#endif
+}
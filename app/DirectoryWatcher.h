@@ -0,0 +1,59 @@
+/* OpenArcanum ArtViewer directory change notifications */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A file in the watched directory that settled after being created, written, renamed or deleted
+struct FileChange
+{
+	std::string path;
+	std::string name;
+	uintmax_t   size = 0;
+	bool        removed = false;
+};
+
+// Watches one directory, not recursively, for .art and .bmp files with inotify on a thread of its own.
+// A burst of writes to a file is reported once, after the file has been quiet for DebounceMs.
+// On platforms without inotify Watch() fails and nothing is ever reported.
+class DirectoryWatcher
+{
+public:
+	static const int DebounceMs = 250;
+
+	// 'wake' is called from the watcher thread when changes are waiting for Poll()
+	explicit DirectoryWatcher(std::function<void()> wake);
+	~DirectoryWatcher();
+
+	DirectoryWatcher(const DirectoryWatcher&) = delete;
+	DirectoryWatcher(DirectoryWatcher&&) = delete;
+
+	// Replaces the watched directory, changes not polled yet are dropped
+	bool Watch(const std::string& directory);
+	void Stop();
+
+	auto GetDirectory() -> const std::string& { return mDirectory; }
+
+	// Render thread: settled changes since the last call. Returns true when the kernel queue overflowed
+	// and changes were lost, the directory then has to be read again.
+	bool Poll(std::vector<FileChange>& changes);
+
+protected:
+	void WatcherMain();
+
+protected:
+	std::function<void()> mWake;
+	std::string           mDirectory;
+	std::thread           mThread;
+	int                   mNotifyFd = -1;
+	int                   mStopPipe[2] = { -1, -1 };
+
+	std::mutex              mMutex;
+	std::vector<FileChange> mReady;
+	bool                    mOverflow = false;
+};
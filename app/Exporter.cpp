@@ -0,0 +1,863 @@
+/* OpenArcanum ArtViewer batch export */
+
+#include "app/Exporter.h"
+
+#include "formats/art.h"
+#include "formats/atlas.h"
+#include "formats/quantize.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <sstream>
+
+
+namespace
+{
+	bool HasExtension(const std::filesystem::path& path, const char* wanted)
+	{
+		std::string ext = path.extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return ext == wanted;
+	}
+
+	std::string CsvString(const std::string& str)
+	{
+		std::string out = "\"";
+		for (char c : str)
+		{
+			if (c == '"')
+				out += '"';
+			out += c;
+		}
+		return out + "\"";
+	}
+
+	// "200-215,220" to the set of those indices
+	bool ParseColors(const std::string& text, PaletteUsage& usage)
+	{
+		std::stringstream list(text);
+		std::string range;
+		while (std::getline(list, range, ','))
+		{
+			int first = 0, last = 0;
+			int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+			if (fields == 1)
+				last = first;
+			if (fields < 1 || first < 0 || last > 255 || first > last)
+				return false;
+			for (int i = first; i <= last; i++)
+				usage.Set(i);
+		}
+		return !text.empty();
+	}
+}
+
+
+bool Exporter::ParseArgs(int argC, char** argV, ExportOptions& options)
+{
+	if (std::none_of(argV + 1, argV + argC, [](const char* arg) { return strcmp(arg, "--export") == 0 || strcmp(arg, "--find-colors") == 0 || strcmp(arg, "--find-similar") == 0 || strcmp(arg, "--diff") == 0; }))
+		return false;
+
+	for (int i = 1; i < argC; i++)
+	{
+		std::string arg = argV[i];
+		if (arg == "--export" && i + 1 < argC)
+		{
+			std::string format = argV[++i];
+			if (format == "png")
+				options.format = ExportFormat::PNG;
+			else if (format == "sheet")
+				options.format = ExportFormat::Sheet;
+			else if (format == "art")
+				options.format = ExportFormat::Art;
+			else if (format == "stats")
+				options.format = ExportFormat::Stats;
+			else
+				fprintf(stderr, "Unknown export format %s, expected png, sheet, art or stats\n", format.c_str());
+		}
+		else if (arg == "--dither")
+			options.dither = true;
+		else if (arg == "--trim")
+			options.trim = true;
+		else if (arg == "--out" && i + 1 < argC)
+			options.outDir = argV[++i];
+		else if (arg == "--find-colors" && i + 1 < argC)
+			options.findColors = argV[++i];
+		else if (arg == "--find-similar" && i + 1 < argC)
+			options.findSimilar = argV[++i];
+		else if (arg == "--frame" && i + 1 < argC)
+			options.similarFrame = atoi(argV[++i]);
+		else if (arg == "--distance" && i + 1 < argC)
+			options.similarDistance = std::min(std::max(atoi(argV[++i]), 0), 64);
+		else if (arg == "--index" && i + 1 < argC)
+			options.indexPath = argV[++i];
+		else if (arg == "--diff")
+			options.diff = true;
+		else if (arg == "--threads" && i + 1 < argC)
+			options.threads = std::max(atoi(argV[++i]), 0);
+		else if (arg.compare(0, 2, "--") == 0)
+			fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+		else
+			options.inputs.push_back(arg);
+	}
+	return true;
+}
+
+
+Exporter::Exporter(const ExportOptions& options)
+	: mOptions(options)
+{
+	// No render thread to leave a core for
+	int workers = mOptions.threads > 0 ? mOptions.threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+	mJobs = new JobSystem([this]() { Wake(); }, workers);
+}
+
+
+Exporter::~Exporter()
+{
+	delete mJobs;
+}
+
+
+void Exporter::Wake()
+{
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mWoken = true;
+	}
+	mWakeCond.notify_one();
+}
+
+
+void Exporter::WaitForJobs()
+{
+	while (!mJobs->IsIdle())
+	{
+		{
+			std::unique_lock<std::mutex> lock(mWakeMutex);
+			mWakeCond.wait_for(lock, std::chrono::milliseconds(100), [this]() { return mWoken; });
+			mWoken = false;
+		}
+		mJobs->RunCompletions();
+	}
+	mJobs->RunCompletions();
+}
+
+
+auto Exporter::FileFailed(const std::string& path, const char* reason) -> JobSystem::Completion
+{
+	std::string message = path + ": " + reason;
+	return [this, message]()
+	{
+		fprintf(stderr, "Cannot process %s\n", message.c_str());
+		mFailedFiles++;
+	};
+}
+
+
+void Exporter::ReportTrim(const std::string& path, size_t bytes)
+{
+	if (!mOptions.trim)
+		return;
+	printf("%s: trimmed %.1f KB\n", path.c_str(), bytes / 1024.0);
+	mTrimmedBytes += bytes;
+}
+
+
+int Exporter::Run()
+{
+	if (!mOptions.findColors.empty())
+		return FindColors();
+	if (!mOptions.findSimilar.empty())
+		return FindSimilar();
+	if (mOptions.diff)
+		return Diff();
+	if (mOptions.format == ExportFormat::None)
+		return 1;
+
+	std::error_code ec;
+	std::filesystem::create_directories(mOptions.outDir, ec);
+	if (!std::filesystem::is_directory(mOptions.outDir, ec))
+	{
+		fprintf(stderr, "Cannot create %s\n", mOptions.outDir.c_str());
+		return 1;
+	}
+
+	const char* extension = mOptions.format == ExportFormat::Art ? ".ini" : ".art";
+	std::vector<std::string> files;
+	for (const auto& input : mOptions.inputs)
+	{
+		if (!std::filesystem::is_directory(input, ec))
+		{
+			files.push_back(input);
+			continue;
+		}
+
+		for (std::filesystem::directory_iterator it(input, ec), end; !ec && it != end; it.increment(ec))
+			if (it->is_regular_file(ec) && HasExtension(it->path(), extension))
+				files.push_back(it->path().string());
+	}
+
+	if (files.empty())
+	{
+		fprintf(stderr, "Nothing to export\n");
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (const auto& path : files)
+		mJobs->Submit(JobPriority::Background, mToken, [this, path](const CancelToken&) -> JobSystem::Completion
+		{
+			// A corrupt file may fail with anything on the way, e.g. bad_alloc for a huge frame, only that file fails
+			try
+			{
+				switch (mOptions.format)
+				{
+				case ExportFormat::Sheet: return ExportSheet(path);
+				case ExportFormat::Art:   return ImportFile(path);
+				case ExportFormat::Stats: return AnalyzeFile(path);
+				default:                  return ExportFile(path);
+				}
+			}
+			catch (std::exception& e)
+			{
+				return FileFailed(path, e.what());
+			}
+		});
+
+	WaitForJobs();
+	if (mOptions.format == ExportFormat::Stats && !SaveStats())
+		mFailedFiles++;
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Exported %d frames of %d files to %s in %.2f s, %.1f MB read, %.1f MB written\n",
+		mFrames, mFiles, mOptions.outDir.c_str(), seconds, mBytesIn / (1024.0 * 1024.0), mBytesOut / (1024.0 * 1024.0));
+	if (mOptions.trim)
+		printf("Trimmed %.1f KB of transparent margins\n", mTrimmedBytes / 1024.0);
+	if (mOptions.format == ExportFormat::Stats)
+		printf("%d frames fully transparent, %.1f%% of all pixels opaque\n", mTransparentFrames, mPixels > 0 ? 100.0 * mOpaquePixels / mPixels : 0.0);
+	if (mFailedFiles > 0 || mFailedFrames > 0)
+		fprintf(stderr, "%d files and %d frames could not be exported\n", mFailedFiles, mFailedFrames);
+
+	return mFailedFiles > 0 || mFailedFrames > 0 ? 1 : 0;
+}
+
+
+auto Exporter::ExportFile(const std::string& path) -> JobSystem::Completion
+{
+	AV_TRACE_SCOPE_DETAIL("Export file", path.c_str());
+
+	// Frames stay RLE encoded, each frame job decodes its rows as it writes them; trimming needs them decoded
+	auto art = std::make_shared<ArtFile>();
+	try
+	{
+		art->LoadArt(path, mOptions.trim);
+	}
+	catch (MissingFile& mf)
+	{
+		return [this, mf]()
+		{
+			fprintf(stderr, "Cannot read %s\n", mf.filename.c_str());
+			mFailedFiles++;
+		};
+	}
+
+	size_t trimmed = mOptions.trim ? art->TrimFrames() : 0;
+	std::string base = (std::filesystem::path(mOptions.outDir) / std::filesystem::path(path).stem()).string();
+	if (!art->SaveIni(base))
+		return FileFailed(path, ("cannot write " + base + ".ini").c_str());
+
+	// Written ahead of the files still to be read
+	for (int i = 0; i < static_cast<int>(art->frame_data.size()); i++)
+		mJobs->Submit(JobPriority::Prefetch, mToken, [this, art, base, i](const CancelToken&) -> JobSystem::Completion
+		{
+			try
+			{
+				return ExportFrame(art, base, i);
+			}
+			catch (std::exception& e)
+			{
+				std::string message = art->GetFrameFileName(base, i, ".png") + ": " + e.what();
+				return [this, message]()
+				{
+					fprintf(stderr, "Cannot write %s\n", message.c_str());
+					mFailedFrames++;
+				};
+			}
+		});
+
+	std::error_code ec;
+	uintmax_t size = std::filesystem::file_size(path, ec);
+	uintmax_t written = std::filesystem::file_size(base + ".ini", ec);
+	return [this, path, size, written, trimmed]()
+	{
+		ReportTrim(path, trimmed);
+		mFiles++;
+		mBytesIn += size;
+		mBytesOut += written;
+	};
+}
+
+
+auto Exporter::ExportSheet(const std::string& path) -> JobSystem::Completion
+{
+	AV_TRACE_SCOPE_DETAIL("Export sheet", path.c_str());
+
+	ArtFile art;
+	try
+	{
+		art.LoadArt(path);
+	}
+	catch (MissingFile& mf)
+	{
+		return [this, mf]()
+		{
+			fprintf(stderr, "Cannot read %s\n", mf.filename.c_str());
+			mFailedFiles++;
+		};
+	}
+
+	size_t trimmed = mOptions.trim ? art.TrimFrames() : 0;
+	std::string base = (std::filesystem::path(mOptions.outDir) / std::filesystem::path(path).stem()).string();
+	ArtAtlas atlas;
+	std::vector<std::string> files;
+	bool ok = atlas.SaveSheet(art, base, files);
+
+	std::error_code ec;
+	uintmax_t size = std::filesystem::file_size(path, ec);
+	uintmax_t written = 0;
+	for (const auto& name : files)
+		written += std::filesystem::file_size(name, ec);
+	int frames = static_cast<int>(art.frame_data.size());
+	return [this, ok, path, size, written, frames, trimmed]()
+	{
+		ReportTrim(path, trimmed);
+		mBytesIn += size;
+		mBytesOut += written;
+		if (!ok)
+		{
+			fprintf(stderr, "Cannot write a sprite sheet of %s\n", path.c_str());
+			mFailedFiles++;
+			return;
+		}
+		mFiles++;
+		mFrames += frames;
+	};
+}
+
+
+auto Exporter::ExportFrame(const std::shared_ptr<ArtFile>& art, const std::string& base, int frame) -> JobSystem::Completion
+{
+	// Empty frames have no PNG, the .ini still lists them
+	const ARTFrameHeader& fh = art->frame_data[frame].header;
+	if (fh.width == 0 || fh.height == 0)
+		return {};
+
+	bool ok = art->SavePNG(base, frame);
+	std::string name = art->GetFrameFileName(base, frame, ".png");
+	std::error_code ec;
+	uintmax_t written = ok ? std::filesystem::file_size(name, ec) : 0;
+	return [this, ok, name, written]()
+	{
+		if (!ok)
+		{
+			fprintf(stderr, "Cannot write %s\n", name.c_str());
+			mFailedFrames++;
+			return;
+		}
+		mFrames++;
+		mBytesOut += written;
+	};
+}
+
+
+auto Exporter::AnalyzeFile(const std::string& path) -> JobSystem::Completion
+{
+	AV_TRACE_SCOPE_DETAIL("Analyze file", path.c_str());
+
+	// Frames stay RLE encoded, summaries are read straight from it
+	ArtFile art;
+	try
+	{
+		art.LoadArt(path, false);
+	}
+	catch (MissingFile& mf)
+	{
+		return [this, mf]()
+		{
+			fprintf(stderr, "Cannot read %s\n", mf.filename.c_str());
+			mFailedFiles++;
+		};
+	}
+
+	std::string rows;
+	std::vector<PaletteUsage> usage;
+	std::vector<uint64_t> hashes;
+	std::string name = CsvString(path);
+	CTABLE_255 palette = get_hash_palette(art);
+	int transparent = 0;
+	uint64_t opaque = 0, pixels = 0;
+	for (size_t i = 0; i < art.frame_data.size(); i++)
+	{
+		const ARTFrameHeader& fh = art.frame_data[i].header;
+		FrameSummary summary = art.frame_data[i].Summarize();
+		char line[160];
+		snprintf(line, sizeof(line), ",%d,%lu,%lu,%u,%d,%d,%d,%d,%d\n", static_cast<int>(i), fh.width, fh.height,
+			summary.opaque, summary.left, summary.top, summary.right, summary.bottom, summary.GetColorCount());
+		rows += name + line;
+		usage.push_back(PaletteUsage::FromHistogram(summary.histogram));
+		hashes.push_back(perceptual_hash(art.frame_data[i], palette));
+
+		transparent += summary.IsTransparent();
+		opaque += summary.opaque;
+		pixels += static_cast<uint64_t>(fh.width) * fh.height;
+	}
+
+	std::error_code ec;
+	uintmax_t size = std::filesystem::file_size(path, ec);
+	int frames = static_cast<int>(art.frame_data.size());
+	return [this, path, rows, usage, hashes, size, frames, transparent, opaque, pixels]()
+	{
+		mStats.push_back({ path, rows, usage, hashes });
+		mFiles++;
+		mFrames += frames;
+		mBytesIn += size;
+		mTransparentFrames += transparent;
+		mOpaquePixels += opaque;
+		mPixels += pixels;
+	};
+}
+
+
+bool Exporter::SaveStats()
+{
+	std::sort(mStats.begin(), mStats.end(), [](const FileStats& a, const FileStats& b) { return a.path < b.path; });
+
+	std::string fname = (std::filesystem::path(mOptions.outDir) / "art_stats.csv").string();
+	FILE* file = fopen(fname.c_str(), "wb");
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Cannot write %s\n", fname.c_str());
+		return false;
+	}
+
+	std::string csv = "file,frame,width,height,opaque,left,top,right,bottom,colors\n";
+	for (const auto& stats : mStats)
+		csv += stats.rows;
+	bool ok = fwrite(csv.data(), 1, csv.size(), file) == csv.size();
+	ok = fclose(file) == 0 && ok;
+	if (ok)
+		mBytesOut += csv.size();
+
+	UsageIndexWriter index;
+	for (const auto& stats : mStats)
+		index.AddFile(stats.path, stats.usage);
+	std::string index_name = (std::filesystem::path(mOptions.outDir) / "art_usage.idx").string();
+	if (!index.Save(index_name))
+	{
+		fprintf(stderr, "Cannot write %s\n", index_name.c_str());
+		return false;
+	}
+	std::error_code ec;
+	mBytesOut += std::filesystem::file_size(index_name, ec);
+
+	SimilarityIndex similar;
+	for (const auto& stats : mStats)
+	{
+		int file = similar.AddFile(stats.path);
+		for (size_t i = 0; i < stats.hashes.size(); i++)
+			similar.Add(stats.hashes[i], file, static_cast<int>(i));
+	}
+	std::string similar_name = (std::filesystem::path(mOptions.outDir) / "art_similar.idx").string();
+	if (!similar.Save(similar_name))
+	{
+		fprintf(stderr, "Cannot write %s\n", similar_name.c_str());
+		return false;
+	}
+	mBytesOut += std::filesystem::file_size(similar_name, ec);
+	return ok;
+}
+
+
+int Exporter::FindColors()
+{
+	PaletteUsage mask;
+	if (!ParseColors(mOptions.findColors, mask))
+	{
+		fprintf(stderr, "Bad palette indices %s, expected e.g. 200-215,220\n", mOptions.findColors.c_str());
+		return 1;
+	}
+
+	std::string fname = !mOptions.indexPath.empty() ? mOptions.indexPath : (std::filesystem::path(mOptions.outDir) / "art_usage.idx").string();
+	auto start = std::chrono::steady_clock::now();
+	UsageIndex index;
+	if (!index.Open(fname))
+	{
+		fprintf(stderr, "Cannot read the palette usage index %s, --export stats writes it\n", fname.c_str());
+		return 1;
+	}
+
+	int files = 0, frames = 0;
+	std::string out;
+	index.Query(mask, [&](int file, const std::vector<int>& hits)
+	{
+		out += index.GetFileName(file) + ":";
+		for (int frame : hits)
+			out += " " + std::to_string(frame);
+		out += "\n";
+		files++;
+		frames += static_cast<int>(hits.size());
+	});
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	fputs(out.c_str(), stdout);
+	printf("%d frames of %d files out of %d use %s, %.2f ms\n", frames, files, index.GetFileCount(), mOptions.findColors.c_str(), ms);
+	return 0;
+}
+
+
+auto Exporter::ImportFile(const std::string& path) -> JobSystem::Completion
+{
+	AV_TRACE_SCOPE_DETAIL("Import file", path.c_str());
+
+	auto import = std::make_shared<Import>();
+	import->art = std::make_shared<ArtFile>();
+	try
+	{
+		import->art->LoadIni(path);
+	}
+	catch (MissingFile& mf)
+	{
+		return [this, mf]()
+		{
+			fprintf(stderr, "Cannot read %s\n", mf.filename.c_str());
+			mFailedFiles++;
+		};
+	}
+
+	// SaveBMPS names the .ini after the whole .art name, the PNG export after its stem
+	ArtFile& art = *import->art;
+	std::filesystem::path name = std::filesystem::path(path).stem();
+	if (!HasExtension(name, ".art"))
+		name += ".art";
+	import->target = (std::filesystem::path(mOptions.outDir) / name).string();
+	import->baseName = path.substr(0, path.size() - 4);
+	import->mapper = std::make_shared<PaletteMapper>(art.palette_data.empty() ? CTABLE_255() : art.palette_data[0]);
+	import->pending = static_cast<int>(art.frame_data.size());
+
+	// Frames are encoded by the jobs that load them, ahead of reading more .ini files
+	for (int i = 0; i < import->pending; i++)
+		mJobs->Submit(JobPriority::Prefetch, mToken, [this, import, i](const CancelToken&) -> JobSystem::Completion
+		{
+			size_t trimmed = 0;
+			try
+			{
+				import->art->LoadFrameBMP(import->baseName, i, *import->mapper, mOptions.dither);
+				trimmed = mOptions.trim ? import->art->frame_data[i].Trim(true) : 0;
+				import->art->frame_data[i].Encode();
+			}
+			catch (std::exception& e)
+			{
+				std::string message = import->art->GetFrameFileName(import->baseName, i, ".bmp") + ": " + e.what();
+				return [this, import, message]()
+				{
+					fprintf(stderr, "Cannot read %s\n", message.c_str());
+					mFailedFrames++;
+					import->failed = true;
+					FrameImported(import);
+				};
+			}
+
+			std::error_code ec;
+			uintmax_t size = std::filesystem::file_size(import->art->GetFrameFileName(import->baseName, i, ".bmp"), ec);
+			return [this, import, size, trimmed]()
+			{
+				import->bytesIn += size;
+				import->trimmedBytes += trimmed;
+				mFrames++;
+				FrameImported(import);
+			};
+		});
+
+	// Frame completions may well have run before this one, only a file without frames is saved here
+	std::error_code ec;
+	uintmax_t size = std::filesystem::file_size(path, ec);
+	bool empty = art.frame_data.empty();
+	return [this, import, size, empty]()
+	{
+		mBytesIn += size;
+		if (empty)
+			SubmitSave(import);
+	};
+}
+
+
+void Exporter::FrameImported(const std::shared_ptr<Import>& import)
+{
+	if (--import->pending > 0)
+		return;
+	if (import->failed)
+	{
+		fprintf(stderr, "Not writing %s, some of its frames could not be read\n", import->target.c_str());
+		mFailedFiles++;
+		return;
+	}
+	SubmitSave(import);
+}
+
+
+void Exporter::SubmitSave(const std::shared_ptr<Import>& import)
+{
+	mJobs->Submit(JobPriority::Visible, mToken, [this, import](const CancelToken&) -> JobSystem::Completion
+	{
+		AV_TRACE_SCOPE_DETAIL("Save art", import->target.c_str());
+		bool ok = true;
+		try
+		{
+			import->art->SaveArt(import->target, false);
+		}
+		catch (std::exception&)
+		{
+			ok = false;
+		}
+
+		std::error_code ec;
+		uintmax_t written = std::filesystem::file_size(import->target, ec);
+		ok = ok && !ec;
+		return [this, import, written, ok]()
+		{
+			mBytesIn += import->bytesIn;
+			if (!ok)
+			{
+				fprintf(stderr, "Cannot write %s\n", import->target.c_str());
+				mFailedFiles++;
+				return;
+			}
+			ReportTrim(import->target, import->trimmedBytes);
+			mFiles++;
+			mBytesOut += written;
+		};
+	});
+}
+
+
+int Exporter::FindSimilar()
+{
+	std::string fname = !mOptions.indexPath.empty() ? mOptions.indexPath : (std::filesystem::path(mOptions.outDir) / "art_similar.idx").string();
+	auto start = std::chrono::steady_clock::now();
+	SimilarityIndex index;
+	if (!index.Load(fname))
+	{
+		fprintf(stderr, "Cannot read the similarity index %s, --export stats writes it\n", fname.c_str());
+		return 1;
+	}
+	double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	ArtFile art;
+	try
+	{
+		art.LoadArt(mOptions.findSimilar);
+	}
+	catch (MissingFile& mf)
+	{
+		fprintf(stderr, "Cannot read %s\n", mf.filename.c_str());
+		return 1;
+	}
+	catch (std::exception& e)
+	{
+		fprintf(stderr, "Cannot read %s: %s\n", mOptions.findSimilar.c_str(), e.what());
+		return 1;
+	}
+
+	int first = 0, last = static_cast<int>(art.frame_data.size()) - 1;
+	if (mOptions.similarFrame >= 0)
+	{
+		if (mOptions.similarFrame > last)
+		{
+			fprintf(stderr, "%s has %d frames\n", mOptions.findSimilar.c_str(), last + 1);
+			return 1;
+		}
+		first = last = mOptions.similarFrame;
+	}
+
+	// The file itself is most likely in the index too, its own frames are left out
+	std::error_code ec;
+	std::filesystem::path self = std::filesystem::weakly_canonical(mOptions.findSimilar, ec);
+	std::vector<bool> is_self(index.files.size());
+	for (size_t i = 0; i < index.files.size(); i++)
+		is_self[i] = std::filesystem::weakly_canonical(index.files[i], ec) == self;
+
+	CTABLE_255 palette = get_hash_palette(art);
+	start = std::chrono::steady_clock::now();
+	int matches = 0;
+	std::string out;
+	for (int frame = first; frame <= last; frame++)
+	{
+		uint64_t hash = perceptual_hash(art.frame_data[frame], palette);
+		for (const SimilarFrame& found : index.Search(hash, mOptions.similarDistance))
+		{
+			if (is_self[found.file] && found.frame == frame)
+				continue;
+			char line[64];
+			snprintf(line, sizeof(line), " #%d, distance %d\n", found.frame, found.distance);
+			out += "frame " + std::to_string(frame) + ": " + index.files[found.file] + line;
+			matches++;
+		}
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	fputs(out.c_str(), stdout);
+	printf("%d similar frames among %d in %d files, index loaded in %.1f ms, searched in %.2f ms\n",
+		matches, index.GetFrameCount(), static_cast<int>(index.files.size()), load_ms, ms);
+	return 0;
+}
+
+
+int Exporter::Diff()
+{
+	if (mOptions.inputs.size() != 2)
+	{
+		fprintf(stderr, "--diff compares two files or two directories\n");
+		return 2;
+	}
+	const std::string& before = mOptions.inputs[0];
+	const std::string& after = mOptions.inputs[1];
+
+	// Directories pair their .art files by name, not recursively, as they are exported
+	std::error_code ec;
+	std::vector<std::pair<std::string, std::string>> pairs;
+	int unpaired = 0;
+	if (std::filesystem::is_directory(before, ec) && std::filesystem::is_directory(after, ec))
+	{
+		std::map<std::string, int> names;     // bit 0: in 'before', bit 1: in 'after'
+		for (int side = 0; side < 2; side++)
+			for (std::filesystem::directory_iterator it(mOptions.inputs[side], ec), end; !ec && it != end; it.increment(ec))
+				if (it->is_regular_file(ec) && HasExtension(it->path(), ".art"))
+					names[it->path().filename().string()] |= 1 << side;
+
+		for (const auto& name : names)
+		{
+			if (name.second == 3)
+				pairs.emplace_back((std::filesystem::path(before) / name.first).string(), (std::filesystem::path(after) / name.first).string());
+			else
+			{
+				printf("Only in %s: %s\n", name.second == 1 ? before.c_str() : after.c_str(), name.first.c_str());
+				unpaired++;
+			}
+		}
+	}
+	else
+		pairs.emplace_back(before, after);
+
+	auto start = std::chrono::steady_clock::now();
+	for (const auto& pair : pairs)
+		mJobs->Submit(JobPriority::Background, mToken, [this, pair](const CancelToken&) -> JobSystem::Completion
+		{
+			try
+			{
+				return DiffFiles(pair.first, pair.second);
+			}
+			catch (std::exception& e)
+			{
+				return FileFailed(pair.second, e.what());
+			}
+		});
+	WaitForJobs();
+
+	std::sort(mDiffs.begin(), mDiffs.end(), [](const FileDiff& a, const FileDiff& b) { return a.path < b.path; });
+	int differ = 0;
+	std::string out;
+	for (const FileDiff& file : mDiffs)
+	{
+		out += file.report;
+		differ += !file.same;
+	}
+	fputs(out.c_str(), stdout);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%d of %d files differ, %d of %d frames, %d files in only one place, %.2f s, %.1f MB read\n",
+		differ, mFiles, mChangedFrames, mFrames, unpaired, seconds, mBytesIn / (1024.0 * 1024.0));
+	if (mFailedFiles > 0)
+	{
+		fprintf(stderr, "%d files could not be read\n", mFailedFiles);
+		return 2;
+	}
+	return differ > 0 || unpaired > 0 ? 1 : 0;
+}
+
+
+auto Exporter::DiffFiles(const std::string& before, const std::string& after) -> JobSystem::Completion
+{
+	AV_TRACE_SCOPE_DETAIL("Diff file", after.c_str());
+
+	// Frames stay RLE encoded, only those whose data differs get decoded
+	ArtFile a, b;
+	try
+	{
+		a.LoadArt(before, false);
+		b.LoadArt(after, false);
+	}
+	catch (MissingFile& mf)
+	{
+		return [this, mf]()
+		{
+			fprintf(stderr, "Cannot read %s\n", mf.filename.c_str());
+			mFailedFiles++;
+		};
+	}
+
+	ArtDiff diff = diff_art(a, b);
+	auto file = std::make_shared<FileDiff>();
+	file->path = after;
+	file->same = diff.IsSame();
+	if (!file->same)
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "%s: %d of %d frames differ\n", after.c_str(), static_cast<int>(diff.frames.size()),
+			static_cast<int>(std::max(a.frame_data.size(), b.frame_data.size())));
+		file->report = line;
+		for (const auto& field : diff.header)
+			file->report += "  " + field + "\n";
+		for (const PaletteDiff& palette : diff.palettes)
+		{
+			snprintf(line, sizeof(line), "  palette %d: %d entries\n", palette.palette, palette.entries);
+			file->report += line;
+		}
+		for (const FrameDiff& frame : diff.frames)
+		{
+			if (frame.added || frame.removed)
+				snprintf(line, sizeof(line), "  frame %d: %s\n", frame.frame, frame.added ? "added" : "removed");
+			else if (frame.resized)
+				snprintf(line, sizeof(line), "  frame %d: resized %lux%lu -> %lux%lu%s\n", frame.frame,
+					a.frame_data[frame.frame].header.width, a.frame_data[frame.frame].header.height,
+					b.frame_data[frame.frame].header.width, b.frame_data[frame.frame].header.height, frame.moved ? ", moved" : "");
+			else if (frame.HasPixelChanges())
+				snprintf(line, sizeof(line), "  frame %d: %d,%d to %d,%d, %u pixels%s\n", frame.frame,
+					frame.left, frame.top, frame.right, frame.bottom, frame.changed, frame.moved ? ", moved" : "");
+			else
+				snprintf(line, sizeof(line), "  frame %d: moved\n", frame.frame);
+			file->report += line;
+		}
+	}
+
+	std::error_code ec;
+	uintmax_t size = std::filesystem::file_size(before, ec) + std::filesystem::file_size(after, ec);
+	int frames = static_cast<int>(std::max(a.frame_data.size(), b.frame_data.size()));
+	int changed = static_cast<int>(diff.frames.size());
+	return [this, file, size, frames, changed]()
+	{
+		mDiffs.push_back(std::move(*file));
+		mFiles++;
+		mFrames += frames;
+		mChangedFrames += changed;
+		mBytesIn += size;
+	};
+}
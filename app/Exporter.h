@@ -0,0 +1,156 @@
+/* OpenArcanum ArtViewer batch export */
+
+#pragma once
+
+#include "app/JobSystem.h"
+#include "formats/diff.h"
+#include "formats/similar.h"
+#include "formats/usage.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ArtFile;
+struct PaletteMapper;
+
+enum class ExportFormat
+{
+	None,
+	PNG,
+	Sheet,
+	Art,
+	Stats,
+};
+
+// Command line conversion, run instead of the viewer so it needs neither a display nor a GPU:
+//
+//   artviewer --export png|sheet --out <dir> [--trim] [--threads <n>] <file.art | directory> ...
+//   artviewer --export art --out <dir> [--dither] [--trim] [--threads <n>] <file.ini | directory> ...
+//   artviewer --export stats --out <dir> [--threads <n>] <file.art | directory> ...
+//   artviewer --find-colors <first[-last]>,... [--index <art_usage.idx>]
+//   artviewer --find-similar <file.art> [--frame <n>] [--distance <bits>] [--index <art_similar.idx>]
+//   artviewer --diff [--threads <n>] <before.art | directory> <after.art | directory>
+//
+// png: <name>.ini as written by SaveBMPS plus one palettised <name>_N.png per frame
+// sheet: all frames packed into <name>_pN.png, one per palette, with rects and offsets in <name>.json
+// art: the way back, <name>.ini with its <name>_N.bmp frames, 8, 24 or 32-bit, into <name>.art
+// stats: art_stats.csv, size, bounding box, opaque pixels and colours of every frame, read from the
+// RLE data without decoding it, art_usage.idx, the palette indices each file and frame uses, and
+// art_similar.idx, a perceptual hash of every frame
+// --find-colors lists the files and frames using any of the given palette indices, from such an index
+// --find-similar lists the frames that look like those of a file, closest first
+// --diff lists the header fields, palettes and frames that differ, with the box of the changed pixels
+// of every frame, between two files or the .art files of the same name in two directories; exits
+// with 0 when they are all the same, 1 when some differ and 2 when some could not be read
+// --trim crops the transparent margins of every frame and reports the bytes saved per file
+struct ExportOptions
+{
+	ExportFormat format = ExportFormat::None;
+	std::string  outDir = ".";
+	int          threads = 0;      // 0: one per core
+	bool         dither = false;   // art: ordered dithering of truecolor frames
+	bool         trim = false;
+	std::string  findColors;       // query instead of export, e.g. "200-215,220"
+	std::string  findSimilar;      // .art file whose frames to look for
+	int          similarFrame = -1;     // -1: all of them
+	int          similarDistance = 8;   // in bits of the 64-bit hash
+	std::string  indexPath;        // of the query, <outDir>/art_usage.idx or art_similar.idx by default
+	bool         diff = false;     // compare the two inputs instead
+	std::vector<std::string> inputs;
+};
+
+// Files are read by jobs of their own. For png every frame is then written by another job, ahead of
+// reading more files, so only the files being written are held in memory; a sheet is written by
+// the job that read its file.
+class Exporter
+{
+public:
+	// False when the command line is for the viewer
+	static bool ParseArgs(int argC, char** argV, ExportOptions& options);
+
+	explicit Exporter(const ExportOptions& options);
+	~Exporter();
+
+	Exporter(const Exporter&) = delete;
+	Exporter(Exporter&&) = delete;
+
+	// Process exit code, 0 when everything was written
+	int Run();
+
+protected:
+	void Wake();
+	void WaitForJobs();
+	void ReportTrim(const std::string& path, size_t bytes);
+	auto FileFailed(const std::string& path, const char* reason) -> JobSystem::Completion;
+	auto ExportFile(const std::string& path) -> JobSystem::Completion;
+	auto ExportSheet(const std::string& path) -> JobSystem::Completion;
+	auto ExportFrame(const std::shared_ptr<ArtFile>& art, const std::string& base, int frame) -> JobSystem::Completion;
+	auto AnalyzeFile(const std::string& path) -> JobSystem::Completion;
+	bool SaveStats();
+	int  FindColors();
+	int  FindSimilar();
+	int  Diff();
+	auto DiffFiles(const std::string& before, const std::string& after) -> JobSystem::Completion;
+
+	// One .ini to import: its frames load on jobs of their own, the .art is written after the last one
+	struct Import
+	{
+		std::shared_ptr<ArtFile>       art;
+		std::shared_ptr<PaletteMapper> mapper;
+		std::string                    baseName;     // of the .ini and its BMPs
+		std::string                    target;
+		int                            pending = 0;  // frames still loading, main thread only
+		uintmax_t                      bytesIn = 0;
+		size_t                         trimmedBytes = 0;
+		bool                           failed = false;  // a frame could not be loaded, nothing is saved
+	};
+
+	auto ImportFile(const std::string& path) -> JobSystem::Completion;
+	void FrameImported(const std::shared_ptr<Import>& import);
+	void SubmitSave(const std::shared_ptr<Import>& import);
+
+protected:
+	ExportOptions mOptions;
+	JobSystem*    mJobs = 0;
+	CancelToken   mToken;
+
+	std::mutex              mWakeMutex;
+	std::condition_variable mWakeCond;
+	bool                    mWoken = false;
+
+	// Main thread only, counted by the jobs' completions
+	int       mFiles = 0;
+	int       mFailedFiles = 0;
+	int       mFrames = 0;
+	int       mFailedFrames = 0;
+	uintmax_t mBytesIn = 0;
+	uintmax_t mBytesOut = 0;
+	size_t    mTrimmedBytes = 0;
+
+	// stats: per file, sorted by path before they are written
+	struct FileStats
+	{
+		std::string               path;
+		std::string               rows;      // CSV lines
+		std::vector<PaletteUsage> usage;     // per frame
+		std::vector<uint64_t>     hashes;    // perceptual_hash() per frame
+	};
+	std::vector<FileStats> mStats;
+	int       mTransparentFrames = 0;
+	uint64_t  mOpaquePixels = 0;
+	uint64_t  mPixels = 0;
+
+	// diff: per pair of files, sorted by path before they are printed
+	struct FileDiff
+	{
+		std::string path;
+		std::string report;
+		bool        same = true;
+	};
+	std::vector<FileDiff> mDiffs;
+	int       mChangedFrames = 0;
+};
@@ -0,0 +1,211 @@
+/* OpenArcanum ArtViewer content-addressed frame store */
+
+#include "app/FrameStore.h"
+
+#include "artviewer_vulkan.h"
+#include "app/ArtPlayback.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+	bool IsSameFrame(const StoredFrame& stored, const ArtFrame& frame)
+	{
+		if (stored.width != static_cast<int>(frame.header.width) || stored.height != static_cast<int>(frame.header.height))
+			return false;
+		for (int y = 0; y < stored.height; y++)
+			if (memcmp(stored.GetRow(y), frame.pixels[y].data(), stored.width) != 0)
+				return false;
+		return true;
+	}
+
+	bool IsSameRect(const AtlasRect& a, const AtlasRect& b)
+	{
+		return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+	}
+}
+
+
+FrameStore::FrameStore(VulkanController* vkCtrl)
+	: mVkCtrl(vkCtrl)
+{
+}
+
+
+FrameStore::~FrameStore()
+{
+	// Animations release what they hold, only one outliving the store leaves anything behind
+	for (auto& it : mAtlases)
+		mVkCtrl->DestroyTexture(it.second.texture);
+}
+
+
+auto FrameStore::Intern(ArtFrame& frame, uint64_t hash, const ArtAnimation* owner, int index) -> std::shared_ptr<const StoredFrame>
+{
+	AV_TRACE_SCOPE("FrameStore::Intern");
+
+	const int width = static_cast<int>(frame.header.width);
+	const int height = static_cast<int>(frame.header.height);
+	if (frame.pixels.size() != static_cast<size_t>(height))
+		frame.Decode();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Hash collisions are told apart by the indices themselves
+	auto range = mFrames.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+		if (IsSameFrame(*it->second.frame, frame))
+		{
+			it->second.users.push_back({ owner, index });
+			bytemap().swap(frame.pixels);
+			return it->second.frame;
+		}
+
+	auto stored = std::make_shared<StoredFrame>();
+	stored->hash = hash;
+	stored->width = width;
+	stored->height = height;
+	stored->indices.resize(static_cast<size_t>(width) * height);
+	for (int y = 0; y < height; y++)
+		std::copy(frame.pixels[y].begin(), frame.pixels[y].begin() + width, stored->indices.begin() + static_cast<size_t>(y) * width);
+	bytemap().swap(frame.pixels);
+
+	Entry entry;
+	entry.frame = stored;
+	entry.users.push_back({ owner, index });
+	mFrames.emplace(hash, std::move(entry));
+	return stored;
+}
+
+
+void FrameStore::Release(const ArtAnimation* owner, const std::vector<std::shared_ptr<const StoredFrame>>& frames)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (const auto& frame : frames)
+	{
+		auto range = mFrames.equal_range(frame->hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.frame != frame)
+				continue;
+
+			auto& users = it->second.users;
+			users.erase(std::remove_if(users.begin(), users.end(), [owner](const FrameUser& u) { return u.owner == owner; }), users.end());
+			if (users.empty())
+				mFrames.erase(it);
+			break;
+		}
+	}
+}
+
+
+auto FrameStore::AcquireAtlas(uint64_t key, const ArtAtlas& layout, const std::vector<std::shared_ptr<const StoredFrame>>& frames,
+	const uint8_t* indices) -> VulkanTexture*
+{
+	// Stored frames are unique by content, so the same frames in the same rects make the same image
+	auto range = mAtlases.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		Atlas& atlas = it->second;
+		if (atlas.width == layout.width && atlas.height == layout.height && atlas.frames == frames &&
+			std::equal(atlas.rects.begin(), atlas.rects.end(), layout.rects.begin(), layout.rects.end(), IsSameRect))
+		{
+			atlas.users++;
+			return atlas.texture;
+		}
+	}
+
+	VulkanTexture* texture = mVkCtrl->CreateTexture(layout.width, layout.height, VK_FORMAT_R8_UNORM, indices);
+	if (texture == nullptr)
+		return nullptr;
+
+	Atlas atlas;
+	atlas.texture = texture;
+	atlas.bytes = static_cast<size_t>(layout.width) * layout.height;
+	atlas.users = 1;
+	atlas.width = layout.width;
+	atlas.height = layout.height;
+	atlas.rects = layout.rects;
+	atlas.frames = frames;
+	mAtlases.emplace(key, std::move(atlas));
+	return texture;
+}
+
+
+void FrameStore::ReleaseAtlas(uint64_t key, const VulkanTexture* texture)
+{
+	auto range = mAtlases.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (it->second.texture != texture)
+			continue;
+
+		// Sheets still recorded for the GPU keep sampling it, destruction waits for them
+		if (--it->second.users == 0)
+		{
+			mVkCtrl->DestroyTexture(it->second.texture);
+			mAtlases.erase(it);
+		}
+		return;
+	}
+}
+
+
+auto FrameStore::GetStats() -> Stats
+{
+	Stats stats;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (const auto& it : mFrames)
+		{
+			size_t bytes = it.second.frame->indices.size();
+			stats.frames += static_cast<int>(it.second.users.size());
+			stats.uniqueFrames++;
+			stats.bytes += bytes;
+			stats.savedBytes += bytes * (it.second.users.size() - 1);
+		}
+	}
+
+	for (const auto& it : mAtlases)
+	{
+		stats.atlases++;
+		stats.sharedAtlases += it.second.users - 1;
+		stats.savedUploadBytes += it.second.bytes * (it.second.users - 1);
+	}
+	return stats;
+}
+
+
+auto FrameStore::GetDuplicateGroups() -> std::vector<DuplicateGroup>
+{
+	std::vector<DuplicateGroup> groups;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (const auto& it : mFrames)
+		{
+			if (it.second.users.size() < 2)
+				continue;
+
+			const StoredFrame& frame = *it.second.frame;
+			DuplicateGroup group;
+			group.hash = frame.hash;
+			group.width = frame.width;
+			group.height = frame.height;
+			for (const FrameUser& user : it.second.users)
+				group.frames.push_back(user.owner->name + " #" + std::to_string(user.index));
+			std::sort(group.frames.begin(), group.frames.end());
+			groups.push_back(std::move(group));
+		}
+	}
+
+	auto saving = [](const DuplicateGroup& g) { return static_cast<size_t>(g.width) * g.height * (g.frames.size() - 1); };
+	std::sort(groups.begin(), groups.end(), [&](const DuplicateGroup& a, const DuplicateGroup& b)
+	{
+		return saving(a) != saving(b) ? saving(a) > saving(b) : a.hash < b.hash;
+	});
+	return groups;
+}
@@ -0,0 +1,114 @@
+/* OpenArcanum ArtViewer content-addressed frame store */
+
+#pragma once
+
+#include "formats/art.h"
+#include "formats/atlas.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VulkanController;
+struct VulkanTexture;
+struct ArtAnimation;
+
+// Decoded indices of one frame, top-down rows of 'width' bytes
+struct StoredFrame
+{
+	uint64_t hash = 0;
+	int      width = 0;
+	int      height = 0;
+	bytevec  indices;
+
+	auto GetRow(int y) const -> const unsigned char* { return &indices[static_cast<size_t>(y) * width]; }
+};
+
+// Frames with the same size and indices, wherever they were loaded from
+struct DuplicateGroup
+{
+	uint64_t hash = 0;
+	int      width = 0;
+	int      height = 0;
+	std::vector<std::string> frames;     // "name.art #N"
+};
+
+// Frames and atlas textures of every loaded animation, addressed by content. A frame identical to one
+// held already, from the same or another file, is kept once and shared. A file whose atlas packs the
+// same frames the same way as another's, e.g. a recolour that only has other palettes, draws from the
+// same texture. Both are reference counted by the animations using them.
+class FrameStore
+{
+public:
+	explicit FrameStore(VulkanController* vkCtrl);
+	~FrameStore();
+
+	FrameStore(const FrameStore&) = delete;
+	FrameStore(FrameStore&&) = delete;
+
+	// Any thread: takes the decoded pixels of 'frame', which is left without any. 'hash' is its
+	// ArtFrame::GetContentHash(), 'owner' and 'index' say where it is used.
+	auto Intern(ArtFrame& frame, uint64_t hash, const ArtAnimation* owner, int index) -> std::shared_ptr<const StoredFrame>;
+	// Any thread: every frame interned for 'owner' is no longer used by it
+	void Release(const ArtAnimation* owner, const std::vector<std::shared_ptr<const StoredFrame>>& frames);
+
+	// Render thread: texture for 'layout', whose ArtAtlas::GetContentHash() is 'key' and whose rects hold
+	// 'frames' as interned for it, created from 'indices' unless another file has it already. Another
+	// file's atlas is only taken when it packs the same stored frames into the same rects, hash
+	// collisions get a texture of their own. Null when the texture cannot be created.
+	auto AcquireAtlas(uint64_t key, const ArtAtlas& layout, const std::vector<std::shared_ptr<const StoredFrame>>& frames,
+		const uint8_t* indices) -> VulkanTexture*;
+	void ReleaseAtlas(uint64_t key, const VulkanTexture* texture);
+
+	struct Stats
+	{
+		int    frames = 0;            // in use by loaded files
+		int    uniqueFrames = 0;
+		size_t bytes = 0;             // decoded indices held
+		size_t savedBytes = 0;        // what the duplicates would hold on their own
+		int    atlases = 0;
+		int    sharedAtlases = 0;     // files drawing from an atlas another file uploaded
+		size_t savedUploadBytes = 0;
+	};
+	auto GetStats() -> Stats;
+
+	// Frames used more than once, largest saving first
+	auto GetDuplicateGroups() -> std::vector<DuplicateGroup>;
+
+protected:
+	struct FrameUser
+	{
+		const ArtAnimation* owner;
+		int                 index;
+	};
+
+	struct Entry
+	{
+		std::shared_ptr<StoredFrame> frame;
+		std::vector<FrameUser>       users;
+	};
+
+	struct Atlas
+	{
+		VulkanTexture* texture = nullptr;
+		size_t         bytes = 0;
+		int            users = 0;
+
+		// What the texture was created from, to tell apart atlases whose hashes collide
+		int                    width = 0;
+		int                    height = 0;
+		std::vector<AtlasRect> rects;
+		std::vector<std::shared_ptr<const StoredFrame>> frames;
+	};
+
+protected:
+	VulkanController* mVkCtrl;
+
+	std::mutex                               mMutex;
+	std::unordered_multimap<uint64_t, Entry> mFrames;
+
+	std::unordered_multimap<uint64_t, Atlas> mAtlases;     // render thread only
+};
@@ -0,0 +1,205 @@
+/* OpenArcanum ArtViewer input recording and replay */
+
+#include "app/InputRecording.h"
+
+#include <algorithm>
+#include <fstream>
+
+
+namespace
+{
+	const char     RecordingMagic[4] = { 'A', 'V', 'I', 'R' };
+	const uint32_t RecordingVersion = 1;
+
+	// File layout, little endian as written by the recording machine:
+	//   header, then per frame a FrameHeader followed by its events as raw SDL_Event,
+	//   each SDL_DROPFILE event followed by a uint32_t length and the file name
+	struct RecordingHeader
+	{
+		char     magic[4];
+		uint32_t version;
+		uint32_t eventSize;      // sizeof(SDL_Event) of the recording build
+		uint32_t frames;
+	};
+
+	struct FrameHeader
+	{
+		float    deltaTime;
+		float    mouseX;
+		float    mouseY;
+		uint32_t mouseButtons;
+		uint32_t events;
+	};
+
+	template <typename T>
+	void Write(std::ofstream& dst, const T& value)
+	{
+		dst.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	bool Read(std::ifstream& src, T& value)
+	{
+		return static_cast<bool>(src.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+}
+
+
+void InputRecording::AddEvent(const SDL_Event& event)
+{
+	mCurrent.events.push_back(event);
+	if (event.type == SDL_DROPFILE)
+	{
+		// The string is freed once the event is handled
+		mCurrent.drops.push_back(event.drop.file != nullptr ? event.drop.file : "");
+		mCurrent.events.back().drop.file = nullptr;
+	}
+}
+
+
+void InputRecording::EndFrame(const ImGuiIO& io)
+{
+	mCurrent.deltaTime = io.DeltaTime;
+	mCurrent.mousePos = io.MousePos;
+	mCurrent.mouseButtons = 0;
+	for (int i = 0; i < IM_ARRAYSIZE(io.MouseDown); i++)
+		mCurrent.mouseButtons |= io.MouseDown[i] ? 1u << i : 0u;
+
+	mFrames.push_back(std::move(mCurrent));
+	mCurrent = RecordedFrame();
+}
+
+
+bool InputRecording::Save(const std::string& path, std::string& error) const
+{
+	std::ofstream dst(path, std::ios_base::binary);
+	if (!dst)
+	{
+		error = "Cannot write input recording " + path;
+		return false;
+	}
+
+	RecordingHeader header;
+	std::copy(RecordingMagic, RecordingMagic + 4, header.magic);
+	header.version = RecordingVersion;
+	header.eventSize = sizeof(SDL_Event);
+	header.frames = (uint32_t)mFrames.size();
+	Write(dst, header);
+
+	for (const RecordedFrame& frame : mFrames)
+	{
+		FrameHeader fh;
+		fh.deltaTime = frame.deltaTime;
+		fh.mouseX = frame.mousePos.x;
+		fh.mouseY = frame.mousePos.y;
+		fh.mouseButtons = frame.mouseButtons;
+		fh.events = (uint32_t)frame.events.size();
+		Write(dst, fh);
+
+		size_t drop = 0;
+		for (const SDL_Event& event : frame.events)
+		{
+			Write(dst, event);
+			if (event.type == SDL_DROPFILE)
+			{
+				const std::string& fname = frame.drops[drop++];
+				Write(dst, (uint32_t)fname.size());
+				dst.write(fname.data(), fname.size());
+			}
+		}
+	}
+
+	if (!dst)
+	{
+		error = "Cannot write input recording " + path;
+		return false;
+	}
+	return true;
+}
+
+
+bool InputRecording::Load(const std::string& path, std::string& error)
+{
+	std::ifstream src(path, std::ios_base::binary);
+	if (!src)
+	{
+		error = "Cannot open input recording " + path;
+		return false;
+	}
+
+	mFrames.clear();
+	mNext = 0;
+
+	RecordingHeader header;
+	if (!Read(src, header) || !std::equal(RecordingMagic, RecordingMagic + 4, header.magic) || header.version != RecordingVersion)
+	{
+		error = path + " is not an input recording";
+		return false;
+	}
+	if (header.eventSize != sizeof(SDL_Event))
+	{
+		error = path + " was recorded by a build for another platform";
+		return false;
+	}
+
+	// Counts come from the file, what they stand for must fit in the rest of it before anything is allocated.
+	// One that does not fails the stream, the same as a short read.
+	const std::streamoff start = src.tellg();
+	src.seekg(0, std::ios_base::end);
+	const std::streamoff end = src.tellg();
+	src.seekg(start);
+	auto fits = [&](uint32_t count, size_t size)
+	{
+		if ((uint64_t)count * size <= (uint64_t)(end - src.tellg()))
+			return true;
+		src.setstate(std::ios_base::failbit);
+		return false;
+	};
+
+	if (fits(header.frames, sizeof(FrameHeader)))
+		mFrames.resize(header.frames);
+	for (RecordedFrame& frame : mFrames)
+	{
+		FrameHeader fh;
+		if (!Read(src, fh) || !fits(fh.events, sizeof(SDL_Event)))
+			break;
+
+		frame.deltaTime = fh.deltaTime;
+		frame.mousePos = ImVec2(fh.mouseX, fh.mouseY);
+		frame.mouseButtons = fh.mouseButtons;
+		frame.events.resize(fh.events);
+		for (SDL_Event& event : frame.events)
+		{
+			if (!Read(src, event))
+				break;
+
+			if (event.type == SDL_DROPFILE)
+			{
+				uint32_t size = 0;
+				if (!Read(src, size) || !fits(size, 1))
+					break;
+				std::string fname(size, '\0');
+				src.read(&fname[0], size);
+				frame.drops.push_back(fname);
+				event.drop.file = nullptr;
+			}
+		}
+
+		if (!src)
+			break;
+	}
+
+	if (!src)
+	{
+		error = path + " is truncated";
+		mFrames.clear();
+		return false;
+	}
+	return true;
+}
+
+
+auto InputRecording::Next() -> const RecordedFrame*
+{
+	return mNext < mFrames.size() ? &mFrames[mNext++] : nullptr;
+}
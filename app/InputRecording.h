@@ -0,0 +1,45 @@
+/* OpenArcanum ArtViewer input recording and replay */
+
+#pragma once
+
+#include <SDL.h>
+
+#include "imgui.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Input of one drawn frame: the SDL events handled before it, and the mouse as ImGui saw it. The mouse
+// is kept because ImGui's SDL backend polls its position from SDL rather than following the events.
+struct RecordedFrame
+{
+	float    deltaTime = 0.0f;           // as recorded, replay uses a fixed step instead
+	ImVec2   mousePos = ImVec2(-FLT_MAX, -FLT_MAX);
+	uint32_t mouseButtons = 0;           // bit per io.MouseDown[] entry
+	std::vector<SDL_Event>   events;
+	std::vector<std::string> drops;      // file names of SDL_DROPFILE events, in order
+};
+
+// SDL_Event stream of a session, saved as raw events so a recording only replays on a build for the
+// same platform. Events that carry no input (worker wake-ups) are not recorded.
+class InputRecording
+{
+public:
+	// Recording: events go to the frame being collected, EndFrame() closes it
+	void AddEvent(const SDL_Event& event);
+	void EndFrame(const ImGuiIO& io);
+
+	bool Save(const std::string& path, std::string& error) const;
+	bool Load(const std::string& path, std::string& error);
+
+	// Replay, frame by frame
+	auto Next() -> const RecordedFrame*;
+	bool IsDone() { return mNext >= mFrames.size(); }
+	int  GetFrameCount() { return (int)mFrames.size(); }
+
+protected:
+	std::vector<RecordedFrame> mFrames;
+	RecordedFrame mCurrent;
+	size_t mNext = 0;
+};
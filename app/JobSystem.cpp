@@ -0,0 +1,170 @@
+/* OpenArcanum ArtViewer background jobs */
+
+#include "app/JobSystem.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <string>
+
+
+namespace
+{
+	const char* const JobTraceNames[] = { "Job (visible)", "Job (prefetch)", "Job (background)" };
+	static_assert(sizeof(JobTraceNames) / sizeof(JobTraceNames[0]) == static_cast<int>(JobPriority::Count), "JobTraceNames does not match JobPriority");
+}
+
+
+JobSystem::JobSystem(std::function<void()> wake, int workers)
+	: mWake(std::move(wake))
+{
+	if (workers <= 0)
+		workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+
+	for (int i = 0; i < workers; i++)
+		mWorkers.emplace_back(&JobSystem::WorkerMain, this, i);
+}
+
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+		for (auto& lane : mLanes)
+			for (auto& job : lane)
+				job.token.Cancel();
+	}
+	mCond.notify_all();
+
+	for (auto& worker : mWorkers)
+		worker.join();
+}
+
+
+void JobSystem::Submit(JobPriority priority, const CancelToken& token, Work work)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mLanes[static_cast<int>(priority)].push_back({ token, std::move(work) });
+	}
+	mCond.notify_one();
+}
+
+
+void JobSystem::Post(const CancelToken& token, Completion completion)
+{
+	if (token.IsCancelled() || !completion)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDone.push_back({ token, std::move(completion) });
+	}
+	mWake();
+}
+
+
+void JobSystem::RunCompletions()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mRunningDone.swap(mDone);
+	}
+
+	if (mRunningDone.empty())
+		return;
+
+	AV_TRACE_SCOPE("RunCompletions");
+	AV_TRACE_COUNTER("Completions", mRunningDone.size());
+
+	// Owner may have cancelled after the work finished, e.g. the thumbnail scrolled away
+	for (auto& done : mRunningDone)
+		if (!done.token.IsCancelled())
+			done.completion();
+	mRunningDone.clear();
+}
+
+
+int JobSystem::GetPendingCount(JobPriority priority)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return static_cast<int>(mLanes[static_cast<int>(priority)].size());
+}
+
+
+bool JobSystem::IsIdle()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (auto& lane : mLanes)
+		for (auto& job : lane)
+			if (!job.token.IsCancelled())
+				return false;
+	return mRunning.load(std::memory_order_relaxed) == 0 && mDone.empty();
+}
+
+
+void JobSystem::WorkerMain(int index)
+{
+	AV_TRACE_THREAD_NAME(("worker " + std::to_string(index)).c_str());
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (true)
+	{
+		Job job;
+		bool found = false;
+		int priority = 0;
+		for (auto& lane : mLanes)
+		{
+			// Cancelled jobs are dropped here without running
+			while (!lane.empty() && lane.front().token.IsCancelled())
+				lane.pop_front();
+			if (!lane.empty())
+			{
+				job = std::move(lane.front());
+				lane.pop_front();
+				found = true;
+				break;
+			}
+			priority++;
+		}
+
+		if (!found)
+		{
+			if (mQuit)
+				return;
+			mCond.wait(lock);
+			continue;
+		}
+
+		mRunning++;
+		lock.unlock();
+
+		// Jobs handle their own failures, this only keeps one that did not from taking the process down
+		Completion completion;
+		try
+		{
+			AV_TRACE_SCOPE(JobTraceNames[priority]);
+			completion = job.work(job.token);
+		}
+		catch (std::exception& e)
+		{
+			fprintf(stderr, "Job failed: %s\n", e.what());
+			completion = nullptr;
+		}
+		catch (...)
+		{
+			fprintf(stderr, "Job failed\n");
+			completion = nullptr;
+		}
+
+		lock.lock();
+		mRunning--;
+		if (completion && !job.token.IsCancelled())
+		{
+			mDone.push_back({ job.token, std::move(completion) });
+			mWake();
+		}
+	}
+}
@@ -0,0 +1,92 @@
+/* OpenArcanum ArtViewer background jobs */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Lower value runs first, a worker only takes a prefetch job when no visible one is waiting
+enum class JobPriority
+{
+	Visible,
+	Prefetch,
+	Background,
+	Count
+};
+
+// Shared flag between the owner of some work and the job doing it. Cancelling skips the job if it
+// has not started, lets a running job bail out early, and drops its completion.
+class CancelToken
+{
+public:
+	CancelToken() : mFlag(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void Cancel() const { mFlag->store(true, std::memory_order_relaxed); }
+	bool IsCancelled() const { return mFlag->load(std::memory_order_relaxed); }
+
+private:
+	std::shared_ptr<std::atomic<bool>> mFlag;
+};
+
+class JobSystem
+{
+public:
+	// Runs on the render thread from RunCompletions(), typically creates textures from the job's result
+	using Completion = std::function<void()>;
+	// Runs on a worker, returns the completion or an empty function when there is nothing to hand back
+	using Work = std::function<Completion(const CancelToken&)>;
+
+	// 'wake' is called from workers when completions are waiting; 0 workers means one per core minus the render thread
+	JobSystem(std::function<void()> wake, int workers = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem(JobSystem&&) = delete;
+
+	void Submit(JobPriority priority, const CancelToken& token, Work work);
+
+	// From a worker: hand something to the render thread without finishing the job, e.g. partial results
+	void Post(const CancelToken& token, Completion completion);
+
+	// Top of the frame on the render thread
+	void RunCompletions();
+
+	int GetWorkerCount() { return static_cast<int>(mWorkers.size()); }
+	int GetPendingCount(JobPriority priority);
+	int GetRunningCount() { return mRunning.load(std::memory_order_relaxed); }
+	// Nothing queued, running or waiting for RunCompletions()
+	bool IsIdle();
+
+protected:
+	struct Job
+	{
+		CancelToken token;
+		Work        work;
+	};
+
+	struct Done
+	{
+		CancelToken token;
+		Completion  completion;
+	};
+
+	void WorkerMain(int index);
+
+protected:
+	std::function<void()>    mWake;
+	std::vector<std::thread> mWorkers;
+
+	std::mutex               mMutex;
+	std::condition_variable  mCond;
+	bool                     mQuit = false;
+	std::deque<Job>          mLanes[static_cast<int>(JobPriority::Count)];
+	std::vector<Done>        mDone;
+	std::vector<Done>        mRunningDone;           // render thread only, kept to reuse its storage
+	std::atomic<int>         mRunning{ 0 };
+};
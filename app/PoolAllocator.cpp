@@ -0,0 +1,142 @@
+/* OpenArcanum ArtViewer pooled allocator for ImGui */
+
+#include "app/PoolAllocator.h"
+
+#include "imgui.h"
+
+#include <cstdlib>
+
+
+namespace
+{
+	// In front of every block, keeps the user pointer 16-byte aligned like malloc's
+	struct BlockHeader
+	{
+		uint32_t sizeClass;
+		uint32_t reserved;
+		uint64_t size;
+	};
+	static_assert(sizeof(BlockHeader) == 16, "BlockHeader must keep 16-byte alignment");
+
+	const size_t MinBlockSize = 32;
+
+	int GetSizeClass(size_t total)
+	{
+		int c = 0;
+		for (size_t block = MinBlockSize; block < total; block <<= 1)
+			c++;
+		return c;
+	}
+}
+
+
+PoolAllocator::~PoolAllocator()
+{
+	for (void* block : mSystemBlocks)
+		free(block);
+}
+
+
+void PoolAllocator::InstallForImGui()
+{
+	ImGui::SetAllocatorFunctions(&PoolAllocator::ImGuiAlloc, &PoolAllocator::ImGuiFree, this);
+}
+
+
+void* PoolAllocator::Alloc(size_t size)
+{
+	const size_t total = size + sizeof(BlockHeader);
+	const int c = GetSizeClass(total);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCurrent.allocs++;
+	mCurrent.bytes += size;
+	mCurrent.live += size;
+	if (mCurrent.live > mCurrent.peak)
+		mCurrent.peak = mCurrent.live;
+
+	BlockHeader* header;
+	if (c >= ClassCount)
+	{
+		// Too big to keep around
+		header = static_cast<BlockHeader*>(malloc(total));
+		if (header == nullptr)
+			return nullptr;
+		mCurrent.systemAllocs++;
+		mCurrent.reserved += total;
+	}
+	else if (mFree[c] != nullptr)
+	{
+		header = reinterpret_cast<BlockHeader*>(mFree[c]);
+		mFree[c] = mFree[c]->next;
+	}
+	else
+	{
+		const size_t block_size = MinBlockSize << c;
+		const size_t count = c < SlabClasses ? SlabSize / block_size : 1;
+		char* memory = static_cast<char*>(malloc(block_size * count));
+		if (memory == nullptr)
+			return nullptr;
+		mSystemBlocks.push_back(memory);
+		mCurrent.systemAllocs++;
+		mCurrent.reserved += block_size * count;
+
+		// The first block is returned, the rest of the slab goes on the free list
+		for (size_t i = count - 1; i > 0; i--)
+		{
+			FreeBlock* block = reinterpret_cast<FreeBlock*>(memory + i * block_size);
+			block->next = mFree[c];
+			mFree[c] = block;
+		}
+		header = reinterpret_cast<BlockHeader*>(memory);
+	}
+
+	header->sizeClass = static_cast<uint32_t>(c < ClassCount ? c : ClassCount);
+	header->reserved = 0;
+	header->size = size;
+	return header + 1;
+}
+
+
+void PoolAllocator::Free(void* ptr)
+{
+	if (ptr == nullptr)
+		return;
+
+	BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+	const uint32_t c = header->sizeClass;
+	IM_ASSERT(c <= ClassCount);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCurrent.frees++;
+	mCurrent.live -= header->size;
+
+	if (c == ClassCount)
+	{
+		mCurrent.reserved -= header->size + sizeof(BlockHeader);
+		free(header);
+		return;
+	}
+
+	FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+	block->next = mFree[c];
+	mFree[c] = block;
+}
+
+
+void PoolAllocator::EndFrame()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mLast = mCurrent;
+	mCurrent.allocs = 0;
+	mCurrent.frees = 0;
+	mCurrent.systemAllocs = 0;
+	mCurrent.bytes = 0;
+}
+
+
+auto PoolAllocator::GetLastFrame() -> FrameStats
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mLast;
+}
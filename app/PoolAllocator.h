@@ -0,0 +1,62 @@
+/* OpenArcanum ArtViewer pooled allocator for ImGui */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Power-of-two size classes with free lists. Small blocks are carved from slabs, bigger ones are
+// allocated one by one; either way a freed block goes back to its list instead of the system, so once
+// ImGui has grown its buffers to their working size a frame allocates nothing from the system.
+class PoolAllocator
+{
+public:
+	struct FrameStats
+	{
+		int    allocs = 0;
+		int    frees = 0;
+		int    systemAllocs = 0;     // slabs and blocks taken from malloc
+		size_t bytes = 0;            // requested by the allocations of the frame
+		size_t live = 0;             // requested and not freed yet
+		size_t peak = 0;             // highest 'live' since start
+		size_t reserved = 0;         // held from the system, in use or on free lists
+	};
+
+	PoolAllocator() = default;
+	~PoolAllocator();
+
+	PoolAllocator(const PoolAllocator&) = delete;
+	PoolAllocator(PoolAllocator&&) = delete;
+
+	// Must happen before ImGui::CreateContext(), and the allocator has to outlive ImGui::DestroyContext()
+	void InstallForImGui();
+
+	void* Alloc(size_t size);
+	void  Free(void* ptr);
+
+	// Closes the statistics of the frame that just ended
+	void EndFrame();
+	auto GetLastFrame() -> FrameStats;
+
+protected:
+	static void* ImGuiAlloc(size_t size, void* user) { return static_cast<PoolAllocator*>(user)->Alloc(size); }
+	static void  ImGuiFree(void* ptr, void* user) { static_cast<PoolAllocator*>(user)->Free(ptr); }
+
+	static const int      ClassCount = 23;            // 32 bytes up to 128 MB blocks, bigger goes straight to malloc
+	static const int      SlabClasses = 8;            // blocks up to 4 KB come from slabs
+	static const size_t   SlabSize = 64 * 1024;
+
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+protected:
+	std::mutex         mMutex;
+	FreeBlock*         mFree[ClassCount] = {};
+	std::vector<void*> mSystemBlocks;               // slabs and single blocks, released in the destructor
+	FrameStats         mCurrent;
+	FrameStats         mLast;
+};
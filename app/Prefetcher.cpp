@@ -0,0 +1,188 @@
+/* OpenArcanum ArtViewer predictive prefetch */
+
+#include "app/Prefetcher.h"
+
+#include <algorithm>
+
+
+Prefetcher::Prefetcher(JobSystem* jobs, SpriteRenderer* sprites, size_t budgetBytes)
+	: mJobs(jobs)
+	, mSprites(sprites)
+	, mBudget(budgetBytes)
+{
+}
+
+
+Prefetcher::~Prefetcher()
+{
+	for (auto& it : mEntries)
+		it.second.token.Cancel();
+}
+
+
+void Prefetcher::Open(const std::string& path, Ready ready)
+{
+	auto it = mEntries.find(path);
+	if (it == mEntries.end())
+	{
+		mStats.misses++;
+		it = mEntries.emplace(path, Entry()).first;
+		it->second.used = true;
+		it->second.waiters.push_back(std::move(ready));
+		Submit(path, it->second, JobPriority::Visible);
+		return;
+	}
+
+	Entry& entry = it->second;
+	entry.lastUsed = ++mClock;
+
+	if (!entry.loading)
+	{
+		mStats.hits++;
+		entry.used = true;
+		ready(entry.anim, entry.error);
+		return;
+	}
+
+	if (entry.predicted && !entry.used)
+		mStats.lateHits++;
+	entry.used = true;
+	entry.waiters.push_back(std::move(ready));
+
+	// Still queued behind other prefetches: it is wanted now, move it to the visible lane
+	if (entry.priority != JobPriority::Visible && !entry.started->load())
+		Submit(path, entry, JobPriority::Visible);
+}
+
+
+void Prefetcher::Predict(const std::vector<std::string>& paths)
+{
+	// Earlier guesses nobody asked for and no worker picked up yet are dropped
+	for (auto it = mEntries.begin(); it != mEntries.end();)
+	{
+		Entry& entry = it->second;
+		bool still_wanted = std::find(paths.begin(), paths.end(), it->first) != paths.end();
+		if (entry.loading && entry.predicted && entry.waiters.empty() && !still_wanted && !entry.started->load())
+		{
+			entry.token.Cancel();
+			it = mEntries.erase(it);
+		}
+		else
+			++it;
+	}
+
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		auto it = mEntries.find(paths[i]);
+		if (it != mEntries.end())
+		{
+			it->second.lastUsed = ++mClock;
+			continue;
+		}
+
+		Entry& entry = mEntries.emplace(paths[i], Entry()).first->second;
+		entry.predicted = true;
+		entry.lastUsed = ++mClock;
+
+		// The first guess competes with thumbnails, the rest only fill idle workers
+		Submit(paths[i], entry, i == 0 ? JobPriority::Prefetch : JobPriority::Background);
+	}
+}
+
+
+void Prefetcher::ResetStats()
+{
+	mStats.hits = mStats.lateHits = mStats.misses = mStats.wasted = 0;
+}
+
+
+void Prefetcher::Invalidate(const std::string& path)
+{
+	auto it = mEntries.find(path);
+	if (it == mEntries.end())
+		return;
+
+	// Whoever waits gets the new contents; the old job's completion is dropped with its token
+	if (it->second.loading)
+		Submit(path, it->second, it->second.priority);
+	else
+	{
+		mEntries.erase(it);
+		Evict();
+	}
+}
+
+
+void Prefetcher::Submit(const std::string& path, Entry& entry, JobPriority priority)
+{
+	entry.token.Cancel();
+	entry.token = CancelToken();
+	entry.started = std::make_shared<std::atomic<bool>>(false);
+	entry.priority = priority;
+	entry.loading = true;
+
+	auto started = entry.started;
+	bool trim = mTrimFrames;
+	FrameStore* store = mStore;
+	mJobs->Submit(priority, entry.token, [this, path, started, trim, store](const CancelToken&) -> JobSystem::Completion
+	{
+		started->store(true);
+
+		auto error = std::make_shared<std::string>();
+		std::shared_ptr<ArtAnimation> anim = PlaybackScheduler::DecodeAnimation(path, *error, trim, store);
+
+		// Upload happens here on the render thread, so a hit costs nothing when the file is opened
+		return [this, path, anim, error]()
+		{
+			auto it = mEntries.find(path);
+			if (it == mEntries.end())
+				return;
+
+			Entry& entry = it->second;
+			std::shared_ptr<ArtAnimation> loaded = anim && anim->Upload(mSprites, *error) ? anim : nullptr;
+			entry.anim = loaded;
+			entry.error = *error;
+			entry.loading = false;
+			entry.bytes = loaded ? loaded->GetMemorySize() : 0;
+
+			// Failures are not cached, the next request tries the file again
+			std::vector<Ready> waiters;
+			waiters.swap(entry.waiters);
+			if (!loaded)
+				mEntries.erase(it);
+
+			// Waiters may open or predict other files, so 'entry' is not touched past this point
+			for (auto& ready : waiters)
+				ready(loaded, *error);
+
+			Evict();
+		};
+	});
+}
+
+
+void Prefetcher::Evict()
+{
+	size_t total = 0;
+	for (auto& it : mEntries)
+		total += it.second.bytes;
+
+	// Least recently used first; an evicted entry is simply loaded again when asked for
+	while (total > mBudget)
+	{
+		auto victim = mEntries.end();
+		for (auto it = mEntries.begin(); it != mEntries.end(); ++it)
+			if (!it->second.loading && (victim == mEntries.end() || it->second.lastUsed < victim->second.lastUsed))
+				victim = it;
+		if (victim == mEntries.end())
+			break;
+
+		if (victim->second.predicted && !victim->second.used)
+			mStats.wasted++;
+		total -= victim->second.bytes;
+		mEntries.erase(victim);
+	}
+
+	mStats.bytes = total;
+	mStats.entries = static_cast<int>(mEntries.size());
+}
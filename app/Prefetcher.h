@@ -0,0 +1,88 @@
+/* OpenArcanum ArtViewer predictive prefetch */
+
+#pragma once
+
+#include "app/ArtPlayback.h"
+#include "app/JobSystem.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Cache of decoded and uploaded animations in front of the job system. Navigation tells it what is
+// likely needed next; those files are loaded in the prefetch lane so that opening them is a lookup.
+class Prefetcher
+{
+public:
+	// Called on the render thread, 'anim' is null on failure
+	using Ready = std::function<void(std::shared_ptr<ArtAnimation> anim, const std::string& error)>;
+
+	Prefetcher(JobSystem* jobs, SpriteRenderer* sprites, size_t budgetBytes);
+	~Prefetcher();
+
+	Prefetcher(const Prefetcher&) = delete;
+	Prefetcher(Prefetcher&&) = delete;
+
+	// Demand load: immediate when prefetched, otherwise queued in the visible lane
+	void Open(const std::string& path, Ready ready);
+
+	// Replaces the previous prediction, most likely first; predictions that have not started are cancelled
+	void Predict(const std::vector<std::string>& paths);
+
+	void   SetBudget(size_t budgetBytes) { mBudget = budgetBytes; Evict(); }
+	size_t GetBudget() { return mBudget; }
+
+	// Crop transparent frame margins of files loaded from now on
+	void   SetTrimFrames(bool trim) { mTrimFrames = trim; }
+	// Share identical frames and atlases of files loaded from now on
+	void   SetFrameStore(FrameStore* store) { mStore = store; }
+
+	struct Stats
+	{
+		int    hits = 0;           // opened from the cache, prefetched or seen before
+		int    lateHits = 0;       // predicted, still loading when opened
+		int    misses = 0;         // not predicted
+		int    wasted = 0;         // prefetched, evicted without being opened
+		size_t bytes = 0;
+		int    entries = 0;
+	};
+	auto GetStats() -> const Stats& { return mStats; }
+	void ResetStats();
+
+	// The file changed on disk: a cached copy is dropped, one being read is read again
+	void Invalidate(const std::string& path);
+
+protected:
+	struct Entry
+	{
+		std::shared_ptr<ArtAnimation>      anim;
+		std::string                        error;
+		CancelToken                        token;
+		std::shared_ptr<std::atomic<bool>> started;
+		std::vector<Ready>                 waiters;
+		JobPriority                        priority = JobPriority::Prefetch;
+		bool                               loading = false;
+		bool                               predicted = false;
+		bool                               used = false;
+		uint64_t                           lastUsed = 0;
+		size_t                             bytes = 0;
+	};
+
+	void Submit(const std::string& path, Entry& entry, JobPriority priority);
+	void Evict();
+
+protected:
+	JobSystem*      mJobs;
+	SpriteRenderer* mSprites;
+	size_t          mBudget;
+	bool            mTrimFrames = false;
+	FrameStore*     mStore = nullptr;
+	uint64_t        mClock = 0;
+
+	std::unordered_map<std::string, Entry> mEntries;
+	Stats mStats;
+};
@@ -0,0 +1,336 @@
+/* OpenArcanum ArtViewer frame profiler */
+
+#include "app/Profiler.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+namespace
+{
+	const char* const StageNames[] =
+	{
+		"Event pump",
+		"Update",
+		"NewFrame",
+		"UI build",
+		"Render",
+		"FrameRender",
+		"FramePresent",
+	};
+	static_assert(IM_ARRAYSIZE(StageNames) == (int)ProfileStage::Count, "StageNames does not match ProfileStage");
+
+	// Over-budget frames listed in the window, most recent first
+	const int OverBudgetListSize = 8;
+
+	const ImVec4 OverBudgetColor = ImVec4(1.0f, 0.4f, 0.4f, 1.0f);
+
+	// Nearest-rank percentile of an already sorted series
+	float Percentile(const std::vector<float>& sorted, float p)
+	{
+		if (sorted.empty())
+			return 0.0f;
+		int rank = (int)std::ceil(p * (float)sorted.size()) - 1;
+		return sorted[std::min(std::max(rank, 0), (int)sorted.size() - 1)];
+	}
+
+	// Largest resident set of the process so far, 0 where unknown
+	size_t GetPeakResidentBytes()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters = {};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return counters.PeakWorkingSetSize;
+		return 0;
+#else
+		struct rusage usage = {};
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+#if defined(__APPLE__)
+		return (size_t)usage.ru_maxrss;
+#else
+		return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+	}
+
+	void StatsRow(const char* name, std::vector<float>& values, float last, bool over)
+	{
+		std::sort(values.begin(), values.end());
+
+		if (over)
+			ImGui::TextColored(OverBudgetColor, "%s", name);
+		else
+			ImGui::TextUnformatted(name);
+		ImGui::NextColumn();
+
+		if (values.empty())
+		{
+			for (int i = 0; i < 5; i++)
+			{
+				ImGui::TextDisabled("-");
+				ImGui::NextColumn();
+			}
+			return;
+		}
+
+		for (float v : { last, Percentile(values, 0.50f), Percentile(values, 0.95f), Percentile(values, 0.99f), values.back() })
+		{
+			ImGui::Text("%.2f", v);
+			ImGui::NextColumn();
+		}
+	}
+}
+
+
+FrameProfiler::FrameProfiler()
+	: mTicksToMs(1000.0 / (double)SDL_GetPerformanceFrequency())
+{
+}
+
+
+const char* FrameProfiler::GetStageName(ProfileStage stage)
+{
+	return StageNames[(int)stage];
+}
+
+
+void FrameProfiler::BeginFrame()
+{
+	mCurrent = Sample();
+	mFrameStart = SDL_GetPerformanceCounter();
+}
+
+
+void FrameProfiler::EndFrame(float budgetMs, float gpuMs)
+{
+	mCurrent.total = (float)((double)(SDL_GetPerformanceCounter() - mFrameStart) * mTicksToMs);
+	mCurrent.gpu = gpuMs;
+	mCurrent.budget = budgetMs;
+	mCurrent.frame = mFrame++;
+
+	bool over = mCurrent.total > budgetMs;
+	if (over)
+	{
+		mOverBudget++;
+		if (mLogOverBudget)
+		{
+			ProfileStage worst = GetWorstStage(mCurrent);
+			fprintf(stderr, "[profiler] frame %d took %.2f ms (budget %.2f ms), %s %.2f ms, GPU %.2f ms\n", mCurrent.frame, mCurrent.total, budgetMs,
+				GetStageName(worst), mCurrent.stages[(int)worst], mCurrent.gpu);
+		}
+	}
+
+	if (mRecording)
+		mRecorded.push_back(mCurrent);
+
+	if (mPaused)
+		return;
+
+	mHistory[mOffset] = mCurrent;
+	mOffset = (mOffset + 1) % HistorySize;
+	if (mCount < HistorySize)
+		mCount++;
+}
+
+
+void FrameProfiler::StartRecording()
+{
+	mRecorded.clear();
+	mRecording = true;
+}
+
+
+bool FrameProfiler::WriteSummary(const std::string& path)
+{
+	FILE* f = path == "-" ? stdout : fopen(path.c_str(), "w");
+	if (f == nullptr)
+	{
+		fprintf(stderr, "Cannot write frame statistics to %s\n", path.c_str());
+		return false;
+	}
+
+	int over = 0, system_allocs = 0;
+	size_t imgui_peak = 0, imgui_reserved = 0, cache_peak = 0;
+	for (const Sample& sample : mRecorded)
+	{
+		over += sample.total > sample.budget ? 1 : 0;
+		system_allocs += sample.memory.systemAllocs;
+		imgui_peak = std::max(imgui_peak, sample.memory.peak);
+		imgui_reserved = std::max(imgui_reserved, sample.memory.reserved);
+		cache_peak = std::max(cache_peak, sample.cacheBytes);
+	}
+
+	fprintf(f, "{\n  \"frames\": %d,\n  \"over_budget\": %d,\n  \"imgui_system_allocs\": %d,\n  \"stages\": {", (int)mRecorded.size(), over, system_allocs);
+
+	// Stages, then the whole frame, then the GPU, which may not have a value for every frame
+	std::vector<float> values;
+	for (int s = 0; s <= (int)ProfileStage::Count + 1; s++)
+	{
+		values.clear();
+		for (const Sample& sample : mRecorded)
+		{
+			float v = s < (int)ProfileStage::Count ? sample.stages[s] : s == (int)ProfileStage::Count ? sample.total : sample.gpu;
+			if (v >= 0.0f)
+				values.push_back(v);
+		}
+		std::sort(values.begin(), values.end());
+
+		double mean = 0.0;
+		for (float v : values)
+			mean += v;
+		mean = values.empty() ? 0.0 : mean / (double)values.size();
+
+		const char* name = s < (int)ProfileStage::Count ? StageNames[s] : s == (int)ProfileStage::Count ? "Frame (CPU)" : "GPU render pass";
+		fprintf(f, "%s\n    \"%s\": { \"samples\": %d, \"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f }",
+			s == 0 ? "" : ",", name, (int)values.size(), mean, Percentile(values, 0.50f), Percentile(values, 0.95f), Percentile(values, 0.99f),
+			values.empty() ? 0.0f : values.back());
+	}
+	fprintf(f, "\n  },\n");
+
+	fprintf(f, "  \"memory_kb\": { \"imgui_live_peak\": %.1f, \"imgui_reserved_peak\": %.1f, \"prefetch_cache_peak\": %.1f, \"process_peak_rss\": %.1f }\n}\n",
+		imgui_peak / 1024.0, imgui_reserved / 1024.0, cache_peak / 1024.0, GetPeakResidentBytes() / 1024.0);
+
+	bool ok = ferror(f) == 0;
+	if (f != stdout)
+		fclose(f);
+	return ok;
+}
+
+
+auto FrameProfiler::GetWorstStage(const Sample& sample) -> ProfileStage
+{
+	int worst = 0;
+	for (int i = 1; i < (int)ProfileStage::Count; i++)
+		if (sample.stages[i] > sample.stages[worst])
+			worst = i;
+	return (ProfileStage)worst;
+}
+
+
+void FrameProfiler::Show(bool* open)
+{
+	ImGui::SetNextWindowSize(ImVec2(520.0f, 460.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Profiler", open))
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Checkbox("Pause", &mPaused);
+	ImGui::SameLine();
+	if (ImGui::Button("Reset"))
+	{
+		mCount = 0;
+		mOffset = 0;
+		mOverBudget = 0;
+	}
+	ImGui::SameLine();
+	ImGui::Checkbox("Log slow frames", &mLogOverBudget);
+
+	if (mCount == 0)
+	{
+		ImGui::TextDisabled("No frames recorded");
+		ImGui::End();
+		return;
+	}
+
+	const Sample& last = GetSample(0);
+
+	// Oldest first for the graph; the scale leaves room to see how far over budget a spike went
+	std::vector<float> totals(mCount);
+	int over = 0;
+	for (int age = 0; age < mCount; age++)
+	{
+		const Sample& sample = GetSample(age);
+		totals[mCount - 1 - age] = sample.total;
+		over += sample.total > sample.budget ? 1 : 0;
+	}
+
+	char overlay[64];
+	snprintf(overlay, sizeof(overlay), "budget %.2f ms", last.budget);
+	ImGui::PlotHistogram("##frames", totals.data(), mCount, 0, overlay, 0.0f, last.budget * 2.0f, ImVec2(-1.0f, 80.0f));
+
+	if (over > 0)
+		ImGui::TextColored(OverBudgetColor, "%d of the last %d frames over budget, %d since start", over, mCount, mOverBudget);
+	else
+		ImGui::Text("Last %d frames within budget", mCount);
+
+	ImGui::Separator();
+	ImGui::Columns(6, "##stages", false);
+	ImGui::SetColumnWidth(0, 140.0f);
+	for (const char* title : { "ms", "last", "p50", "p95", "p99", "max" })
+	{
+		ImGui::TextDisabled("%s", title);
+		ImGui::NextColumn();
+	}
+
+	std::vector<float> values;
+	values.reserve(mCount);
+	for (int s = 0; s < (int)ProfileStage::Count; s++)
+	{
+		values.clear();
+		for (int age = 0; age < mCount; age++)
+			values.push_back(GetSample(age).stages[s]);
+		StatsRow(StageNames[s], values, last.stages[s], false);
+	}
+
+	StatsRow("Frame (CPU)", totals, last.total, last.total > last.budget);
+
+	// Timestamps arrive a few frames late and not at all on queues without timestamp support
+	values.clear();
+	for (int age = 0; age < mCount; age++)
+		if (GetSample(age).gpu >= 0.0f)
+			values.push_back(GetSample(age).gpu);
+	StatsRow("GPU render pass", values, last.gpu, false);
+
+	ImGui::Columns(1);
+
+	// Once ImGui's buffers have reached their working size, frames should not need the system heap
+	ImGui::Separator();
+	int system_frames = 0, max_allocs = 0;
+	for (int age = 0; age < mCount; age++)
+	{
+		const PoolAllocator::FrameStats& memory = GetSample(age).memory;
+		system_frames += memory.systemAllocs > 0 ? 1 : 0;
+		max_allocs = std::max(max_allocs, memory.allocs);
+	}
+	const PoolAllocator::FrameStats& memory = last.memory;
+	ImGui::Text("ImGui heap: %d allocs, %d frees, %.1f KB this frame, at most %d allocs per frame",
+		memory.allocs, memory.frees, memory.bytes / 1024.0, max_allocs);
+	ImGui::Text("%.1f KB live, %.1f KB peak, %.1f KB held from the system", memory.live / 1024.0, memory.peak / 1024.0, memory.reserved / 1024.0);
+	if (system_frames > 0)
+		ImGui::TextColored(OverBudgetColor, "%d of the last %d frames allocated from the system", system_frames, mCount);
+	else
+		ImGui::Text("No system allocations in the last %d frames", mCount);
+
+	if (over > 0)
+	{
+		ImGui::Separator();
+		ImGui::TextDisabled("Recent frames over budget");
+		int listed = 0;
+		for (int age = 0; age < mCount && listed < OverBudgetListSize; age++)
+		{
+			const Sample& sample = GetSample(age);
+			if (sample.total <= sample.budget)
+				continue;
+
+			ProfileStage worst = GetWorstStage(sample);
+			ImGui::Text("#%d  %.2f ms, %s %.2f ms", sample.frame, sample.total, GetStageName(worst), sample.stages[(int)worst]);
+			listed++;
+		}
+	}
+
+	ImGui::End();
+}
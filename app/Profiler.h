@@ -0,0 +1,122 @@
+/* OpenArcanum ArtViewer frame profiler */
+
+#pragma once
+
+#include <SDL.h>
+
+#include "app/PoolAllocator.h"
+#include "common/Trace.h"
+
+#include <string>
+#include <vector>
+
+// Parts of a frame on the render thread, in the order they run
+enum class ProfileStage
+{
+	EventPump,
+	Update,
+	NewFrame,
+	BuildUI,
+	Render,
+	FrameRender,
+	FramePresent,
+	Count
+};
+
+// Rolling per-stage CPU timings plus the GPU time of the render pass. Only frames that get drawn are
+// recorded, and the idle wait for events is not part of any stage.
+class FrameProfiler
+{
+public:
+	static const int HistorySize = 600;
+
+	FrameProfiler();
+
+	FrameProfiler(const FrameProfiler&) = delete;
+	FrameProfiler(FrameProfiler&&) = delete;
+
+	// Starts a new sample; a frame that is not drawn simply starts over with the next call
+	void BeginFrame();
+	void AddTime(ProfileStage stage, float ms) { mCurrent.stages[(int)stage] += ms; }
+	// ImGui heap activity of the frame, see PoolAllocator
+	void SetMemory(const PoolAllocator::FrameStats& memory) { mCurrent.memory = memory; }
+	// Decoded animations held by the prefetcher
+	void SetCacheBytes(size_t bytes) { mCurrent.cacheBytes = bytes; }
+	// 'gpuMs' is the latest render pass time the GPU reported, negative when unknown
+	void EndFrame(float budgetMs, float gpuMs);
+
+	// Frames over budget are also written to stderr, for runs without the window open
+	void SetLogOverBudget(bool log) { mLogOverBudget = log; }
+
+	void Show(bool* open);
+
+	// Keeps every frame from now on, not just the rolling history, for WriteSummary()
+	void StartRecording();
+	// Per-stage mean and percentiles of the recorded frames and memory high-water marks as JSON; "-" prints to stdout
+	bool WriteSummary(const std::string& path);
+
+	static const char* GetStageName(ProfileStage stage);
+
+protected:
+	struct Sample
+	{
+		float stages[(int)ProfileStage::Count] = {};
+		float total = 0.0f;
+		float gpu = -1.0f;
+		float budget = 0.0f;
+		int   frame = 0;
+		PoolAllocator::FrameStats memory;
+		size_t cacheBytes = 0;
+	};
+
+	auto GetSample(int age) const -> const Sample& { return mHistory[(mOffset + HistorySize - 1 - age) % HistorySize]; }
+	static auto GetWorstStage(const Sample& sample) -> ProfileStage;
+
+protected:
+	Sample mHistory[HistorySize];
+	int    mCount = 0;
+	int    mOffset = 0;
+	int    mFrame = 0;
+
+	Sample mCurrent;
+	Uint64 mFrameStart = 0;
+	double mTicksToMs;
+
+	std::vector<Sample> mRecorded;
+	bool   mRecording = false;
+
+	int    mOverBudget = 0;      // since start, the history only covers the last HistorySize frames
+	bool   mLogOverBudget = false;
+	bool   mPaused = false;
+};
+
+// Adds the time until the end of the scope to one stage of the current frame, and records it in the trace
+class ProfileScope
+{
+public:
+	ProfileScope(FrameProfiler* profiler, ProfileStage stage)
+		: mProfiler(profiler)
+		, mStage(stage)
+		, mStart(SDL_GetPerformanceCounter())
+#if ARTVIEWER_TRACE
+		, mTrace(FrameProfiler::GetStageName(stage))
+#endif
+	{
+	}
+
+	~ProfileScope()
+	{
+		mProfiler->AddTime(mStage, (float)((double)(SDL_GetPerformanceCounter() - mStart) * 1000.0 / (double)SDL_GetPerformanceFrequency()));
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	FrameProfiler* mProfiler;
+	ProfileStage   mStage;
+	Uint64         mStart;
+#if ARTVIEWER_TRACE
+	Trace::Scope   mTrace;
+#endif
+};
@@ -0,0 +1,113 @@
+/* OpenArcanum ArtViewer scripted scenarios for headless runs */
+
+#include "app/Scenario.h"
+
+#include <fstream>
+#include <sstream>
+
+
+namespace
+{
+	struct ScenarioOpName
+	{
+		ScenarioOp  op;
+		const char* name;
+		int         values;      // numeric arguments
+		bool        text;        // takes the rest of the line as argument
+	};
+
+	const ScenarioOpName ScenarioOps[] =
+	{
+		{ ScenarioOp::Open,       "open",        0, true },
+		{ ScenarioOp::Dir,        "dir",         0, true },
+		{ ScenarioOp::Show,       "show",        1, false },
+		{ ScenarioOp::Next,       "next",        0, false },
+		{ ScenarioOp::Prev,       "prev",        0, false },
+		{ ScenarioOp::Fill,       "fill",        2, false },
+		{ ScenarioOp::Play,       "play",        0, false },
+		{ ScenarioOp::Pause,      "pause",       0, false },
+		{ ScenarioOp::Zoom,       "zoom",        1, false },
+		{ ScenarioOp::Scroll,     "scroll",      1, false },
+		{ ScenarioOp::Wait,       "wait",        0, false },
+		{ ScenarioOp::Frames,     "frames",      1, false },
+		{ ScenarioOp::ResetStats, "reset-stats", 0, false },
+		{ ScenarioOp::Capture,    "capture",     0, true },
+	};
+}
+
+
+bool Scenario::Load(const std::string& path, std::string& error)
+{
+	std::ifstream src(path);
+	if (!src)
+	{
+		error = "Cannot open scenario " + path;
+		return false;
+	}
+
+	mCommands.clear();
+	mNext = 0;
+
+	std::string line;
+	for (int line_num = 1; std::getline(src, line); line_num++)
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		std::istringstream words(line);
+		std::string name;
+		if (!(words >> name) || name[0] == '#')
+			continue;
+
+		const ScenarioOpName* op = nullptr;
+		for (const auto& candidate : ScenarioOps)
+			if (name == candidate.name)
+				op = &candidate;
+
+		ScenarioCommand cmd;
+		cmd.line = line_num;
+		bool ok = op != nullptr;
+		if (ok)
+		{
+			cmd.op = op->op;
+			for (int i = 0; i < op->values; i++)
+				ok &= static_cast<bool>(words >> cmd.values[i]);
+			if (op->text)
+			{
+				std::getline(words >> std::ws, cmd.arg);
+				ok &= !cmd.arg.empty();
+			}
+		}
+
+		if (!ok)
+		{
+			error = path + ":" + std::to_string(line_num) + ": cannot parse '" + line + "'";
+			return false;
+		}
+		mCommands.push_back(cmd);
+	}
+
+	return true;
+}
+
+
+void Scenario::SetDefault(int frames)
+{
+	mCommands.clear();
+	mNext = 0;
+
+	ScenarioCommand wait;
+	wait.op = ScenarioOp::Wait;
+	mCommands.push_back(wait);
+
+	ScenarioCommand draw;
+	draw.op = ScenarioOp::Frames;
+	draw.values[0] = static_cast<float>(frames);
+	mCommands.push_back(draw);
+}
+
+
+auto Scenario::Next() -> const ScenarioCommand*
+{
+	return mNext < mCommands.size() ? &mCommands[mNext++] : nullptr;
+}
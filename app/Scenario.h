@@ -0,0 +1,64 @@
+/* OpenArcanum ArtViewer scripted scenarios for headless runs */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// One line of a scenario script. Commands run in order before a frame is built; 'frames' and 'wait'
+// let frames be drawn before the next command.
+//
+//   open <file>          open a file, as if dropped on the window
+//   dir <directory>      show a directory in the browser
+//   show <index>         open a browser entry, next/prev step from there
+//   next, prev
+//   fill <cols> <rows>   fill the playback grid with instances of the current animation
+//   play, pause
+//   zoom <factor>        playback zoom
+//   scroll <rows>        scroll the browser by this many rows every frame, 0 stops
+//   wait                 draw frames until nothing is loading
+//   frames <n>           draw n frames
+//   reset-stats          start measuring here, e.g. after warming up
+//   capture <file.png>   save the last drawn frame
+enum class ScenarioOp
+{
+	Open,
+	Dir,
+	Show,
+	Next,
+	Prev,
+	Fill,
+	Play,
+	Pause,
+	Zoom,
+	Scroll,
+	Wait,
+	Frames,
+	ResetStats,
+	Capture,
+};
+
+struct ScenarioCommand
+{
+	ScenarioOp  op;
+	std::string arg;
+	float       values[2] = {};
+	int         line = 0;
+};
+
+class Scenario
+{
+public:
+	// Returns false with 'error' set on the first line that cannot be parsed
+	bool Load(const std::string& path, std::string& error);
+
+	// Without a script: load what is on the command line, then draw 'frames' frames
+	void SetDefault(int frames);
+
+	auto Next() -> const ScenarioCommand*;
+	bool IsDone() { return mNext >= mCommands.size(); }
+
+protected:
+	std::vector<ScenarioCommand> mCommands;
+	size_t mNext = 0;
+};
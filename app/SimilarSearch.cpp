@@ -0,0 +1,165 @@
+/* OpenArcanum ArtViewer near-duplicate frame search */
+
+#include "app/SimilarSearch.h"
+
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+
+namespace
+{
+	struct FileHashes
+	{
+		std::string           path;
+		std::vector<uint64_t> hashes;
+	};
+}
+
+
+SimilarSearch::SimilarSearch(JobSystem* jobs)
+	: mJobs(jobs)
+{
+}
+
+
+SimilarSearch::~SimilarSearch()
+{
+	mToken.Cancel();
+}
+
+
+void SimilarSearch::IndexDirectory(const std::string& directory, const std::vector<BrowserEntry>& entries)
+{
+	if (directory == mDirectory)
+		return;
+
+	mToken.Cancel();
+	mToken = CancelToken();
+	mIndex = SimilarityIndex();
+	mDirectory = directory;
+	mPending = static_cast<int>(entries.size());
+	mResults.clear();
+	mStale = true;
+
+	for (const BrowserEntry& entry : entries)
+	{
+		std::string path = entry.path;
+		mJobs->Submit(JobPriority::Background, mToken, [this, path](const CancelToken&) -> JobSystem::Completion
+		{
+			AV_TRACE_SCOPE_DETAIL("Hash frames", path.c_str());
+			auto file = std::make_shared<FileHashes>();
+			file->path = path;
+			try
+			{
+				ArtFile art;
+				art.LoadArt(path, false);
+				CTABLE_255 palette = get_hash_palette(art);
+				for (ArtFrame& frame : art.frame_data)
+					file->hashes.push_back(perceptual_hash(frame, palette));
+			}
+			catch (MissingFile&)
+			{
+			}
+			catch (std::exception&)
+			{
+				file->hashes.clear();
+			}
+
+			return [this, file]()
+			{
+				int index = mIndex.AddFile(file->path);
+				for (size_t i = 0; i < file->hashes.size(); i++)
+					mIndex.Add(file->hashes[i], index, static_cast<int>(i));
+				mPending--;
+				mStale = true;
+			};
+		});
+	}
+}
+
+
+void SimilarSearch::Search()
+{
+	auto start = std::chrono::steady_clock::now();
+	mResults = mIndex.Search(mQueryHash, mDistance);
+
+	// The frame looked for is not a result
+	mResults.erase(std::remove_if(mResults.begin(), mResults.end(), [this](const SimilarFrame& found)
+	{
+		return found.frame == mQueryFrame && mIndex.files[found.file] == mQueryPath;
+	}), mResults.end());
+
+	mSearchMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	mStale = false;
+}
+
+
+bool SimilarSearch::Show(bool* open, const std::shared_ptr<ArtAnimation>& anim, std::string* activated)
+{
+	ImGui::SetNextWindowSize(ImVec2(420.0f, 480.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Similar frames", open))
+	{
+		ImGui::End();
+		return false;
+	}
+
+	if (mDirectory.empty())
+		ImGui::TextDisabled("Open a directory in the browser to search it");
+	else
+		ImGui::Text("%d frames of %d files%s", mIndex.GetFrameCount(), (int)mIndex.files.size(), mPending > 0 ? " (hashing)" : "");
+
+	if (anim && !anim->art.frame_data.empty())
+	{
+		const int frames = static_cast<int>(anim->art.frame_data.size());
+		mFrame = std::min(std::max(mFrame, 0), frames - 1);
+		ImGui::TextUnformatted(anim->name.c_str());
+		ImGui::SliderInt("Frame", &mFrame, 0, frames - 1);
+		ImGui::SliderInt("Distance", &mDistance, 0, 24, "%d bits");
+		if (ImGui::Button("Find similar"))
+		{
+			ArtAnimation& a = *anim;
+			const ARTFrameHeader& fh = a.art.frame_data[mFrame].header;
+			CTABLE_255 palette = get_hash_palette(a.art);
+			mQueryHash = perceptual_hash(static_cast<int>(fh.width), static_cast<int>(fh.height),
+				[&](int y) { return a.GetFrameRow(mFrame, y); }, palette);
+			mQueryPath = a.path;
+			mQueryFrame = mFrame;
+			mHasQuery = true;
+			mStale = true;
+		}
+	}
+	else
+		ImGui::TextDisabled("Open a file to look for frames like its own");
+
+	if (mHasQuery && mStale)
+		Search();
+	if (mHasQuery)
+		ImGui::TextDisabled("%d found in %.2f ms", (int)mResults.size(), mSearchMs);
+
+	bool result = false;
+	ImGui::BeginChild("##results");
+	ImGuiListClipper clipper((int)mResults.size());
+	while (clipper.Step())
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			const SimilarFrame& found = mResults[i];
+			const std::string& path = mIndex.files[found.file];
+			std::string name = path.substr(path.find_last_of("/\\") + 1);
+			ImGui::PushID(i);
+			if (ImGui::Selectable("##result", false, ImGuiSelectableFlags_AllowDoubleClick) && ImGui::IsMouseDoubleClicked(0))
+			{
+				*activated = path;
+				result = true;
+			}
+			ImGui::SameLine();
+			ImGui::Text("%s #%d, distance %d", name.c_str(), found.frame, found.distance);
+			ImGui::PopID();
+		}
+	ImGui::EndChild();
+
+	ImGui::End();
+	return result;
+}
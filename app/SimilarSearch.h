@@ -0,0 +1,51 @@
+/* OpenArcanum ArtViewer near-duplicate frame search */
+
+#pragma once
+
+#include "app/ArtBrowser.h"
+#include "app/ArtPlayback.h"
+#include "app/JobSystem.h"
+#include "formats/similar.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Finds frames of the browsed directory that look like one of the current animation. Every file of
+// the directory is hashed by a background job the first time the window is shown for it; searches made
+// while that is still going only see the files done so far and are run again as more come in.
+class SimilarSearch
+{
+public:
+	explicit SimilarSearch(JobSystem* jobs);
+	~SimilarSearch();
+
+	SimilarSearch(const SimilarSearch&) = delete;
+	SimilarSearch(SimilarSearch&&) = delete;
+
+	// Hashes these files unless 'directory' is the one indexed already
+	void IndexDirectory(const std::string& directory, const std::vector<BrowserEntry>& entries);
+
+	// Returns true and sets 'activated' to the path of a result that was double clicked
+	bool Show(bool* open, const std::shared_ptr<ArtAnimation>& anim, std::string* activated);
+
+protected:
+	void Search();
+
+protected:
+	JobSystem*      mJobs;
+	CancelToken     mToken;
+	SimilarityIndex mIndex;
+	std::string     mDirectory;
+	int             mPending = 0;      // files still being hashed
+
+	std::string               mQueryPath;
+	int                       mQueryFrame = 0;
+	uint64_t                  mQueryHash = 0;
+	bool                      mHasQuery = false;
+	bool                      mStale = false;     // files were added since the last search
+	int                       mFrame = 0;
+	int                       mDistance = 8;
+	std::vector<SimilarFrame> mResults;
+	double                    mSearchMs = 0.0;
+};
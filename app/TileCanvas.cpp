@@ -0,0 +1,308 @@
+/* OpenArcanum ArtViewer tiled canvas for large frames */
+
+#include "app/TileCanvas.h"
+
+#include "artviewer_sprites.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <math.h>
+
+
+namespace
+{
+	const float MaxZoom = 64.0f;
+	const float MinZoom = 1.0f / (1 << (TileCanvas::MaxLevels - 1));
+
+	const int CacheSize = TileCanvas::TileSize * TileCanvas::CacheTilesPerSide;
+}
+
+
+TileCanvas::TileCanvas(SpriteRenderer* sprites)
+	: mSprites(sprites)
+{
+}
+
+
+TileCanvas::~TileCanvas()
+{
+	if (mSprites != nullptr)
+		mSprites->DestroySheet(mCache);
+}
+
+
+void TileCanvas::SetAnimation(const std::shared_ptr<ArtAnimation>& anim)
+{
+	mAnimation = anim;
+	mResident.clear();
+	mSlots.assign(CacheTilesPerSide * CacheTilesPerSide, Slot());
+	mFrame = 0;
+	mPalette = 0;
+	mFitPending = true;
+
+	if (!mAnimation || mSprites == nullptr)
+		return;
+
+	// The cache texture is created once and kept, only the palette table goes with the file. When the
+	// table cannot be replaced, the sheet is built again for this file rather than left without one.
+	std::vector<uint32_t> palettes = ArtAtlas::BuildPalettes(mAnimation->art);
+	int palette_count = static_cast<int>(palettes.size() / 256);
+	if (mCache != nullptr && !mSprites->ReplacePalettes(mCache, palette_count, palettes.data()))
+	{
+		mSprites->DestroySheet(mCache);
+		mCache = nullptr;
+	}
+	if (mCache == nullptr)
+	{
+		bytevec empty(static_cast<size_t>(CacheSize) * CacheSize, 0);
+		mCache = mSprites->CreateSheet(CacheSize, CacheSize, empty.data(), palette_count, palettes.data());
+	}
+}
+
+
+bool TileCanvas::Show(bool* open, const std::shared_ptr<ArtAnimation>& anim)
+{
+	ImGui::SetNextWindowSize(ImVec2(640.0f, 480.0f), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Canvas", open))
+	{
+		ImGui::End();
+		return false;
+	}
+
+	if (anim != mAnimation)
+		SetAnimation(anim);
+
+	if (!mAnimation || mCache == nullptr || mAnimation->art.frame_data.empty())
+	{
+		ImGui::TextDisabled("No frame to show");
+		ImGui::End();
+		return false;
+	}
+
+	ArtFile& art = mAnimation->art;
+	ImGui::SetNextItemWidth(160.0f);
+	ImGui::SliderInt("Frame", &mFrame, 0, static_cast<int>(art.frame_data.size()) - 1);
+	mFrame = std::min(std::max(mFrame, 0), static_cast<int>(art.frame_data.size()) - 1);
+	if (mCache->paletteCount > 1)
+	{
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(120.0f);
+		ImGui::SliderInt("Palette", &mPalette, 0, mCache->paletteCount - 1);
+		mPalette = std::min(std::max(mPalette, 0), mCache->paletteCount - 1);
+	}
+	ImGui::SameLine();
+	bool actual_size = ImGui::Button("1:1");
+	ImGui::SameLine();
+	if (ImGui::Button("Fit"))
+		mFitPending = true;
+
+	const ARTFrameHeader& fh = art.frame_data[mFrame].header;
+	ImGui::Text("%dx%d, zoom %g, %d tiles visible, %d from a coarser level, %d uploads, %d of %d cache slots in use",
+		static_cast<int>(fh.width), static_cast<int>(fh.height), mZoom, mVisibleTiles, mFallbackTiles, mUploads,
+		static_cast<int>(mResident.size()), static_cast<int>(mSlots.size()));
+
+	ImGui::BeginChild("##tiles", ImVec2(0.0f, 0.0f), true, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse | ImGuiWindowFlags_NoMove);
+	ImVec2 view_min = ImGui::GetCursorScreenPos();
+	ImVec2 view_size = ImGui::GetContentRegionAvail();
+	if (mFitPending && view_size.x > 0.0f && view_size.y > 0.0f)
+		Fit(view_size);
+	if (actual_size)
+		ZoomAt(1.0f, ImVec2(view_size.x * 0.5f, view_size.y * 0.5f));
+
+	// Drag to pan, the wheel zooms in powers of two around the mouse so texels stay whole screen pixels
+	ImGuiIO& io = ImGui::GetIO();
+	ImGui::InvisibleButton("##view", ImVec2(std::max(view_size.x, 1.0f), std::max(view_size.y, 1.0f)));
+	if (ImGui::IsItemActive() && ImGui::IsMouseDragging(ImGuiMouseButton_Left, 0.0f))
+	{
+		mOffset.x += io.MouseDelta.x;
+		mOffset.y += io.MouseDelta.y;
+	}
+	if (ImGui::IsItemHovered() && io.MouseWheel != 0.0f)
+		ZoomAt(io.MouseWheel > 0.0f ? mZoom * 2.0f : mZoom * 0.5f, ImVec2(io.MousePos.x - view_min.x, io.MousePos.y - view_min.y));
+
+	ImVec2 origin(floorf(view_min.x + mOffset.x), floorf(view_min.y + mOffset.y));
+	bool complete = DrawFrame(ImGui::GetWindowDrawList(), origin, view_min, ImVec2(view_min.x + view_size.x, view_min.y + view_size.y));
+
+	ImGui::EndChild();
+	ImGui::End();
+	return !complete;
+}
+
+
+void TileCanvas::ZoomAt(float zoom, ImVec2 point)
+{
+	// Keep the frame pixel under 'point' where it is
+	zoom = std::min(std::max(zoom, MinZoom), MaxZoom);
+	float x = (point.x - mOffset.x) / mZoom;
+	float y = (point.y - mOffset.y) / mZoom;
+	mZoom = zoom;
+	mOffset = ImVec2(point.x - x * mZoom, point.y - y * mZoom);
+}
+
+
+void TileCanvas::Fit(ImVec2 viewSize)
+{
+	const ARTFrameHeader& fh = mAnimation->art.frame_data[mFrame].header;
+	float width = static_cast<float>(std::max<int>(fh.width, 1));
+	float height = static_cast<float>(std::max<int>(fh.height, 1));
+
+	// Largest power of two that shows the whole frame
+	mZoom = MaxZoom;
+	while (mZoom > MinZoom && (width * mZoom > viewSize.x || height * mZoom > viewSize.y))
+		mZoom *= 0.5f;
+	mOffset = ImVec2(floorf((viewSize.x - width * mZoom) * 0.5f), floorf((viewSize.y - height * mZoom) * 0.5f));
+	mFitPending = false;
+}
+
+
+auto TileCanvas::GetLevelSize(int level) const -> ImVec2
+{
+	const ARTFrameHeader& fh = mAnimation->art.frame_data[mFrame].header;
+	int step = 1 << level;
+	return ImVec2(static_cast<float>((static_cast<int>(fh.width) + step - 1) >> level), static_cast<float>((static_cast<int>(fh.height) + step - 1) >> level));
+}
+
+
+int TileCanvas::Acquire(int level, int tx, int ty, bool upload)
+{
+	uint64_t key = (static_cast<uint64_t>(mFrame) << 40) | (static_cast<uint64_t>(level) << 32) | (static_cast<uint64_t>(ty) << 16) | static_cast<uint64_t>(tx);
+	auto it = mResident.find(key);
+	if (it != mResident.end())
+	{
+		mSlots[it->second].lastUsed = mSerial;
+		return it->second;
+	}
+
+	if (!upload || mUploads >= MaxUploadsPerFrame)
+		return -1;
+
+	// Least recently used slot that nothing drawn this frame comes from
+	int victim = -1;
+	for (int i = 0; i < static_cast<int>(mSlots.size()); i++)
+		if (mSlots[i].lastUsed < mSerial && (victim < 0 || mSlots[i].lastUsed < mSlots[victim].lastUsed))
+			victim = i;
+	if (victim < 0)
+		return -1;
+
+	Slot& slot = mSlots[victim];
+	if (slot.key != ~0ull)
+		mResident.erase(slot.key);
+	slot.key = ~0ull;
+
+	AV_TRACE_SCOPE("TileCanvas::Upload");
+
+	// Level n is every 2^n-th pixel of the frame, what nearest filtering would pick at that zoom anyway
+	ImVec2 level_size = GetLevelSize(level);
+	int width = std::min(TileSize, static_cast<int>(level_size.x) - tx * TileSize);
+	int height = std::min(TileSize, static_cast<int>(level_size.y) - ty * TileSize);
+	mTileBuffer.resize(static_cast<size_t>(width) * height);
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* row = mAnimation->GetFrameRow(mFrame, (ty * TileSize + y) << level);
+		unsigned char* dst = &mTileBuffer[static_cast<size_t>(y) * width];
+		if (level == 0)
+			std::copy(row + tx * TileSize, row + tx * TileSize + width, dst);
+		else
+			for (int x = 0; x < width; x++)
+				dst[x] = row[static_cast<size_t>(tx * TileSize + x) << level];
+	}
+
+	int slot_x = (victim % CacheTilesPerSide) * TileSize;
+	int slot_y = (victim / CacheTilesPerSide) * TileSize;
+	if (!mSprites->UpdateSheet(mCache, slot_x, slot_y, width, height, mTileBuffer.data()))
+		return -1;
+
+	mUploads++;
+	slot.key = key;
+	slot.lastUsed = mSerial;
+	mResident[key] = victim;
+	return victim;
+}
+
+
+void TileCanvas::AddTile(int level, int slot, int tx, int ty, int offsetX, int offsetY, int width, int height)
+{
+	SpriteInstance sprite;
+	sprite.rect[0] = static_cast<float>((slot % CacheTilesPerSide) * TileSize + offsetX);
+	sprite.rect[1] = static_cast<float>((slot / CacheTilesPerSide) * TileSize + offsetY);
+	sprite.rect[2] = static_cast<float>(width);
+	sprite.rect[3] = static_cast<float>(height);
+	sprite.pos[0] = static_cast<float>(tx * TileSize + offsetX);
+	sprite.pos[1] = static_cast<float>(ty * TileSize + offsetY);
+	sprite.palette = static_cast<float>(mPalette);
+	sprite.tint = IM_COL32_WHITE;
+	mBatches[level].push_back(sprite);
+}
+
+
+bool TileCanvas::DrawFrame(ImDrawList* drawList, ImVec2 origin, ImVec2 clipMin, ImVec2 clipMax)
+{
+	mSerial++;
+	mUploads = 0;
+	mVisibleTiles = 0;
+	mFallbackTiles = 0;
+	for (auto& batch : mBatches)
+		batch.clear();
+
+	// Enough levels to get the whole frame into one tile
+	const ARTFrameHeader& fh = mAnimation->art.frame_data[mFrame].header;
+	mLevels = 1;
+	while (mLevels < MaxLevels && (std::max<int>(fh.width, fh.height) >> (mLevels - 1)) > TileSize)
+		mLevels++;
+
+	// Finest level whose texels are still no smaller than half a screen pixel
+	int level = 0;
+	while (level + 1 < mLevels && mZoom * static_cast<float>(1 << (level + 1)) <= 1.0f)
+		level++;
+
+	// Cull against the view: only tiles overlapping it are looked at
+	float scale = mZoom * static_cast<float>(1 << level);
+	ImVec2 level_size = GetLevelSize(level);
+	int tiles_x = (static_cast<int>(level_size.x) + TileSize - 1) / TileSize;
+	int tiles_y = (static_cast<int>(level_size.y) + TileSize - 1) / TileSize;
+	int tx0 = std::max(0, static_cast<int>(floorf((clipMin.x - origin.x) / scale / TileSize)));
+	int ty0 = std::max(0, static_cast<int>(floorf((clipMin.y - origin.y) / scale / TileSize)));
+	int tx1 = std::min(tiles_x - 1, static_cast<int>(floorf((clipMax.x - origin.x) / scale / TileSize)));
+	int ty1 = std::min(tiles_y - 1, static_cast<int>(floorf((clipMax.y - origin.y) / scale / TileSize)));
+
+	bool complete = true;
+	for (int ty = ty0; ty <= ty1; ty++)
+		for (int tx = tx0; tx <= tx1; tx++)
+		{
+			mVisibleTiles++;
+			int width = std::min(TileSize, static_cast<int>(level_size.x) - tx * TileSize);
+			int height = std::min(TileSize, static_cast<int>(level_size.y) - ty * TileSize);
+
+			int slot = Acquire(level, tx, ty, true);
+			if (slot >= 0)
+			{
+				AddTile(level, slot, tx, ty, 0, 0, width, height);
+				continue;
+			}
+			complete = false;
+
+			// Until it is uploaded, the matching part of a coarser tile already in the cache stands in
+			for (int parent = level + 1; parent < mLevels; parent++)
+			{
+				int shift = parent - level;
+				int parent_slot = Acquire(parent, tx >> shift, ty >> shift, false);
+				if (parent_slot < 0)
+					continue;
+
+				ImVec2 parent_size = GetLevelSize(parent);
+				int offset_x = (tx - ((tx >> shift) << shift)) * (TileSize >> shift);
+				int offset_y = (ty - ((ty >> shift) << shift)) * (TileSize >> shift);
+				int parent_width = std::min((width + (1 << shift) - 1) >> shift, static_cast<int>(parent_size.x) - (tx >> shift) * TileSize - offset_x);
+				int parent_height = std::min((height + (1 << shift) - 1) >> shift, static_cast<int>(parent_size.y) - (ty >> shift) * TileSize - offset_y);
+				AddTile(parent, parent_slot, tx >> shift, ty >> shift, offset_x, offset_y, parent_width, parent_height);
+				mFallbackTiles++;
+				break;
+			}
+		}
+
+	for (int l = mLevels - 1; l >= 0; l--)
+		if (!mBatches[l].empty())
+			mSprites->AddBatch(drawList, mCache, mBatches[l].data(), static_cast<int>(mBatches[l].size()), origin, mZoom * static_cast<float>(1 << l));
+
+	return complete;
+}
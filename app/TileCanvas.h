@@ -0,0 +1,81 @@
+/* OpenArcanum ArtViewer tiled canvas for large frames */
+
+#pragma once
+
+#include "imgui.h"
+#include "app/ArtPlayback.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class SpriteRenderer;
+struct SpriteSheet;
+struct SpriteInstance;
+
+// One frame at any zoom and pan with nearest filtering. The frame is cut into TileSize tiles that are
+// uploaded into slots of a fixed tile cache only while visible. Zoomed out, tiles of a coarser level
+// (every 2nd, 4th ... pixel of the frame) are drawn instead, so the number of tiles on screen stays
+// bounded too. VRAM use is the cache texture whatever the frame size.
+class TileCanvas
+{
+public:
+	static const int TileSize = 256;
+	static const int CacheTilesPerSide = 16;       // 4096x4096 R8, 16 MB: a 4K view at 1:1 needs up to 170 tiles
+	static const int MaxUploadsPerFrame = 16;      // the rest shows a coarser level until the next frames
+	static const int MaxLevels = 8;
+
+	explicit TileCanvas(SpriteRenderer* sprites);
+	~TileCanvas();
+
+	TileCanvas(const TileCanvas&) = delete;
+	TileCanvas(TileCanvas&&) = delete;
+
+	// 'anim' may change between calls, the cache starts over when it does.
+	// Returns true while visible tiles are still waiting for their upload.
+	bool Show(bool* open, const std::shared_ptr<ArtAnimation>& anim);
+
+protected:
+	struct Slot
+	{
+		uint64_t key = ~0ull;
+		int      lastUsed = -1;
+	};
+
+	void SetAnimation(const std::shared_ptr<ArtAnimation>& anim);
+	void ZoomAt(float zoom, ImVec2 point);
+	void Fit(ImVec2 viewSize);
+
+	// Cache slot holding the tile, uploaded now if 'upload' and a slot is free; -1 when not resident
+	int  Acquire(int level, int tx, int ty, bool upload);
+	void AddTile(int level, int slot, int tx, int ty, int offsetX, int offsetY, int width, int height);
+	auto GetLevelSize(int level) const -> ImVec2;
+
+	// Draws the visible tiles, false if some could not be drawn at their level
+	bool DrawFrame(ImDrawList* drawList, ImVec2 origin, ImVec2 clipMin, ImVec2 clipMax);
+
+protected:
+	SpriteRenderer* mSprites;
+
+	std::shared_ptr<ArtAnimation> mAnimation;
+	SpriteSheet*                  mCache = nullptr;
+	int                           mLevels = 1;
+
+	std::vector<Slot>                 mSlots;
+	std::unordered_map<uint64_t, int> mResident;     // tile key to slot
+	bytevec                           mTileBuffer;
+	std::vector<SpriteInstance>       mBatches[MaxLevels];
+
+	int    mFrame = 0;
+	int    mPalette = 0;
+	float  mZoom = 1.0f;
+	ImVec2 mOffset = ImVec2(0.0f, 0.0f);     // screen position of the frame's top-left corner in the view
+	bool   mFitPending = true;
+
+	// Per shown frame
+	int    mSerial = 0;
+	int    mUploads = 0;
+	int    mVisibleTiles = 0;
+	int    mFallbackTiles = 0;
+};
@@ -0,0 +1,198 @@
+/* OpenArcanum ArtViewer trace recording */
+
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace Trace
+{
+	std::atomic<bool> gEnabled(false);
+}
+
+namespace
+{
+	// Per thread: about 2.5 MB, several seconds of a busy render loop
+	const size_t RingSize = 1 << 15;
+	const size_t DetailSize = 56;
+
+	struct Event
+	{
+		const char* name;
+		uint64_t    ts;
+		uint64_t    dur;
+		int64_t     value;
+		char        phase;
+		char        detail[DetailSize];
+	};
+
+	// Single writer, the owning thread. WriteJson() reads concurrently and drops whatever the writer
+	// may have overwritten meanwhile, so recording never takes a lock.
+	struct ThreadRing
+	{
+		std::string           name;
+		int                   tid = 0;
+		std::atomic<uint64_t> head{ 0 };
+		std::unique_ptr<Event[]> events{ new Event[RingSize] };
+	};
+
+	std::mutex                               gRingsMutex;
+	std::vector<std::unique_ptr<ThreadRing>> gRings;    // kept after their thread exits, until the process ends
+	thread_local ThreadRing*                 tRing = nullptr;
+
+	ThreadRing* GetRing()
+	{
+		if (tRing == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(gRingsMutex);
+			gRings.emplace_back(new ThreadRing());
+			tRing = gRings.back().get();
+			tRing->tid = static_cast<int>(gRings.size());
+			tRing->name = "thread " + std::to_string(tRing->tid);
+		}
+		return tRing;
+	}
+
+	void Push(char phase, const char* name, uint64_t ts, uint64_t dur, int64_t value, const char* detail)
+	{
+		ThreadRing* ring = GetRing();
+		uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+		Event& e = ring->events[head % RingSize];
+		e.name = name;
+		e.ts = ts;
+		e.dur = dur;
+		e.value = value;
+		e.phase = phase;
+		e.detail[0] = 0;
+		if (detail != nullptr)
+		{
+			// Paths are the usual detail, their end says more than their start
+			size_t len = strlen(detail);
+			const char* tail = len < DetailSize ? detail : detail + len - (DetailSize - 1);
+			memcpy(e.detail, tail, std::min(len, DetailSize - 1) + 1);
+		}
+
+		ring->head.store(head + 1, std::memory_order_release);
+	}
+
+	void WriteEscaped(FILE* f, const char* s)
+	{
+		for (; *s; s++)
+		{
+			unsigned char c = (unsigned char)*s;
+			if (c == '"' || c == '\\')
+				fprintf(f, "\\%c", c);
+			else if (c < 0x20)
+				fprintf(f, "\\u%04x", c);
+			else
+				fputc(c, f);
+		}
+	}
+}
+
+
+void Trace::SetEnabled(bool enabled)
+{
+	gEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+
+void Trace::SetThreadName(const char* name)
+{
+	ThreadRing* ring = GetRing();
+	std::lock_guard<std::mutex> lock(gRingsMutex);
+	ring->name = name;
+}
+
+
+uint64_t Trace::Now()
+{
+	static const auto start = std::chrono::steady_clock::now();
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+void Trace::Complete(const char* name, uint64_t start, const char* detail)
+{
+	Push('X', name, start, Now() - start, 0, detail);
+}
+
+
+void Trace::Instant(const char* name, const char* detail)
+{
+	Push('i', name, Now(), 0, 0, detail);
+}
+
+
+void Trace::Counter(const char* name, int64_t value)
+{
+	Push('C', name, Now(), 0, value, nullptr);
+}
+
+
+bool Trace::WriteJson(const std::string& path)
+{
+	FILE* f = fopen(path.c_str(), "wb");
+	if (f == nullptr)
+	{
+		fprintf(stderr, "Cannot write trace to %s\n", path.c_str());
+		return false;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+
+	std::lock_guard<std::mutex> lock(gRingsMutex);
+	std::vector<Event> events(RingSize);
+	for (const auto& ring : gRings)
+	{
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", first ? "" : ",\n", ring->tid);
+		WriteEscaped(f, ring->name.c_str());
+		fprintf(f, "\"}}");
+		first = false;
+
+		// Copy first, then keep only what the writer cannot have touched during the copy
+		uint64_t end = ring->head.load(std::memory_order_acquire);
+		uint64_t begin = end > RingSize ? end - RingSize : 0;
+		for (uint64_t i = begin; i < end; i++)
+			events[i - begin] = ring->events[i % RingSize];
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = ring->head.load(std::memory_order_relaxed);
+		uint64_t safe = after + 1 > RingSize ? after + 1 - RingSize : 0;
+
+		for (uint64_t i = std::max(begin, safe); i < end; i++)
+		{
+			const Event& e = events[i - begin];
+			fprintf(f, ",\n{\"name\":\"");
+			WriteEscaped(f, e.name);
+			fprintf(f, "\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%llu", e.phase, ring->tid, (unsigned long long)e.ts);
+			if (e.phase == 'X')
+				fprintf(f, ",\"dur\":%llu", (unsigned long long)e.dur);
+			if (e.phase == 'i')
+				fprintf(f, ",\"s\":\"t\"");
+			if (e.phase == 'C')
+				fprintf(f, ",\"args\":{\"value\":%lld}", (long long)e.value);
+			else if (e.detail[0] != 0)
+			{
+				fprintf(f, ",\"args\":{\"detail\":\"");
+				WriteEscaped(f, e.detail);
+				fprintf(f, "\"}");
+			}
+			fprintf(f, "}");
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	if (!ok)
+		fprintf(stderr, "Cannot write trace to %s\n", path.c_str());
+	return ok;
+}
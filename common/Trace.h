@@ -0,0 +1,78 @@
+/* OpenArcanum ArtViewer trace recording, written out in Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev) */
+
+#pragma once
+
+// Build with ARTVIEWER_TRACE=0 to compile every AV_TRACE_* macro to nothing
+#ifndef ARTVIEWER_TRACE
+#define ARTVIEWER_TRACE 1
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Trace
+{
+	// Recording is off until enabled; a disabled macro costs one relaxed load
+	void SetEnabled(bool enabled);
+	inline bool IsEnabled()
+	{
+		extern std::atomic<bool> gEnabled;
+		return gEnabled.load(std::memory_order_relaxed);
+	}
+
+	// Shown as the track name; call once from the thread itself
+	void SetThreadName(const char* name);
+
+	// Microseconds since the first call, the timestamp unit of the trace format
+	uint64_t Now();
+
+	// 'name' must outlive the trace, i.e. a string literal. 'detail' is copied and may be truncated.
+	void Complete(const char* name, uint64_t start, const char* detail = nullptr);
+	void Instant(const char* name, const char* detail = nullptr);
+	void Counter(const char* name, int64_t value);
+
+	// Everything still in the per-thread rings, oldest events may have been overwritten already
+	bool WriteJson(const std::string& path);
+
+	class Scope
+	{
+	public:
+		explicit Scope(const char* name, const char* detail = nullptr)
+			: mName(IsEnabled() ? name : nullptr)
+			, mDetail(detail)
+			, mStart(mName ? Now() : 0)
+		{
+		}
+
+		~Scope()
+		{
+			if (mName)
+				Complete(mName, mStart, mDetail);
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		const char* mName;
+		const char* mDetail;
+		uint64_t    mStart;
+	};
+}
+
+#if ARTVIEWER_TRACE
+#define AV_TRACE_CONCAT_(a, b) a##b
+#define AV_TRACE_CONCAT(a, b) AV_TRACE_CONCAT_(a, b)
+#define AV_TRACE_SCOPE(name) Trace::Scope AV_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define AV_TRACE_SCOPE_DETAIL(name, detail) Trace::Scope AV_TRACE_CONCAT(trace_scope_, __LINE__)(name, detail)
+#define AV_TRACE_INSTANT(name, detail) do { if (Trace::IsEnabled()) Trace::Instant(name, detail); } while (0)
+#define AV_TRACE_COUNTER(name, value) do { if (Trace::IsEnabled()) Trace::Counter(name, (int64_t)(value)); } while (0)
+#define AV_TRACE_THREAD_NAME(name) Trace::SetThreadName(name)
+#else
+#define AV_TRACE_SCOPE(name) do {} while (0)
+#define AV_TRACE_SCOPE_DETAIL(name, detail) do {} while (0)
+#define AV_TRACE_INSTANT(name, detail) do {} while (0)
+#define AV_TRACE_COUNTER(name, value) do {} while (0)
+#define AV_TRACE_THREAD_NAME(name) do {} while (0)
+#endif
@@ -2,11 +2,120 @@
    Refactored for OpenArcanum https://github.com/OpenArcanum/artviewer */
 
 #include "formats/art.h"
+#include "formats/png.h"
+#include "formats/quantize.h"
+#include "common/Trace.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 
 
+// One lane of xxHash64: 8 bytes per step, a multiply and a rotate each, then a final avalanche
+static const uint64_t HashPrime1 = 0x9E3779B185EBCA87ull;
+static const uint64_t HashPrime2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t HashPrime3 = 0x165667B19E3779F9ull;
+static const uint64_t HashPrime4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t HashPrime5 = 0x27D4EB2F165667C5ull;
+
+static auto rotl64(uint64_t v, int bits) -> uint64_t
+{
+	return (v << bits) | (v >> (64 - bits));
+}
+
+auto hash_bytes(const void* data, size_t size, uint64_t seed) -> uint64_t
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const unsigned char* end = p + size;
+	uint64_t h = seed + HashPrime5 + size;
+
+	for (; p + 8 <= end; p += 8)
+	{
+		uint64_t k;
+		memcpy(&k, p, 8);
+		h ^= rotl64(k * HashPrime2, 31) * HashPrime1;
+		h = rotl64(h, 27) * HashPrime1 + HashPrime4;
+	}
+	for (; p < end; p++)
+		h = rotl64(h ^ (*p * HashPrime5), 11) * HashPrime1;
+
+	h ^= h >> 33;
+	h *= HashPrime2;
+	h ^= h >> 29;
+	h *= HashPrime3;
+	h ^= h >> 32;
+	return h;
+}
+
+auto from_disk(const ARTDiskHeader& d) -> ARTheader
+{
+	ARTheader h;
+	for (int i = 0; i < 3; i++)
+		h.h0[i] = d.h0[i];
+	std::copy(std::begin(d.stupid_color), std::end(d.stupid_color), h.stupid_color);
+	h.frame_num_low = d.frame_num_low;
+	h.frame_num = d.frame_num;
+	std::copy(std::begin(d.palette_data1), std::end(d.palette_data1), h.palette_data1);
+	std::copy(std::begin(d.palette_data2), std::end(d.palette_data2), h.palette_data2);
+	std::copy(std::begin(d.palette_data3), std::end(d.palette_data3), h.palette_data3);
+	return h;
+}
+
+auto from_disk(const ARTDiskFrameHeader& d) -> ARTFrameHeader
+{
+	return ARTFrameHeader{ d.width, d.height, d.size, d.c_x, d.c_y, d.d_x, d.d_y };
+}
+
+auto from_disk(const bmpDiskHeader& d) -> bmpHeader
+{
+	return bmpHeader{ d.bfType, d.bfSize, d.bfReserved1, d.bfReserved2, d.bfOffBits };
+}
+
+auto from_disk(const bmpDiskInfoHeader& d) -> bmpInfoHeader
+{
+	return bmpInfoHeader{ d.biSize, d.biWidth, d.biHeight, d.biPlanes, d.biBitCount, d.biCompression,
+		d.biSizeImage, d.biXPelsPerMeter, d.biYPelsPerMeter, d.biClrUsed, d.biClrImportant };
+}
+
+auto to_disk(const ARTheader& h) -> ARTDiskHeader
+{
+	ARTDiskHeader d;
+	for (int i = 0; i < 3; i++)
+		d.h0[i] = static_cast<uint32_t>(h.h0[i]);
+	std::copy(std::begin(h.stupid_color), std::end(h.stupid_color), d.stupid_color);
+	d.frame_num_low = static_cast<uint32_t>(h.frame_num_low);
+	d.frame_num = static_cast<uint32_t>(h.frame_num);
+	std::copy(std::begin(h.palette_data1), std::end(h.palette_data1), d.palette_data1);
+	std::copy(std::begin(h.palette_data2), std::end(h.palette_data2), d.palette_data2);
+	std::copy(std::begin(h.palette_data3), std::end(h.palette_data3), d.palette_data3);
+	return d;
+}
+
+auto to_disk(const ARTFrameHeader& h) -> ARTDiskFrameHeader
+{
+	return ARTDiskFrameHeader{ static_cast<uint32_t>(h.width), static_cast<uint32_t>(h.height), static_cast<uint32_t>(h.size),
+		h.c_x, h.c_y, h.d_x, h.d_y };
+}
+
+auto to_disk(const bmpHeader& h) -> bmpDiskHeader
+{
+	return bmpDiskHeader{ h.bfType, static_cast<uint32_t>(h.bfSize), h.bfReserved1, h.bfReserved2, static_cast<uint32_t>(h.bfOffBits) };
+}
+
+auto to_disk(const bmpInfoHeader& h) -> bmpDiskInfoHeader
+{
+	return bmpDiskInfoHeader{ static_cast<uint32_t>(h.biSize), static_cast<int32_t>(h.biWidth), static_cast<int32_t>(h.biHeight),
+		h.biPlanes, h.biBitCount, static_cast<uint32_t>(h.biCompression), static_cast<uint32_t>(h.biSizeImage),
+		static_cast<int32_t>(h.biXPelsPerMeter), static_cast<int32_t>(h.biYPelsPerMeter),
+		static_cast<uint32_t>(h.biClrUsed), static_cast<uint32_t>(h.biClrImportant) };
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
 auto ArtFrame::Inc() -> bool
 {
 	px++;
@@ -43,23 +152,26 @@ auto ArtFrame::EOD() -> bool
 
 auto ArtFrame::LoadHeader(std::ifstream& source) -> void
 {
-	source.read(reinterpret_cast<char*>(&header), sizeof(header));
+	ARTDiskFrameHeader disk;
+	source.read(reinterpret_cast<char*>(&disk), sizeof(disk));
+	header = from_disk(disk);
 }
 
 auto ArtFrame::SaveHeader(std::ofstream& dest) -> void
 {
-	dest.write(reinterpret_cast<char*>(&header), sizeof(header));
+	ARTDiskFrameHeader disk = to_disk(header);
+	dest.write(reinterpret_cast<char*>(&disk), sizeof(disk));
 }
 
 auto ArtFrame::Load(std::ifstream& source) -> void
 {
-	data = new char[header.size];
-	source.read(data, header.size);
+	data.resize(header.size);
+	source.read(data.data(), header.size);
 }
 
 auto ArtFrame::Save(std::ofstream& source) -> void
 {
-	source.write(data, header.size);
+	source.write(data.data(), header.size);
 }
 
 auto ArtFrame::GetValue(int x, int y) -> unsigned char
@@ -86,6 +198,7 @@ auto ArtFrame::SetSize(int w, int h) -> void
 
 auto ArtFrame::Encode() -> void
 {
+	AV_TRACE_SCOPE("ArtFrame::Encode");
 	std::string data_compressed;
 	std::string data_raw;
 
@@ -143,43 +256,47 @@ auto ArtFrame::Encode() -> void
 
 	if (data_raw.size() <= data_compressed.size())
 	{
-		data = new char[data_raw.size()];
-		memcpy(data, data_raw.c_str(), data_raw.size());
+		data.assign(data_raw.begin(), data_raw.end());
 		header.size = static_cast<unsigned long>(data_raw.size());
 	}
 	else
 	{
-		data = new char[data_compressed.size()];
-		memcpy(data, data_compressed.c_str(), data_compressed.size());
+		data.assign(data_compressed.begin(), data_compressed.end());
 		header.size = static_cast<unsigned long>(data_compressed.size());
 	}
 }
 
 auto ArtFrame::Decode() -> void
 {
+	AV_TRACE_SCOPE("ArtFrame::Decode");
 	pixels = bytemap(header.height, bytevec(header.width));
 	Reset();
+	if (header.width == 0 || header.height == 0)
+		return;
+
+	// Corrupt data may ask for more pixels than the frame has or end within an opcode, either stops
+	// the decoding as in DecodeRows(); whatever the data leaves out stays transparent
+	const int size = static_cast<int>(header.size);
 	if (header.size < (header.height*header.width))
 	{
-		for (int p = 0; p < static_cast<int>(header.size); p++)
+		for (int p = 0; p < size && !EOD(); p++)
 		{
 			unsigned char ch = static_cast<unsigned char>(data[p]);
 			if (ch & 0x80)
 			{
 				int to_copy = ch & (0x7F);
-				while (to_copy--)
+				while (to_copy-- && p + 1 < size && !EOD())
 				{
 					p++;
 					pixels[py][px] = data[p];
 					Inc();
 				}
 			}
-			else
+			else if (++p < size)
 			{
 				int to_clone = ch & (0x7F);
-				p++;
 				unsigned char src = static_cast<unsigned char>(data[p]);
-				while (to_clone--)
+				while (to_clone-- && !EOD())
 				{
 					pixels[py][px] = src;
 					Inc();
@@ -189,7 +306,7 @@ auto ArtFrame::Decode() -> void
 	}
 	else
 	{
-		for (int p = 0; p < static_cast<int>(header.size); p++)
+		for (int p = 0; p < size && !EOD(); p++)
 		{
 			pixels[py][px] = data[p];
 			Inc();
@@ -197,18 +314,327 @@ auto ArtFrame::Decode() -> void
 	}
 }
 
+auto ArtFrame::DecodeRows(const std::function<void(const unsigned char* row)>& emit) -> void
+{
+	const int width = static_cast<int>(header.width);
+	const int height = static_cast<int>(header.height);
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (!pixels.empty())
+	{
+		for (int y = 0; y < height; y++)
+			emit(pixels[y].data());
+		return;
+	}
+
+	AV_TRACE_SCOPE("ArtFrame::DecodeRows");
+	bytevec row(width);
+	int x = 0, rows = 0;
+	auto put = [&](unsigned char v)
+	{
+		row[x++] = v;
+		if (x == width)
+		{
+			emit(row.data());
+			x = 0;
+			rows++;
+		}
+	};
+
+	const int size = static_cast<int>(header.size);
+	if (header.size < header.height * header.width)
+	{
+		for (int p = 0; p < size && rows < height; p++)
+		{
+			unsigned char ch = static_cast<unsigned char>(data[p]);
+			int count = ch & 0x7F;
+			if (ch & 0x80)
+			{
+				while (count-- && p + 1 < size && rows < height)
+					put(static_cast<unsigned char>(data[++p]));
+			}
+			else if (++p < size)
+			{
+				unsigned char src = static_cast<unsigned char>(data[p]);
+				while (count-- && rows < height)
+					put(src);
+			}
+		}
+	}
+	else
+	{
+		for (int p = 0; p < size && rows < height; p++)
+			put(static_cast<unsigned char>(data[p]));
+	}
+
+	// Whatever the data leaves out stays transparent, as with Decode()
+	while (rows < height)
+		put(0);
+}
+
+auto ArtFrame::Trim(bool bottom_up) -> size_t
+{
+	const int width = static_cast<int>(header.width);
+	const int height = static_cast<int>(header.height);
+	if (width <= 0 || height <= 0 || pixels.empty())
+		return 0;
+
+	// OR of the whole row, a loop the compiler vectorises
+	auto row_empty = [&](int y)
+	{
+		const unsigned char* row = pixels[y].data();
+		unsigned char any = 0;
+		for (int x = 0; x < width; x++)
+			any |= row[x];
+		return any == 0;
+	};
+
+	int top = 0;
+	while (top < height && row_empty(top))
+		top++;
+
+	// Nothing visible: one transparent pixel at the frame's corner
+	int bottom = height - 1, left = 0, right = 0;
+	if (top == height)
+	{
+		top = bottom = bottom_up ? height - 1 : 0;
+	}
+	else
+	{
+		while (row_empty(bottom))
+			bottom--;
+
+		// Each row only has to be searched outside the columns already known to be in use
+		left = width;
+		right = -1;
+		for (int y = top; y <= bottom; y++)
+		{
+			const unsigned char* row = pixels[y].data();
+			for (int x = 0; x < left; x++)
+				if (row[x] != 0)
+				{
+					left = x;
+					break;
+				}
+			for (int x = width - 1; x > right; x--)
+				if (row[x] != 0)
+				{
+					right = x;
+					break;
+				}
+		}
+	}
+
+	const int trimmed_width = right - left + 1;
+	const int trimmed_height = bottom - top + 1;
+	if (trimmed_width == width && trimmed_height == height)
+		return 0;
+
+	bytemap cropped(trimmed_height);
+	for (int y = 0; y < trimmed_height; y++)
+		cropped[y].assign(pixels[top + y].begin() + left, pixels[top + y].begin() + right + 1);
+	pixels.swap(cropped);
+
+	// The frame's top-left corner is drawn at the anchor minus c_x/c_y
+	header.c_x -= left;
+	header.c_y -= bottom_up ? height - 1 - bottom : top;
+	header.width = trimmed_width;
+	header.height = trimmed_height;
+
+	std::vector<char>().swap(data);
+	header.size = 0;
+
+	return static_cast<size_t>(width) * height - static_cast<size_t>(trimmed_width) * trimmed_height;
+}
+
+auto ArtFrame::GetContentHash() -> uint64_t
+{
+	const uint32_t size[2] = { static_cast<uint32_t>(header.width), static_cast<uint32_t>(header.height) };
+	uint64_t h = hash_bytes(size, sizeof(size));
+	DecodeRows([&](const unsigned char* row) { h = hash_bytes(row, header.width, h); });
+	return h;
+}
+
+auto ArtFrame::IsSameContent(const ArtFrame& other) const -> bool
+{
+	if (header.width != other.header.width || header.height != other.header.height)
+		return false;
+	if (!pixels.empty() || !other.pixels.empty())
+		return pixels == other.pixels;
+	return header.size == other.header.size && (header.size == 0 || memcmp(data.data(), other.data.data(), header.size) == 0);
+}
+
+// Walks the frame's indices in stream order: clone(pos, count, value) once per clone opcode, and
+// literal(pos, bytes, count) for literal opcodes, raw frames, or each row of a decoded one. Both are
+// clipped to the frame; a false return stops the walk.
+template <typename Clone, typename Literal>
+static auto for_each_run(const ArtFrame& frame, Clone clone, Literal literal) -> void
+{
+	const size_t width = frame.header.width;
+	const size_t total = width * frame.header.height;
+	if (total == 0)
+		return;
+
+	if (!frame.pixels.empty())
+	{
+		for (size_t y = 0; y < frame.pixels.size(); y++)
+			if (!literal(y * width, frame.pixels[y].data(), width))
+				return;
+		return;
+	}
+
+	const size_t size = frame.header.size;
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(frame.data.data());
+	if (size >= total)
+	{
+		literal(0, data, total);
+		return;
+	}
+
+	size_t pos = 0;
+	for (size_t p = 0; p < size && pos < total; p++)
+	{
+		unsigned char ch = data[p];
+		size_t count = ch & 0x7F;
+		if (ch & 0x80)
+		{
+			count = std::min(std::min(count, size - p - 1), total - pos);
+			if (count > 0 && !literal(pos, data + p + 1, count))
+				return;
+			p += count;
+			pos += count;
+		}
+		else if (++p < size && count > 0)
+		{
+			count = std::min(count, total - pos);
+			if (!clone(pos, count, data[p]))
+				return;
+			pos += count;
+		}
+	}
+}
+
+auto FrameSummary::GetColorCount() const -> int
+{
+	int colors = 0;
+	for (int i = 1; i < 256; i++)
+		colors += histogram[i] != 0;
+	return colors;
+}
+
+auto ArtFrame::Summarize() const -> FrameSummary
+{
+	AV_TRACE_SCOPE("ArtFrame::Summarize");
+	FrameSummary summary;
+	const size_t width = header.width;
+	size_t left = width, top = header.height, right = 0, bottom = 0;
+	auto cover = [&](size_t row, size_t first_col, size_t last_col)
+	{
+		top = std::min(top, row);
+		bottom = std::max(bottom, row);
+		left = std::min(left, first_col);
+		right = std::max(right, last_col);
+	};
+
+	auto clone = [&](size_t pos, size_t count, unsigned char value)
+	{
+		summary.histogram[value] += static_cast<uint32_t>(count);
+		if (value == 0)
+			return true;
+
+		// A run wrapping into the next row covers its first and last column
+		size_t first_row = pos / width, last_row = (pos + count - 1) / width;
+		if (first_row != last_row)
+		{
+			cover(first_row, 0, width - 1);
+			cover(last_row, 0, width - 1);
+		}
+		else
+			cover(first_row, pos % width, (pos + count - 1) % width);
+		return true;
+	};
+
+	// Row by row, so only the first and last visible pixel of each piece touch the box
+	auto literal = [&](size_t pos, const unsigned char* bytes, size_t count)
+	{
+		size_t row = pos / width, col = pos % width;
+		while (count > 0)
+		{
+			size_t n = std::min(count, width - col);
+			size_t first = n, last = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				summary.histogram[bytes[i]]++;
+				if (bytes[i] != 0)
+				{
+					first = std::min(first, i);
+					last = i;
+				}
+			}
+			if (first < n)
+				cover(row, col + first, col + last);
+
+			bytes += n;
+			count -= n;
+			row++;
+			col = 0;
+		}
+		return true;
+	};
+
+	for_each_run(*this, clone, literal);
+
+	// Pixels a short stream never reaches decode as 0, they count as transparent too
+	uint64_t covered = summary.histogram[0];
+	for (int i = 1; i < 256; i++)
+		summary.opaque += summary.histogram[i];
+	covered += summary.opaque;
+	summary.histogram[0] += static_cast<uint32_t>(width * header.height - covered);
+	if (summary.opaque > 0)
+	{
+		summary.left = static_cast<int>(left);
+		summary.top = static_cast<int>(top);
+		summary.right = static_cast<int>(right);
+		summary.bottom = static_cast<int>(bottom);
+	}
+	return summary;
+}
+
+auto ArtFrame::IsTransparent() const -> bool
+{
+	bool transparent = true;
+	auto clone = [&](size_t, size_t, unsigned char value)
+	{
+		transparent = value == 0;
+		return transparent;
+	};
+	auto literal = [&](size_t, const unsigned char* bytes, size_t count)
+	{
+		transparent = std::all_of(bytes, bytes + count, [](unsigned char v) { return v == 0; });
+		return transparent;
+	};
+	for_each_run(*this, clone, literal);
+	return transparent;
+}
+
 //-----------------------------------------------------------------------
 //-----------------------------------------------------------------------
 
-auto ArtFile::LoadArt(const std::string &fname) -> void
+auto ArtFile::LoadArt(const std::string &fname, bool decode) -> void
 {
+	AV_TRACE_SCOPE_DETAIL("ArtFile::LoadArt", fname.c_str());
 	std::ifstream source;
 	source.open(fname, std::ios_base::binary);
 
 	if (!source)
 		throw MissingFile{ fname };
 
-	source.read(reinterpret_cast<char*>(&header), sizeof(header));
+	ARTDiskHeader disk_header;
+	source.read(reinterpret_cast<char*>(&disk_header), sizeof(disk_header));
+	if (!source)
+		throw MissingFile{ fname };
+	header = from_disk(disk_header);
 
 	animated = ((header.h0[0] & 0x1) == 0);
 
@@ -217,46 +643,66 @@ auto ArtFile::LoadArt(const std::string &fname) -> void
 	{
 		if (in_palette(col)) palettes++;
 	}
-	frames = header.frame_num;
 	key_frame = header.frame_num_low;
 
-	if (animated) frames *= 8;
+	// Counts come from the file, they must fit in it before anything is allocated for them. In 64 bits,
+	// eight directions of a 32-bit count overflow an int.
+	int64_t frame_count = static_cast<int64_t>(header.frame_num) * (animated ? 8 : 1);
+	std::streamoff table_size = palettes * static_cast<std::streamoff>(sizeof(CTABLE_255)) + frame_count * static_cast<std::streamoff>(sizeof(ARTDiskFrameHeader));
+	std::streamoff table_start = source.tellg();
+	source.seekg(0, std::ios_base::end);
+	const std::streamoff file_end = source.tellg();
+	if (frame_count > INT32_MAX || file_end - table_start < table_size)
+		throw MissingFile{ fname };
+	source.seekg(table_start);
+	frames = static_cast<int>(frame_count);
 
-	for (int i = 0; i < palettes; i++)
-	{
-		palette_data.push_back(CTABLE_255());
-		source.read(reinterpret_cast<char*>(&palette_data.back()), sizeof(CTABLE_255));
-	}
+	palette_data.resize(palettes);
+	source.read(reinterpret_cast<char*>(palette_data.data()), palettes * sizeof(CTABLE_255));
+
+	// The frame header table in one read, a truncated one would leave frames of garbage sizes
+	std::vector<ARTDiskFrameHeader> frame_headers(frames);
+	source.read(reinterpret_cast<char*>(frame_headers.data()), frames * sizeof(ARTDiskFrameHeader));
+	if (!source)
+		throw MissingFile{ fname };
 
+	frame_data.resize(frames);
 	for (int i = 0; i < frames; i++)
-	{
-		frame_data.push_back(ArtFrame());
-		frame_data.back().LoadHeader(source);
-	}
+		frame_data[i].header = from_disk(frame_headers[i]);
 
+	// Each frame's data must be in what is left of the file, and be read whole
+	std::streamoff left = file_end - table_start - table_size;
 	for (auto &af : frame_data)
 	{
+		if (static_cast<std::streamoff>(af.header.size) > left)
+			throw MissingFile{ fname };
+		left -= af.header.size;
 		af.Load(source);
-		af.Decode();
+		if (!source)
+			throw MissingFile{ fname };
+		if (decode)
+			af.Decode();
 	}
 }
 
-auto ArtFile::SaveArt(const std::string &fname) -> void
+auto ArtFile::SaveArt(const std::string &fname, bool encode) -> void
 {
+	AV_TRACE_SCOPE_DETAIL("ArtFile::SaveArt", fname.c_str());
 	std::ofstream source;
 	source.open(fname, std::ios_base::binary);
-	source.write(reinterpret_cast<char*>(&header), sizeof(header));
-
-	for (int i = 0; i < palettes; i++)
-	{
-		source.write(reinterpret_cast<char*>(&palette_data[i]), sizeof(CTABLE_255));
-	}
+	ARTDiskHeader disk_header = to_disk(header);
+	source.write(reinterpret_cast<char*>(&disk_header), sizeof(disk_header));
+	source.write(reinterpret_cast<char*>(palette_data.data()), palettes * sizeof(CTABLE_255));
 
+	std::vector<ARTDiskFrameHeader> frame_headers;
+	frame_headers.reserve(frame_data.size());
 	for (auto &af : frame_data)
 	{
-		af.Encode();
-		af.SaveHeader(source);
+		if (encode)
+			af.Encode();
+		frame_headers.push_back(to_disk(af.header));
 	}
+	source.write(reinterpret_cast<char*>(frame_headers.data()), frame_headers.size() * sizeof(ARTDiskFrameHeader));
 
 	for (auto &af : frame_data)
 	{
@@ -266,7 +712,22 @@ auto ArtFile::SaveArt(const std::string &fname) -> void
 	source.close();
 }
 
-auto ArtFile::LoadBMPS(const std::string &fname) -> void
+auto ArtFile::LoadBMPS(const std::string &fname, bool dither, bool trim) -> void
+{
+	AV_TRACE_SCOPE_DETAIL("ArtFile::LoadBMPS", fname.c_str());
+	LoadIni(fname);
+
+	PaletteMapper mapper(palette_data.empty() ? CTABLE_255() : palette_data[0]);
+	std::string base_name = fname.substr(0, fname.size() - 4);
+	for (int i = 0; i < frames; i++)
+	{
+		LoadFrameBMP(base_name, i, mapper, dither);
+		if (trim)
+			frame_data[i].Trim(true);
+	}
+}
+
+auto ArtFile::LoadIni(const std::string &fname) -> void
 {
 	std::ifstream ctrl;
 	ctrl.open(fname);
@@ -321,74 +782,89 @@ auto ArtFile::LoadBMPS(const std::string &fname) -> void
 	}
 
 	ctrl.close();
+}
 
-	std::string base_name = fname.substr(0, fname.size() - 4);
-	int frame_num = 0;
-	for (auto &af : frame_data)
+auto ArtFile::LoadFrameBMP(const std::string &base_name, int frame, const PaletteMapper& mapper, bool dither) -> void
+{
+	std::string bmp_name = GetFrameFileName(base_name, frame, ".bmp");
+	AV_TRACE_SCOPE_DETAIL("BMP read", bmp_name.c_str());
+	ArtFrame& af = frame_data[frame];
+
+	std::ifstream src;
+	src.open(bmp_name, std::ios_base::binary);
+
+	bmpDiskHeader disk_hdr = {};
+	bmpDiskInfoHeader disk_ihdr = {};
+	src.read(reinterpret_cast<char*>(&disk_hdr), sizeof(disk_hdr));
+	src.read(reinterpret_cast<char*>(&disk_ihdr), sizeof(disk_ihdr));
+	bmpHeader file_hdr = from_disk(disk_hdr);
+	bmpInfoHeader info = from_disk(disk_ihdr);
+
+	// Rows are bottom-up in pixels, as stored by most BMPs; top-down ones have a negative height
+	const int bpp = info.biBitCount;
+	const int width = static_cast<int>(info.biWidth);
+	const int height = std::abs(static_cast<int>(info.biHeight));
+	const bool top_down = info.biHeight < 0;
+	const bool supported = info.biCompression == 0 ? (bpp == 8 || bpp == 24 || bpp == 32) : (info.biCompression == 3 && bpp == 32);
+
+	// Missing or unreadable frames stay small and empty
+	if (!src || !supported || width <= 0 || height <= 0)
 	{
-		std::ostringstream oss;
-		if (!animated)
-			oss << base_name << "_" << frame_num << ".bmp";
-		else
-			oss << base_name << "_" << (frame_num / 8) << (frame_num % 8) << ".bmp";
-		frame_num++;
+		af.SetSize(6, 6);
+		return;
+	}
 
-		std::ifstream src;
-		src.open(oss.str(), std::ios_base::binary);
+	// 8-bit: each index through the file's own palette, kept wherever it already has the ART colour
+	unsigned char remap[256];
+	if (bpp == 8)
+	{
+		int colors = info.biClrUsed > 0 && info.biClrUsed < 256 ? static_cast<int>(info.biClrUsed) : 256;
+		std::vector<COLOR_4B> table(colors);
+		src.seekg(sizeof(bmpDiskHeader) + info.biSize);
+		src.read(reinterpret_cast<char*>(table.data()), colors * sizeof(COLOR_4B));
 
-		if (src)
+		for (int i = 0; i < 256; i++)
 		{
-			src.read(reinterpret_cast<char*>(&hdr), sizeof(hdr));
-			src.read(reinterpret_cast<char*>(&ihdr), sizeof(ihdr));
-
-			CTABLE_255 ignore;
-			src.read(reinterpret_cast<char*>(&ignore), sizeof(ignore));
-
-			int offset = sizeof(hdr) + sizeof(ihdr) + sizeof(ignore);
-			unsigned char ch;
-
-			int height = ihdr.biHeight;
-			int width = ihdr.biWidth;
-			//int offbits = hdr.bfOffBits;
-
-			int stride = ((width + 3) / 4) * 4;
-
-			while (offset < static_cast<int>(hdr.bfOffBits))
-			{
-				offset++;
-				src.read(reinterpret_cast<char*>(&ch), 1);
-			}
-
-			af.SetSize(width, height);
-
-			for (int i = 0; i < height; i++)
-			{
-				for (int j = 0; j < width; j++)
-				{
-					src.read(reinterpret_cast<char*>(&ch), 1);
-					af.SetValue(j, i, ch);
-				}
-				offset = width;
-				while (offset < stride)
-				{
-					offset++;
-					src.read(reinterpret_cast<char*>(&ch), 1);
-				}
-			}
-
-			src.close();
+			remap[i] = static_cast<unsigned char>(i);
+			if (i >= colors || palette_data.empty() || !src)
+				continue;
+
+			COLOR_4B want = palette_data[0].colors[i];
+			COLOR_4B key = palette_data[0].colors[0];
+			COLOR_4B have = table[i];
+			if (have.r == want.r && have.g == want.g && have.b == want.b)
+				continue;
+			remap[i] = have.r == key.r && have.g == key.g && have.b == key.b ? 0 : mapper.Nearest(have.r, have.g, have.b);
 		}
-		else
+	}
+
+	// All rows in one read, a short file leaves the rest transparent
+	const size_t stride = ((static_cast<size_t>(width) * bpp / 8) + 3) & ~static_cast<size_t>(3);
+	bytevec data(stride * height, 0);
+	src.clear();
+	src.seekg(file_hdr.bfOffBits);
+	src.read(reinterpret_cast<char*>(data.data()), data.size());
+
+	// 32-bit BMPs often leave alpha at 0 throughout, then it means nothing
+	bool use_alpha = false;
+	if (bpp == 32)
+		for (size_t i = 3; i < data.size() && !use_alpha; i += 4)
+			use_alpha = data[i] != 0;
+
+	af.SetSize(width, height);
+	PaletteMapper::Memo memo;
+	for (int i = 0; i < height; i++)
+	{
+		const unsigned char* row = data.data() + stride * i;
+		int y = top_down ? height - 1 - i : i;
+		unsigned char* dst = af.pixels[y].data();
+		if (bpp == 8)
 		{
-			af.SetSize(6, 6);
-			for (int i = 0; i < 6; i++)
-			{
-				for (int j = 0; j < 6; j++)
-				{
-					af.SetValue(j, i, 0);
-				}
-			}
+			for (int x = 0; x < width; x++)
+				dst[x] = remap[row[x]];
 		}
+		else
+			mapper.MapRow(row, bpp / 8, use_alpha, width, y, dither, memo, dst);
 	}
 }
 
@@ -484,7 +960,32 @@ auto ArtFile::LoadHeader(std::ifstream& dst, ARTheader& h) -> void
 		LoadCOLOR(dst, h.palette_data3[i]);
 }
 
-auto ArtFile::SaveBMPS(const std::string &fname) -> void
+auto ArtFile::TrimFrames() -> size_t
+{
+	AV_TRACE_SCOPE("ArtFile::TrimFrames");
+	size_t saved = 0;
+	for (auto &af : frame_data)
+		saved += af.Trim(false);
+	return saved;
+}
+
+auto ArtFile::GetFrameRate() -> int
+{
+	// Second header dword, zero in some static art
+	return header.h0[1] > 0 ? static_cast<int>(header.h0[1]) : 10;
+}
+
+auto ArtFile::GetFrameFileName(const std::string &fname, int frame, const char* ext) -> std::string
+{
+	std::ostringstream oss;
+	if (!animated)
+		oss << fname << "_" << frame << ext;
+	else
+		oss << fname << "_" << (frame / 8) << (frame % 8) << ext;
+	return oss.str();
+}
+
+auto ArtFile::SaveIni(const std::string &fname) -> bool
 {
 	std::ostringstream gss;
 	gss << fname << ".ini";
@@ -521,24 +1022,27 @@ auto ArtFile::SaveBMPS(const std::string &fname) -> void
 	}
 
 	ctrl.close();
+	return !ctrl.fail();
+}
+
+auto ArtFile::SaveBMPS(const std::string &fname) -> void
+{
+	AV_TRACE_SCOPE_DETAIL("ArtFile::SaveBMPS", fname.c_str());
+	SaveIni(fname);
 
 	int frame_num = 0;
 	for (auto& af : frame_data)
 	{
-		std::ostringstream oss;
-		if (!animated)
-			oss << fname << "_" << frame_num << ".bmp";
-		else
-			oss << fname << "_" << (frame_num / 8) << (frame_num % 8) << ".bmp";
+		std::string bmp_name = GetFrameFileName(fname, frame_num, ".bmp");
 		frame_num++;
 
-		hdr.bfOffBits = sizeof(hdr) + sizeof(ihdr) + sizeof(CTABLE_255);
+		hdr.bfOffBits = sizeof(bmpDiskHeader) + sizeof(bmpDiskInfoHeader) + sizeof(CTABLE_255);
 		hdr.bfReserved1 = 28020;
 		hdr.bfReserved2 = 115;
 
 		int stride = ((af.GetHeader().width + 3) / 4) * 4;
 
-		hdr.bfSize = sizeof(hdr) + sizeof(ihdr) + sizeof(CTABLE_255) + af.GetHeader().height*stride - 40;
+		hdr.bfSize = hdr.bfOffBits + af.GetHeader().height * stride;
 		hdr.bfType = 19778;
 
 		ihdr.biBitCount = 8;
@@ -550,14 +1054,17 @@ auto ArtFile::SaveBMPS(const std::string &fname) -> void
 		ihdr.biSize = 40;
 		ihdr.biWidth = af.GetHeader().width;
 
+		AV_TRACE_SCOPE_DETAIL("BMP write", bmp_name.c_str());
 		std::ofstream dst;
-		dst.open(oss.str(), std::ios_base::binary);
-		dst.write(reinterpret_cast<char*>(&hdr), sizeof(hdr));
-		dst.write(reinterpret_cast<char*>(&ihdr), sizeof(ihdr));
+		dst.open(bmp_name, std::ios_base::binary);
+		bmpDiskHeader disk_hdr = to_disk(hdr);
+		bmpDiskInfoHeader disk_ihdr = to_disk(ihdr);
+		dst.write(reinterpret_cast<char*>(&disk_hdr), sizeof(disk_hdr));
+		dst.write(reinterpret_cast<char*>(&disk_ihdr), sizeof(disk_ihdr));
 
 		dst.write(reinterpret_cast<char*>(&palette_data[0]), sizeof(CTABLE_255));
 
-		int offset = sizeof(hdr) + sizeof(ihdr) + sizeof(CTABLE_255);
+		int offset = hdr.bfOffBits;
 
 		char ch = 0;
 		while (offset < static_cast<int>(hdr.bfOffBits))
@@ -586,6 +1093,42 @@ auto ArtFile::SaveBMPS(const std::string &fname) -> void
 	}
 }
 
+auto ArtFile::SavePNGS(const std::string &fname) -> void
+{
+	AV_TRACE_SCOPE_DETAIL("ArtFile::SavePNGS", fname.c_str());
+	SaveIni(fname);
+	for (int i = 0; i < static_cast<int>(frame_data.size()); i++)
+		SavePNG(fname, i);
+}
+
+auto ArtFile::GetPaletteRGB(int palette, unsigned char* rgb) -> void
+{
+	for (int i = 0; i < 256; i++)
+	{
+		unsigned char grey = static_cast<unsigned char>(i);
+		COLOR_4B c = palette < static_cast<int>(palette_data.size()) ? palette_data[palette].colors[i] : COLOR_4B{ grey, grey, grey, 0 };
+		rgb[i * 3 + 0] = c.r;
+		rgb[i * 3 + 1] = c.g;
+		rgb[i * 3 + 2] = c.b;
+	}
+}
+
+auto ArtFile::SavePNG(const std::string &fname, int frame) -> bool
+{
+	std::string png_name = GetFrameFileName(fname, frame, ".png");
+	AV_TRACE_SCOPE_DETAIL("PNG write", png_name.c_str());
+
+	unsigned char rgb[256 * 3];
+	GetPaletteRGB(0, rgb);
+
+	ArtFrame& af = frame_data[frame];
+	IndexedPNGWriter png;
+	if (!png.Open(png_name, static_cast<int>(af.header.width), static_cast<int>(af.header.height), rgb, 256, 0))
+		return false;
+	af.DecodeRows([&](const unsigned char* row) { png.WriteRow(row); });
+	return png.Close();
+}
+
 /*
 void Draw(int p_num, int f_num)
 {
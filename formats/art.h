@@ -3,10 +3,14 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 #include <fstream>
 
+struct PaletteMapper;
+
 struct MissingFile
 {
 	std::string filename;
@@ -17,7 +21,7 @@ struct COLOR_3B
 	unsigned char b, g, r, a;
 };
 
-bool in_palette(COLOR_3B col)
+inline bool in_palette(COLOR_3B col)
 {
 	return (col.a | col.b | col.g | col.r) != 0;
 }
@@ -31,6 +35,10 @@ typedef COLOR_3B COLOR_4B;
 using bytevec = std::vector<unsigned char>;
 using bytemap = std::vector<bytevec>;
 
+// Fast 64-bit hash for telling frames apart by content, not meant to stand up to crafted input.
+// Calls chain through 'seed'.
+auto hash_bytes(const void* data, size_t size, uint64_t seed = 0) -> uint64_t;
+
 struct ARTheader
 {
 	unsigned long    h0[3]; //1,8,8,WTF
@@ -55,10 +63,24 @@ struct ARTFrameHeader
 	int d_y;
 };
 
+// What a frame holds, rows counted in the order they are stored (top-down for LoadArt())
+struct FrameSummary
+{
+	int      left = 0;               // bounding box of the non-zero indices, inclusive,
+	int      top = 0;                // empty (right < left) for a fully transparent frame
+	int      right = -1;
+	int      bottom = -1;
+	uint32_t opaque = 0;             // pixels with a non-zero index
+	uint32_t histogram[256] = {};
+
+	auto IsTransparent() const -> bool { return opaque == 0; }
+	auto GetColorCount() const -> int;     // distinct non-zero indices
+};
+
 struct ArtFrame
 {
 	ARTFrameHeader header;
-	char*          data;
+	std::vector<char> data;     // header.size bytes as stored, RLE encoded or raw
 	bytemap        pixels;
 	int px, py;
 
@@ -81,6 +103,23 @@ struct ArtFrame
 
 	auto Encode() -> void;
 	auto Decode() -> void;
+	// Top to bottom, one reused row at a time: from pixels when decoded, else straight from the RLE data
+	auto DecodeRows(const std::function<void(const unsigned char* row)>& emit) -> void;
+
+	// Crops fully transparent rows and columns of the decoded pixels and moves c_x/c_y so the frame still
+	// draws at the same place. 'bottom_up' when pixels are stored as LoadBMPS leaves them. The RLE data
+	// no longer matches and is dropped, Encode() makes it again. Returns the pixel bytes saved.
+	auto Trim(bool bottom_up) -> size_t;
+
+	// Of the size and indices, the same for identical frames whether decoded or still RLE encoded
+	auto GetContentHash() -> uint64_t;
+	// Same size and indices. Frames still RLE encoded only match when their RLE data does.
+	auto IsSameContent(const ArtFrame& other) const -> bool;
+
+	// Straight from the RLE data unless already decoded, 'pixels' is never filled. A clone opcode
+	// counts as one step whatever its length; IsTransparent() stops at the first visible pixel.
+	auto Summarize() const -> FrameSummary;
+	auto IsTransparent() const -> bool;
 };
 
 struct bmpHeader
@@ -107,6 +146,73 @@ struct bmpInfoHeader
 	unsigned long  biClrImportant;
 };
 
+// On-disk layouts. The structs above are what the code works with; their unsigned long fields are
+// 8 bytes on LP64, so files are only ever read and written through these. Both formats are
+// little-endian, as is every platform the viewer runs on.
+#pragma pack(push, 1)
+struct ARTDiskHeader
+{
+	uint32_t h0[3];
+	COLOR_4B stupid_color[4];
+	uint32_t frame_num_low;
+	uint32_t frame_num;
+	COLOR_4B palette_data1[8];
+	COLOR_4B palette_data2[8];
+	COLOR_4B palette_data3[8];
+};
+
+struct ARTDiskFrameHeader
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t size;
+	int32_t  c_x;
+	int32_t  c_y;
+	int32_t  d_x;
+	int32_t  d_y;
+};
+
+struct bmpDiskHeader
+{
+	uint16_t bfType;
+	uint32_t bfSize;
+	uint16_t bfReserved1;
+	uint16_t bfReserved2;
+	uint32_t bfOffBits;
+};
+
+struct bmpDiskInfoHeader
+{
+	uint32_t biSize;
+	int32_t  biWidth;
+	int32_t  biHeight;
+	uint16_t biPlanes;
+	uint16_t biBitCount;
+	uint32_t biCompression;
+	uint32_t biSizeImage;
+	int32_t  biXPelsPerMeter;
+	int32_t  biYPelsPerMeter;
+	uint32_t biClrUsed;
+	uint32_t biClrImportant;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(COLOR_4B) == 4, "COLOR_4B must match the file layout");
+static_assert(sizeof(CTABLE_255) == 1024, "CTABLE_255 must match the file layout");
+static_assert(sizeof(ARTDiskHeader) == 132, "ARTDiskHeader must match the file layout");
+static_assert(sizeof(ARTDiskFrameHeader) == 28, "ARTDiskFrameHeader must match the file layout");
+static_assert(sizeof(bmpDiskHeader) == 14, "bmpDiskHeader must match the file layout");
+static_assert(sizeof(bmpDiskInfoHeader) == 40, "bmpDiskInfoHeader must match the file layout");
+
+auto from_disk(const ARTDiskHeader& d) -> ARTheader;
+auto from_disk(const ARTDiskFrameHeader& d) -> ARTFrameHeader;
+auto from_disk(const bmpDiskHeader& d) -> bmpHeader;
+auto from_disk(const bmpDiskInfoHeader& d) -> bmpInfoHeader;
+auto to_disk(const ARTheader& h) -> ARTDiskHeader;
+auto to_disk(const ARTFrameHeader& h) -> ARTDiskFrameHeader;
+auto to_disk(const bmpHeader& h) -> bmpDiskHeader;
+auto to_disk(const bmpInfoHeader& h) -> bmpDiskInfoHeader;
+
 struct ArtFile
 {
 	ARTheader header;
@@ -121,12 +227,29 @@ struct ArtFile
 	bmpHeader hdr;
 	bmpInfoHeader ihdr;
 
-	auto LoadArt(const std::string &fname) -> void;
-	auto SaveArt(const std::string &fname) -> void;
+	// Without 'decode' frames keep only their RLE data, for DecodeRows()
+	auto LoadArt(const std::string &fname, bool decode = true) -> void;
+	// Without 'encode' frames are written as already encoded, e.g. by the jobs that loaded them
+	auto SaveArt(const std::string &fname, bool encode = true) -> void;
 
-	auto LoadBMPS(const std::string &fname) -> void;
+	// fname.ini and the fname_N.bmp files it lists. 8-bit BMPs go through their own palette, kept as
+	// is where it matches the first palette of the .ini; 24 and 32-bit ones are quantised to that
+	// palette, optionally with ordered dithering. LoadIni() and LoadFrameBMP() are its two steps, for
+	// loading frames in parallel.
+	auto LoadBMPS(const std::string &fname, bool dither = false, bool trim = false) -> void;
+	auto LoadIni(const std::string &fname) -> void;
+	auto LoadFrameBMP(const std::string &base_name, int frame, const PaletteMapper& mapper, bool dither) -> void;
 	auto SaveBMPS(const std::string &fname) -> void;
 
+	// fname.ini plus fname_N.png, frames as 8-bit palettised PNGs in the first palette with index 0
+	// transparent. SavePNG() writes a single frame, for exporting frames in parallel.
+	auto SavePNGS(const std::string &fname) -> void;
+	auto SavePNG(const std::string &fname, int frame) -> bool;
+	auto SaveIni(const std::string &fname) -> bool;
+	auto GetFrameFileName(const std::string &fname, int frame, const char* ext) -> std::string;
+	// 3 bytes per entry as PNG wants them, a grey ramp when the file has no such palette
+	auto GetPaletteRGB(int palette, unsigned char* rgb) -> void;
+
 	auto LoadDWORD(std::ifstream& dst, unsigned long &data) -> void;
 	auto SaveDWORD(std::ofstream& dst, unsigned long data) -> void;
 	
@@ -135,4 +258,12 @@ struct ArtFile
 	
 	auto LoadHeader(std::ifstream& dst, ARTheader& h) -> void;
 	auto SaveHeader(std::ofstream& dst, ARTheader& h) -> void;
+
+	// Trim() of every frame, as loaded by LoadArt()
+	auto TrimFrames() -> size_t;
+
+	auto GetFrameRate() -> int;
+	auto GetDirections() -> int { return animated ? 8 : 1; }
+	auto GetFramesPerDirection() -> int { return frames / GetDirections(); }
+	auto GetFrameIndex(int direction, int frame) -> int { return direction * GetFramesPerDirection() + frame; }
 };
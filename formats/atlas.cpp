@@ -0,0 +1,236 @@
+/* OpenArcanum ART frame atlas packing */
+
+#include "formats/atlas.h"
+#include "formats/png.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+// imgui_draw.cpp keeps its copy of stb_rect_pack static, this one is ours
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+
+static void BuildPaletteLut(ArtFile& art, int palette, uint32_t* lut)
+{
+	for (int i = 0; i < 256; i++)
+	{
+		if (palette < static_cast<int>(art.palette_data.size()))
+		{
+			COLOR_4B c = art.palette_data[palette].colors[i];
+			lut[i] = 0xFF000000u | (c.b << 16) | (c.g << 8) | c.r;
+		}
+		else
+			lut[i] = 0xFF000000u | (i << 16) | (i << 8) | i;
+	}
+	lut[0] = 0;
+}
+
+auto ArtAtlas::Pack(ArtFile& art, int max_size, int padding) -> bool
+{
+	width = height = 0;
+	rects.clear();
+	hashes.clear();
+	duplicates = 0;
+
+	if (art.frame_data.empty())
+		return true;
+
+	// Frames that reuse an earlier one go in as empty rects and take its place afterwards
+	std::vector<int> source(art.frame_data.size(), -1);
+	std::unordered_multimap<uint64_t, int> seen;
+	hashes.resize(art.frame_data.size());
+	for (size_t i = 0; i < art.frame_data.size(); i++)
+	{
+		hashes[i] = art.frame_data[i].GetContentHash();
+		auto range = seen.equal_range(hashes[i]);
+		for (auto it = range.first; it != range.second && source[i] < 0; ++it)
+			if (art.frame_data[i].IsSameContent(art.frame_data[it->second]))
+				source[i] = it->second;
+		if (source[i] < 0)
+			seen.emplace(hashes[i], static_cast<int>(i));
+		else
+			duplicates++;
+	}
+
+	std::vector<stbrp_rect> packed(art.frame_data.size());
+	long long area = 0;
+	int widest = 0;
+	for (size_t i = 0; i < art.frame_data.size(); i++)
+	{
+		ARTFrameHeader& fh = art.frame_data[i].GetHeader();
+		bool unique = source[i] < 0;
+		packed[i].id = static_cast<int>(i);
+		packed[i].w = static_cast<stbrp_coord>(unique ? fh.width + padding : 0);
+		packed[i].h = static_cast<stbrp_coord>(unique ? fh.height + padding : 0);
+		area += static_cast<long long>(packed[i].w) * packed[i].h;
+		widest = std::max(widest, static_cast<int>(packed[i].w));
+	}
+
+	// Aim for a roughly square atlas, packing is skyline so height is whatever it takes
+	int target = static_cast<int>(std::sqrt(static_cast<double>(area)) * 1.1) + 1;
+	target = std::min(std::max(target, widest), max_size);
+
+	std::vector<stbrp_node> nodes(target);
+	stbrp_context ctx;
+	stbrp_init_target(&ctx, target, max_size, nodes.data(), static_cast<int>(nodes.size()));
+	stbrp_pack_rects(&ctx, packed.data(), static_cast<int>(packed.size()));
+
+	rects.resize(packed.size());
+	for (auto& r : packed)
+	{
+		if (!r.was_packed)
+		{
+			rects.clear();
+			return false;
+		}
+
+		if (source[r.id] >= 0)
+			continue;
+		rects[r.id] = { r.x, r.y, r.w - padding, r.h - padding };
+		width = std::max(width, static_cast<int>(r.x + r.w));
+		height = std::max(height, static_cast<int>(r.y + r.h));
+	}
+	for (size_t i = 0; i < rects.size(); i++)
+		if (source[i] >= 0)
+			rects[i] = rects[source[i]];
+
+	return true;
+}
+
+auto ArtAtlas::GetContentHash() const -> uint64_t
+{
+	const int32_t size[2] = { width, height };
+	uint64_t h = hash_bytes(size, sizeof(size));
+	for (size_t i = 0; i < rects.size(); i++)
+	{
+		h = hash_bytes(&rects[i], sizeof(AtlasRect), h);
+		h = hash_bytes(&hashes[i], sizeof(uint64_t), h);
+	}
+	return h;
+}
+
+auto ArtAtlas::BuildRGBA(ArtFile& art, int palette) -> std::vector<uint32_t>
+{
+	uint32_t lut[256];
+	BuildPaletteLut(art, palette, lut);
+
+	std::vector<uint32_t> image(static_cast<size_t>(width) * height, 0);
+	for (size_t f = 0; f < rects.size(); f++)
+	{
+		const AtlasRect& r = rects[f];
+		ArtFrame& af = art.frame_data[f];
+		for (int y = 0; y < r.h; y++)
+		{
+			uint32_t* dst = &image[static_cast<size_t>(r.y + y) * width + r.x];
+			const bytevec& row = af.pixels[y];
+			for (int x = 0; x < r.w; x++)
+				dst[x] = lut[row[x]];
+		}
+	}
+
+	return image;
+}
+
+auto ArtAtlas::BuildIndexed(ArtFile& art) -> bytevec
+{
+	bytevec image(static_cast<size_t>(width) * height, 0);
+	for (size_t f = 0; f < rects.size(); f++)
+	{
+		const AtlasRect& r = rects[f];
+		ArtFrame& af = art.frame_data[f];
+		for (int y = 0; y < r.h; y++)
+			std::copy(af.pixels[y].begin(), af.pixels[y].begin() + r.w, image.begin() + static_cast<size_t>(r.y + y) * width + r.x);
+	}
+
+	return image;
+}
+
+auto ArtAtlas::BuildPalettes(ArtFile& art) -> std::vector<uint32_t>
+{
+	int rows = std::max(1, static_cast<int>(art.palette_data.size()));
+	std::vector<uint32_t> table(static_cast<size_t>(rows) * 256);
+	for (int p = 0; p < rows; p++)
+		BuildPaletteLut(art, p, &table[static_cast<size_t>(p) * 256]);
+
+	return table;
+}
+
+static auto JsonString(const std::string& str) -> std::string
+{
+	std::string out = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out + "\"";
+}
+
+auto ArtAtlas::SaveSheet(ArtFile& art, const std::string& fname, std::vector<std::string>& files) -> bool
+{
+	AV_TRACE_SCOPE_DETAIL("ArtAtlas::SaveSheet", fname.c_str());
+
+	// Smallest square limit the frames fit in, engines take 16K textures but rarely more
+	bool packed = false;
+	for (int max_size : { 4096, 8192, 16384 })
+		if ((packed = Pack(art, max_size)))
+			break;
+	if (!packed || width == 0 || height == 0)
+		return false;
+
+	// Every palette indexes the same pixels, so they are compressed once
+	bytevec image = BuildIndexed(art);
+	std::vector<uint8_t> compressed = CompressIndexed(width, height, image.data());
+
+	std::string base = fname.substr(fname.find_last_of("/\\") + 1);
+	std::vector<std::string> images;
+	int palettes = std::max(1, static_cast<int>(art.palette_data.size()));
+	for (int p = 0; p < palettes; p++)
+	{
+		std::string name = fname + "_p" + std::to_string(p) + ".png";
+		unsigned char rgb[256 * 3];
+		art.GetPaletteRGB(p, rgb);
+		if (!SaveIndexedPNG(name, width, height, rgb, 256, 0, compressed))
+			return false;
+		files.push_back(name);
+		images.push_back(base + "_p" + std::to_string(p) + ".png");
+	}
+
+	std::ostringstream json;
+	json << "{\n\t\"images\": [";
+	for (size_t i = 0; i < images.size(); i++)
+		json << (i > 0 ? ", " : "") << JsonString(images[i]);
+	json << "],\n";
+	json << "\t\"width\": " << width << ",\n";
+	json << "\t\"height\": " << height << ",\n";
+	json << "\t\"directions\": " << art.GetDirections() << ",\n";
+	json << "\t\"frames_per_direction\": " << art.GetFramesPerDirection() << ",\n";
+	json << "\t\"frame_rate\": " << art.GetFrameRate() << ",\n";
+	json << "\t\"key_frame\": " << art.key_frame << ",\n";
+	json << "\t\"frames\": [\n";
+	for (size_t f = 0; f < rects.size(); f++)
+	{
+		const AtlasRect& r = rects[f];
+		const ARTFrameHeader& fh = art.frame_data[f].header;
+		json << "\t\t{ \"x\": " << r.x << ", \"y\": " << r.y << ", \"w\": " << r.w << ", \"h\": " << r.h
+			<< ", \"c_x\": " << fh.c_x << ", \"c_y\": " << fh.c_y << ", \"d_x\": " << fh.d_x << ", \"d_y\": " << fh.d_y
+			<< " }" << (f + 1 < rects.size() ? ",\n" : "\n");
+	}
+	json << "\t]\n}\n";
+
+	std::string text = json.str();
+	std::string json_name = fname + ".json";
+	std::ofstream dst;
+	dst.open(json_name, std::ios_base::binary);
+	dst.write(text.data(), text.size());
+	if (!dst)
+		return false;
+	files.push_back(json_name);
+	return true;
+}
@@ -0,0 +1,40 @@
+/* OpenArcanum ART frame atlas packing */
+
+#pragma once
+
+#include "formats/art.h"
+
+#include <cstdint>
+
+struct AtlasRect
+{
+	int x, y, w, h;
+};
+
+// All frames of one ArtFile packed into a single image, rects are indexed like ArtFile::frame_data.
+// Identical frames are packed once and share their rect.
+struct ArtAtlas
+{
+	int width = 0;
+	int height = 0;
+	std::vector<AtlasRect> rects;
+	std::vector<uint64_t>  hashes;      // ArtFrame::GetContentHash() of every frame
+	int duplicates = 0;                 // frames that reuse the rect of an earlier one
+
+	// Of the packed image, equal for files that pack the same frames the same way, whatever their palettes
+	auto GetContentHash() const -> uint64_t;
+
+	auto Pack(ArtFile& art, int max_size, int padding = 1) -> bool;
+
+	// RGBA8 as expected by IM_COL32, index 0 stays fully transparent
+	auto BuildRGBA(ArtFile& art, int palette) -> std::vector<uint32_t>;
+	auto BuildIndexed(ArtFile& art) -> bytevec;
+
+	// Every palette of the file as one 256 wide RGBA8 row, for looking indices up on the GPU
+	static auto BuildPalettes(ArtFile& art) -> std::vector<uint32_t>;
+
+	// Sprite sheet: packs the decoded frames, then writes fname_pN.png, one palettised image per
+	// palette with index 0 transparent, and fname.json with the rects and offsets of every frame.
+	// Each file is written with a single write; their names are added to 'files'.
+	auto SaveSheet(ArtFile& art, const std::string& fname, std::vector<std::string>& files) -> bool;
+};
@@ -0,0 +1,207 @@
+/* OpenArcanum ART file comparison */
+
+#include "formats/diff.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ART_DIFF_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Byte by byte, for the chunks that differ and the end of the row
+static auto diff_bytes(const unsigned char* a, const unsigned char* b, int from, int to, int& count, int& first, int& last) -> void
+{
+	for (int x = from; x < to; x++)
+		if (a[x] != b[x])
+		{
+			if (count == 0)
+				first = x;
+			last = x;
+			count++;
+		}
+}
+
+auto diff_row(const unsigned char* a, const unsigned char* b, int width, int& first, int& last) -> int
+{
+	int count = 0;
+	int x = 0;
+#if defined(ART_DIFF_SSE2)
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF)
+			diff_bytes(a, b, x, x + 16, count, first, last);
+	}
+#else
+	for (; x + 8 <= width; x += 8)
+	{
+		uint64_t wa, wb;
+		memcpy(&wa, a + x, sizeof(wa));
+		memcpy(&wb, b + x, sizeof(wb));
+		if (wa != wb)
+			diff_bytes(a, b, x, x + 8, count, first, last);
+	}
+#endif
+	diff_bytes(a, b, x, width, count, first, last);
+	return count;
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
+template <typename T>
+static auto diff_field(std::vector<std::string>& out, const char* name, T a, T b) -> void
+{
+	if (a != b)
+		out.push_back(std::string(name) + " " + std::to_string(a) + " -> " + std::to_string(b));
+}
+
+auto diff_headers(const ArtFile& a, const ArtFile& b, ArtDiff& diff) -> void
+{
+	diff_field(diff.header, "directions", a.animated ? 8 : 1, b.animated ? 8 : 1);
+	diff_field(diff.header, "frames", a.frames, b.frames);
+	diff_field(diff.header, "key frame", a.key_frame, b.key_frame);
+	diff_field(diff.header, "frame rate", a.header.h0[1], b.header.h0[1]);
+	diff_field(diff.header, "palettes", a.palettes, b.palettes);
+
+	// Whatever else the header holds is not known well enough to be named
+	const ARTDiskHeader disk_a = to_disk(a.header);
+	const ARTDiskHeader disk_b = to_disk(b.header);
+	if (diff.header.empty() && memcmp(&disk_a, &disk_b, sizeof(ARTDiskHeader)) != 0)
+		diff.header.push_back("other header fields");
+
+	const int palettes = static_cast<int>(std::max(a.palette_data.size(), b.palette_data.size()));
+	for (int p = 0; p < palettes; p++)
+	{
+		PaletteDiff palette;
+		palette.palette = p;
+		if (p >= static_cast<int>(a.palette_data.size()) || p >= static_cast<int>(b.palette_data.size()))
+			palette.entries = 256;
+		else
+			for (int i = 0; i < 256; i++)
+				palette.entries += memcmp(&a.palette_data[p].colors[i], &b.palette_data[p].colors[i], sizeof(COLOR_4B)) != 0;
+		if (palette.entries > 0)
+			diff.palettes.push_back(palette);
+	}
+}
+
+auto diff_frame_header(const ARTFrameHeader& a, const ARTFrameHeader& b, FrameDiff& diff) -> bool
+{
+	diff.moved = a.c_x != b.c_x || a.c_y != b.c_y || a.d_x != b.d_x || a.d_y != b.d_y;
+	if (a.width == b.width && a.height == b.height)
+		return true;
+
+	diff.resized = true;
+	diff.left = 0;
+	diff.top = 0;
+	diff.right = static_cast<int>(std::max(a.width, b.width)) - 1;
+	diff.bottom = static_cast<int>(std::max(a.height, b.height)) - 1;
+	return false;
+}
+
+auto diff_frame_pixels(int width, int height, const std::function<const unsigned char*(int y)>& row_a,
+	const std::function<const unsigned char*(int y)>& row_b, FrameDiff& diff) -> void
+{
+	for (int y = 0; y < height; y++)
+	{
+		int first = 0, last = 0;
+		const int count = diff_row(row_a(y), row_b(y), width, first, last);
+		if (count == 0)
+			continue;
+
+		if (!diff.HasPixelChanges())
+		{
+			diff.left = first;
+			diff.right = last;
+			diff.top = y;
+		}
+		diff.left = std::min(diff.left, first);
+		diff.right = std::max(diff.right, last);
+		diff.bottom = y;
+		diff.changed += count;
+	}
+}
+
+auto diff_art(const ArtFile& a, const ArtFile& b, const std::function<bool(int frame)>& same_pixels,
+	const FrameRows& rows_a, const FrameRows& rows_b) -> ArtDiff
+{
+	AV_TRACE_SCOPE("diff_art");
+	ArtDiff diff;
+	diff_headers(a, b, diff);
+
+	const int frames = static_cast<int>(std::max(a.frame_data.size(), b.frame_data.size()));
+	for (int i = 0; i < frames; i++)
+	{
+		FrameDiff frame;
+		frame.frame = i;
+
+		// A frame only one file has is all change
+		const bool in_a = i < static_cast<int>(a.frame_data.size());
+		const bool in_b = i < static_cast<int>(b.frame_data.size());
+		if (!in_a || !in_b)
+		{
+			const ARTFrameHeader& fh = in_a ? a.frame_data[i].header : b.frame_data[i].header;
+			frame.added = !in_a;
+			frame.removed = !in_b;
+			frame.right = static_cast<int>(fh.width) - 1;
+			frame.bottom = static_cast<int>(fh.height) - 1;
+			frame.changed = static_cast<uint32_t>(fh.width * fh.height);
+			diff.frames.push_back(frame);
+			continue;
+		}
+
+		const ARTFrameHeader& fh = a.frame_data[i].header;
+		if (diff_frame_header(fh, b.frame_data[i].header, frame) && !same_pixels(i))
+			diff_frame_pixels(static_cast<int>(fh.width), static_cast<int>(fh.height),
+				[&](int y) { return rows_a(i, y); }, [&](int y) { return rows_b(i, y); }, frame);
+
+		if (frame.moved || frame.resized || frame.HasPixelChanges())
+			diff.frames.push_back(frame);
+		else
+			diff.same_frames++;
+	}
+	return diff;
+}
+
+// Frames of a file loaded without decoding, each decoded when its first row is asked for and dropped
+// again once another frame is; those decoded at load are left as they are
+struct DecodedFrames
+{
+	explicit DecodedFrames(ArtFile& art) : art(art) {}
+	~DecodedFrames() { Drop(); }
+
+	auto Row(int frame, int y) -> const unsigned char*
+	{
+		ArtFrame& af = art.frame_data[frame];
+		if (frame != decoded && af.pixels.empty())
+		{
+			Drop();
+			af.Decode();
+			decoded = frame;
+		}
+		return af.pixels[y].data();
+	}
+
+private:
+	auto Drop() -> void
+	{
+		if (decoded >= 0)
+			bytemap().swap(art.frame_data[decoded].pixels);
+		decoded = -1;
+	}
+
+	ArtFile& art;
+	int      decoded = -1;
+};
+
+auto diff_art(ArtFile& a, ArtFile& b) -> ArtDiff
+{
+	// Another encoding of the same pixels comes out without changes
+	DecodedFrames decoded_a(a), decoded_b(b);
+	return diff_art(a, b, [&](int i) { return a.frame_data[i].IsSameContent(b.frame_data[i]); },
+		[&](int i, int y) { return decoded_a.Row(i, y); }, [&](int i, int y) { return decoded_b.Row(i, y); });
+}
@@ -0,0 +1,66 @@
+/* OpenArcanum ART file comparison */
+
+#pragma once
+
+#include "formats/art.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Columns where two rows of 'width' indices differ: how many, the first and last of them in 'first'
+// and 'last', left alone when there are none. 16 columns at a time with SSE2, 8 without.
+auto diff_row(const unsigned char* a, const unsigned char* b, int width, int& first, int& last) -> int;
+
+// How a frame of the second file differs from the same frame of the first
+struct FrameDiff
+{
+	int      frame = 0;
+	bool     added = false;       // only the second file has it
+	bool     removed = false;     // only the first one does
+	bool     resized = false;     // pixels are not compared, the box covers both sizes
+	bool     moved = false;       // c_x, c_y, d_x or d_y differ
+	int      left = 0;            // changed pixels, top-down and inclusive,
+	int      top = 0;             // empty (right < left) when only the header changed
+	int      right = -1;
+	int      bottom = -1;
+	uint32_t changed = 0;
+
+	auto HasPixelChanges() const -> bool { return right >= left; }
+};
+
+struct PaletteDiff
+{
+	int palette = 0;
+	int entries = 0;     // that differ, all 256 when only one file has the palette
+};
+
+struct ArtDiff
+{
+	std::vector<std::string> header;       // "frame rate 10 -> 12", one per field that differs
+	std::vector<PaletteDiff> palettes;
+	std::vector<FrameDiff>   frames;       // only those that differ
+	int                      same_frames = 0;
+
+	auto IsSame() const -> bool { return header.empty() && palettes.empty() && frames.empty(); }
+};
+
+// File header fields and palettes of 'b' against those of 'a', into 'diff'
+auto diff_headers(const ArtFile& a, const ArtFile& b, ArtDiff& diff) -> void;
+// Size and offsets; false when the sizes differ, which leaves nothing to compare pixel by pixel
+auto diff_frame_header(const ARTFrameHeader& a, const ARTFrameHeader& b, FrameDiff& diff) -> bool;
+// Bounding box and count of the changed pixels of two frames of the same size, rows top-down
+auto diff_frame_pixels(int width, int height, const std::function<const unsigned char*(int y)>& row_a,
+	const std::function<const unsigned char*(int y)>& row_b, FrameDiff& diff) -> void;
+
+// Where the pixels of frame 'frame' of each file come from: 'same_pixels' says the two hold the same
+// pixels without them being looked at, the frames for which it does not are read row by row
+using FrameRows = std::function<const unsigned char*(int frame, int y)>;
+
+// Headers, palettes and every frame of 'b' against 'a', the frames through the given sources
+auto diff_art(const ArtFile& a, const ArtFile& b, const std::function<bool(int frame)>& same_pixels,
+	const FrameRows& rows_a, const FrameRows& rows_b) -> ArtDiff;
+// Frames with byte-identical RLE data, most of them in a patched file, are passed over without being
+// decoded; only the others are decoded, for the time being, and compared row by row.
+auto diff_art(ArtFile& a, ArtFile& b) -> ArtDiff;
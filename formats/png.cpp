@@ -0,0 +1,596 @@
+/* OpenArcanum PNG writing */
+
+#include "formats/png.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <queue>
+#include <vector>
+
+
+static auto Crc32(uint32_t crc, const uint8_t* data, size_t size) -> uint32_t
+{
+	struct Table
+	{
+		uint32_t entries[256];
+
+		Table()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				entries[i] = c;
+			}
+		}
+	};
+	static const Table table;
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static auto PutBE32(std::vector<uint8_t>& out, uint32_t v) -> void
+{
+	out.push_back(static_cast<uint8_t>(v >> 24));
+	out.push_back(static_cast<uint8_t>(v >> 16));
+	out.push_back(static_cast<uint8_t>(v >> 8));
+	out.push_back(static_cast<uint8_t>(v));
+}
+
+static auto AppendChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) -> void
+{
+	size_t start = out.size();
+	PutBE32(out, static_cast<uint32_t>(data.size()));
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	PutBE32(out, Crc32(0, out.data() + start + 4, out.size() - start - 4));
+}
+
+static auto WriteChunk(std::ofstream& dst, const char* type, const std::vector<uint8_t>& data) -> void
+{
+	std::vector<uint8_t> chunk;
+	chunk.reserve(data.size() + 12);
+	AppendChunk(chunk, type, data);
+	dst.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+// Signature, IHDR, PLTE and tRNS of a palettised image
+static auto AppendIndexedHeader(std::vector<uint8_t>& out, int width, int height, const uint8_t* rgb, int colors, int transparent) -> void
+{
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.insert(out.end(), signature, signature + sizeof(signature));
+
+	std::vector<uint8_t> ihdr;
+	PutBE32(ihdr, static_cast<uint32_t>(width));
+	PutBE32(ihdr, static_cast<uint32_t>(height));
+	ihdr.push_back(8);      // bit depth
+	ihdr.push_back(3);      // palette
+	ihdr.push_back(0);      // deflate
+	ihdr.push_back(0);      // adaptive filtering
+	ihdr.push_back(0);      // no interlace
+	AppendChunk(out, "IHDR", ihdr);
+
+	AppendChunk(out, "PLTE", std::vector<uint8_t>(rgb, rgb + colors * 3));
+
+	// Alpha of the entries up to the transparent one, the rest are opaque
+	if (transparent >= 0 && transparent < colors)
+	{
+		std::vector<uint8_t> trns(transparent + 1, 255);
+		trns[transparent] = 0;
+		AppendChunk(out, "tRNS", trns);
+	}
+}
+
+auto SavePNG(const std::string& fname, int width, int height, const uint32_t* pixels) -> bool
+{
+	if (width <= 0 || height <= 0)
+		return false;
+
+	std::ofstream dst;
+	dst.open(fname, std::ios_base::binary);
+	if (!dst)
+		return false;
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	dst.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+	std::vector<uint8_t> ihdr;
+	PutBE32(ihdr, static_cast<uint32_t>(width));
+	PutBE32(ihdr, static_cast<uint32_t>(height));
+	ihdr.push_back(8);      // bit depth
+	ihdr.push_back(6);      // RGBA
+	ihdr.push_back(0);      // deflate
+	ihdr.push_back(0);      // adaptive filtering
+	ihdr.push_back(0);      // no interlace
+	WriteChunk(dst, "IHDR", ihdr);
+
+	// Every row is prefixed with filter type 0
+	const size_t row_size = static_cast<size_t>(width) * 4 + 1;
+	std::vector<uint8_t> raw(row_size * height);
+	for (int y = 0; y < height; y++)
+	{
+		uint8_t* row = raw.data() + row_size * y;
+		row[0] = 0;
+		const uint32_t* src = pixels + static_cast<size_t>(width) * y;
+		for (int x = 0; x < width; x++)
+		{
+			row[1 + x * 4 + 0] = static_cast<uint8_t>(src[x]);
+			row[1 + x * 4 + 1] = static_cast<uint8_t>(src[x] >> 8);
+			row[1 + x * 4 + 2] = static_cast<uint8_t>(src[x] >> 16);
+			row[1 + x * 4 + 3] = static_cast<uint8_t>(src[x] >> 24);
+		}
+	}
+
+	// zlib stream: header, stored blocks of at most 65535 bytes, Adler-32 of the raw data
+	std::vector<uint8_t> idat;
+	idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+
+	uint32_t a = 1, b = 0;
+	size_t offset = 0;
+	do
+	{
+		size_t len = std::min<size_t>(65535, raw.size() - offset);
+		bool last = offset + len == raw.size();
+		idat.push_back(last ? 1 : 0);
+		idat.push_back(static_cast<uint8_t>(len));
+		idat.push_back(static_cast<uint8_t>(len >> 8));
+		idat.push_back(static_cast<uint8_t>(~len));
+		idat.push_back(static_cast<uint8_t>(~len >> 8));
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + len);
+
+		for (size_t i = offset; i < offset + len; i++)
+		{
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		offset += len;
+	} while (offset < raw.size());
+	PutBE32(idat, (b << 16) | a);
+	WriteChunk(dst, "IDAT", idat);
+
+	WriteChunk(dst, "IEND", {});
+
+	return static_cast<bool>(dst);
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
+static const int HashBits = 15;
+static const int MaxChain = 128;
+static const int LiteralCodes = 286;
+static const int DistanceCodes = 30;
+
+static const uint16_t LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// 258 has a code of its own, 285; 284 with all its extra bits set would say the same but is invalid
+static auto LengthCode(int length) -> int
+{
+	return static_cast<int>(std::upper_bound(LengthBase, LengthBase + 29, length) - LengthBase) - 1;
+}
+
+static auto DistanceCode(int distance) -> int
+{
+	return static_cast<int>(std::upper_bound(DistanceBase, DistanceBase + 30, distance) - DistanceBase) - 1;
+}
+
+// Huffman code lengths of at most 'limit' bits. Frequencies are halved until the tree fits, and every
+// alphabet gets at least two codes so that decoders never see an incomplete code.
+static auto BuildLengths(std::vector<uint32_t> freq, int limit, uint8_t* lengths) -> void
+{
+	const int n = static_cast<int>(freq.size());
+	for (int i = 0, used = static_cast<int>(std::count_if(freq.begin(), freq.end(), [](uint32_t f) { return f > 0; })); used < 2; i++)
+		if (freq[i] == 0)
+		{
+			freq[i] = 1;
+			used++;
+		}
+
+	while (true)
+	{
+		using Node = std::pair<uint64_t, int>;
+		std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+		std::vector<int> parent(n, -1);
+		for (int i = 0; i < n; i++)
+			if (freq[i] > 0)
+				queue.push({ freq[i], i });
+		while (queue.size() > 1)
+		{
+			Node a = queue.top(); queue.pop();
+			Node b = queue.top(); queue.pop();
+			parent[a.second] = parent[b.second] = static_cast<int>(parent.size());
+			parent.push_back(-1);
+			queue.push({ a.first + b.first, static_cast<int>(parent.size()) - 1 });
+		}
+
+		int longest = 0;
+		for (int i = 0; i < n; i++)
+		{
+			int depth = 0;
+			if (freq[i] > 0)
+				for (int node = i; parent[node] >= 0; node = parent[node])
+					depth++;
+			lengths[i] = static_cast<uint8_t>(depth);
+			longest = std::max(longest, depth);
+		}
+		if (longest <= limit)
+			return;
+
+		for (auto& f : freq)
+			if (f > 0)
+				f = std::max<uint32_t>(f >> 1, 1);
+	}
+}
+
+// Canonical codes from lengths, bit-reversed since deflate sends Huffman codes starting from the top bit
+static auto BuildCodes(const uint8_t* lengths, int n, uint16_t* codes) -> void
+{
+	int count[16] = {};
+	for (int i = 0; i < n; i++)
+		count[lengths[i]]++;
+	count[0] = 0;
+
+	int next[16] = {};
+	for (int bits = 1, code = 0; bits < 16; bits++)
+	{
+		code = (code + count[bits - 1]) << 1;
+		next[bits] = code;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		int len = lengths[i];
+		int code = len > 0 ? next[len]++ : 0;
+		int reversed = 0;
+		for (int b = 0; b < len; b++)
+			reversed |= ((code >> b) & 1) << (len - 1 - b);
+		codes[i] = static_cast<uint16_t>(reversed);
+	}
+}
+
+Deflater::Deflater()
+	: head(static_cast<size_t>(1) << HashBits, -1)
+	, prev(WindowSize, -1)
+{
+	// zlib header: deflate with a 32 KB window, default compression
+	output.push_back(0x78);
+	output.push_back(0x9C);
+	symbols.reserve(BlockSymbols);
+}
+
+auto Deflater::Write(const uint8_t* data, size_t size) -> void
+{
+	// Adler-32 sums can go 5552 bytes before they need reducing
+	for (size_t offset = 0; offset < size; offset += 5552)
+	{
+		size_t count = std::min<size_t>(5552, size - offset);
+		for (size_t i = 0; i < count; i++)
+		{
+			adler_a += data[offset + i];
+			adler_b += adler_a;
+		}
+		adler_a %= 65521;
+		adler_b %= 65521;
+	}
+
+	window.insert(window.end(), data, data + size);
+	end += size;
+	Compress(false);
+}
+
+auto Deflater::Finish() -> void
+{
+	Compress(true);
+	EmitBlock(true);
+	if (bit_count > 0)
+		PutBits(0, 8 - bit_count);
+
+	uint32_t adler = (adler_b << 16) | adler_a;
+	for (int shift = 24; shift >= 0; shift -= 8)
+		output.push_back(static_cast<uint8_t>(adler >> shift));
+}
+
+auto Deflater::InsertHash(size_t at) -> void
+{
+	if (at + 2 >= end)
+		return;
+	const uint8_t* p = window.data() + (at - window_start);
+	size_t h = ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << HashBits) - 1);
+	prev[at & (WindowSize - 1)] = head[h];
+	head[h] = static_cast<int64_t>(at);
+}
+
+auto Deflater::Compress(bool flush) -> void
+{
+	// Without a flush a full match length stays buffered, so matches are never cut short by a row end
+	size_t limit = flush ? end : (end > MaxMatch ? end - MaxMatch : 0);
+	while (pos < limit)
+	{
+		const uint8_t* cur = window.data() + (pos - window_start);
+		int avail = static_cast<int>(std::min<size_t>(MaxMatch, end - pos));
+		int best_len = 0;
+		int best_dist = 0;
+		if (avail >= 3)
+		{
+			size_t h = ((cur[0] << 10) ^ (cur[1] << 5) ^ cur[2]) & ((1 << HashBits) - 1);
+			int64_t cand = head[h];
+			for (int chain = MaxChain; cand >= 0 && pos - cand <= WindowSize && chain > 0; chain--)
+			{
+				const uint8_t* match = window.data() + (cand - window_start);
+				if (match[best_len] == cur[best_len])
+				{
+					int len = 0;
+					while (len < avail && match[len] == cur[len])
+						len++;
+					if (len > best_len)
+					{
+						best_len = len;
+						best_dist = static_cast<int>(pos - cand);
+						if (len == avail)
+							break;
+					}
+				}
+
+				// Entries older than the window have been overwritten by newer positions
+				int64_t next = prev[cand & (WindowSize - 1)];
+				if (next >= cand)
+					break;
+				cand = next;
+			}
+		}
+
+		if (best_len >= 3)
+		{
+			symbols.push_back((static_cast<uint32_t>(best_len) << 16) | static_cast<uint32_t>(best_dist));
+			for (int i = 0; i < best_len; i++)
+				InsertHash(pos + i);
+			pos += best_len;
+		}
+		else
+		{
+			symbols.push_back(*cur);
+			InsertHash(pos);
+			pos++;
+		}
+
+		if (symbols.size() >= BlockSymbols)
+			EmitBlock(false);
+	}
+
+	// Keep one window of history behind the current position
+	if (pos - window_start > 2 * static_cast<size_t>(WindowSize))
+	{
+		size_t drop = pos - WindowSize - window_start;
+		window.erase(window.begin(), window.begin() + drop);
+		window_start += drop;
+	}
+}
+
+auto Deflater::PutBits(uint32_t bits, int count) -> void
+{
+	bit_buffer |= bits << bit_count;
+	bit_count += count;
+	while (bit_count >= 8)
+	{
+		output.push_back(static_cast<uint8_t>(bit_buffer));
+		bit_buffer >>= 8;
+		bit_count -= 8;
+	}
+}
+
+auto Deflater::EmitBlock(bool last) -> void
+{
+	std::vector<uint32_t> lit_freq(LiteralCodes), dist_freq(DistanceCodes);
+	for (uint32_t s : symbols)
+	{
+		if (s < 256)
+			lit_freq[s]++;
+		else
+		{
+			lit_freq[257 + LengthCode(s >> 16)]++;
+			dist_freq[DistanceCode(s & 0xFFFF)]++;
+		}
+	}
+	lit_freq[256]++;
+
+	uint8_t lengths[LiteralCodes + DistanceCodes];
+	uint8_t* lit_len = lengths;
+	uint8_t* dist_len = lengths + LiteralCodes;
+	BuildLengths(lit_freq, 15, lit_len);
+	BuildLengths(dist_freq, 15, dist_len);
+
+	int hlit = LiteralCodes;
+	while (hlit > 257 && lit_len[hlit - 1] == 0)
+		hlit--;
+	int hdist = DistanceCodes;
+	while (hdist > 1 && dist_len[hdist - 1] == 0)
+		hdist--;
+
+	// Both length tables as one sequence, runs coded with 16 (repeat previous), 17 and 18 (zeros)
+	std::vector<uint8_t> all(lit_len, lit_len + hlit);
+	all.insert(all.end(), dist_len, dist_len + hdist);
+	std::vector<std::pair<int, int>> cl;
+	for (size_t i = 0; i < all.size();)
+	{
+		uint8_t v = all[i];
+		size_t run = 1;
+		while (i + run < all.size() && all[i + run] == v)
+			run++;
+		i += run;
+
+		size_t left = run;
+		if (v == 0)
+		{
+			while (left >= 11)
+			{
+				size_t r = std::min<size_t>(left, 138);
+				cl.push_back({ 18, static_cast<int>(r - 11) });
+				left -= r;
+			}
+			if (left >= 3)
+			{
+				cl.push_back({ 17, static_cast<int>(left - 3) });
+				left = 0;
+			}
+		}
+		else
+		{
+			cl.push_back({ v, 0 });
+			left--;
+			while (left >= 3)
+			{
+				size_t r = std::min<size_t>(left, 6);
+				cl.push_back({ 16, static_cast<int>(r - 3) });
+				left -= r;
+			}
+		}
+		while (left-- > 0)
+			cl.push_back({ v, 0 });
+	}
+
+	std::vector<uint32_t> cl_freq(19);
+	for (auto& c : cl)
+		cl_freq[c.first]++;
+	uint8_t cl_len[19];
+	uint16_t cl_codes[19];
+	BuildLengths(cl_freq, 7, cl_len);
+	BuildCodes(cl_len, 19, cl_codes);
+
+	int hclen = 19;
+	while (hclen > 4 && cl_len[CodeLengthOrder[hclen - 1]] == 0)
+		hclen--;
+
+	uint16_t lit_codes[LiteralCodes], dist_codes[DistanceCodes];
+	BuildCodes(lit_len, LiteralCodes, lit_codes);
+	BuildCodes(dist_len, DistanceCodes, dist_codes);
+
+	PutBits(last ? 1 : 0, 1);
+	PutBits(2, 2);
+	PutBits(hlit - 257, 5);
+	PutBits(hdist - 1, 5);
+	PutBits(hclen - 4, 4);
+	for (int i = 0; i < hclen; i++)
+		PutBits(cl_len[CodeLengthOrder[i]], 3);
+	for (auto& c : cl)
+	{
+		PutBits(cl_codes[c.first], cl_len[c.first]);
+		if (c.first == 16)
+			PutBits(c.second, 2);
+		else if (c.first == 17)
+			PutBits(c.second, 3);
+		else if (c.first == 18)
+			PutBits(c.second, 7);
+	}
+
+	for (uint32_t s : symbols)
+	{
+		if (s < 256)
+		{
+			PutBits(lit_codes[s], lit_len[s]);
+			continue;
+		}
+
+		int len = s >> 16, dist = s & 0xFFFF;
+		int lc = LengthCode(len), dc = DistanceCode(dist);
+		PutBits(lit_codes[257 + lc], lit_len[257 + lc]);
+		PutBits(len - LengthBase[lc], LengthExtra[lc]);
+		PutBits(dist_codes[dc], dist_len[dc]);
+		PutBits(dist - DistanceBase[dc], DistanceExtra[dc]);
+	}
+	PutBits(lit_codes[256], lit_len[256]);
+
+	symbols.clear();
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
+auto IndexedPNGWriter::Open(const std::string& fname, int image_width, int height, const uint8_t* rgb, int colors, int transparent) -> bool
+{
+	if (image_width <= 0 || height <= 0 || colors <= 0 || colors > 256)
+		return false;
+
+	dst.open(fname, std::ios_base::binary);
+	if (!dst)
+		return false;
+
+	std::vector<uint8_t> header;
+	AppendIndexedHeader(header, image_width, height, rgb, colors, transparent);
+	dst.write(reinterpret_cast<const char*>(header.data()), header.size());
+
+	width = image_width;
+	row.assign(static_cast<size_t>(width) + 1, 0);
+	deflater = Deflater();
+	return static_cast<bool>(dst);
+}
+
+auto IndexedPNGWriter::WriteRow(const uint8_t* indices) -> void
+{
+	// Filter type 0 in front of every row
+	memcpy(row.data() + 1, indices, width);
+	deflater.Write(row.data(), row.size());
+	FlushData(64 * 1024);
+}
+
+auto IndexedPNGWriter::FlushData(size_t threshold) -> void
+{
+	if (deflater.output.size() < threshold || deflater.output.empty())
+		return;
+	WriteChunk(dst, "IDAT", deflater.output);
+	deflater.output.clear();
+}
+
+auto IndexedPNGWriter::Close() -> bool
+{
+	deflater.Finish();
+	FlushData(1);
+	WriteChunk(dst, "IEND", {});
+
+	bool ok = static_cast<bool>(dst);
+	dst.close();
+	return ok;
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
+auto CompressIndexed(int width, int height, const uint8_t* indices) -> std::vector<uint8_t>
+{
+	Deflater deflater;
+	std::vector<uint8_t> row(static_cast<size_t>(width) + 1, 0);
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(row.data() + 1, indices + static_cast<size_t>(width) * y, width);
+		deflater.Write(row.data(), row.size());
+	}
+	deflater.Finish();
+	return std::move(deflater.output);
+}
+
+auto SaveIndexedPNG(const std::string& fname, int width, int height, const uint8_t* rgb, int colors, int transparent, const std::vector<uint8_t>& compressed) -> bool
+{
+	if (width <= 0 || height <= 0 || colors <= 0 || colors > 256)
+		return false;
+
+	std::vector<uint8_t> file;
+	file.reserve(compressed.size() + colors * 3 + 1024);
+	AppendIndexedHeader(file, width, height, rgb, colors, transparent);
+	AppendChunk(file, "IDAT", compressed);
+	AppendChunk(file, "IEND", {});
+
+	std::ofstream dst;
+	dst.open(fname, std::ios_base::binary);
+	dst.write(reinterpret_cast<const char*>(file.data()), file.size());
+	return static_cast<bool>(dst);
+}
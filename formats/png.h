@@ -0,0 +1,71 @@
+/* OpenArcanum PNG writing */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 8-bit RGBA, pixels in IM_COL32 byte order (R first), rows top to bottom without padding.
+// Image data goes out as stored deflate blocks: no compression, but no zlib dependency either.
+auto SavePNG(const std::string& fname, int width, int height, const uint32_t* pixels) -> bool;
+
+// zlib stream compressor fed in pieces of any size: LZ77 over a 32 KB window, each block of symbols
+// with its own Huffman code. Only the window and one block of symbols are kept, whatever the input size.
+struct Deflater
+{
+	static const int WindowSize = 32768;
+	static const int MaxMatch = 258;
+	static const int BlockSymbols = 16384;
+
+	Deflater();
+
+	auto Write(const uint8_t* data, size_t size) -> void;
+	// Flushes the last block and the Adler-32; nothing may be written afterwards
+	auto Finish() -> void;
+
+	// Compressed bytes so far, to be taken whenever convenient
+	std::vector<uint8_t> output;
+
+private:
+	auto Compress(bool flush) -> void;
+	auto InsertHash(size_t pos) -> void;
+	auto EmitBlock(bool last) -> void;
+	auto PutBits(uint32_t bits, int count) -> void;
+
+	std::vector<uint8_t>  window;        // history and lookahead, window_start is its absolute position
+	size_t                window_start = 0;
+	size_t                pos = 0;       // next absolute position to compress
+	size_t                end = 0;       // absolute position after the last byte written
+	std::vector<int64_t>  head;
+	std::vector<int64_t>  prev;
+	std::vector<uint32_t> symbols;       // literal or length << 16 | distance
+	uint32_t              adler_a = 1;
+	uint32_t              adler_b = 0;
+	uint32_t              bit_buffer = 0;
+	int                   bit_count = 0;
+};
+
+// 8-bit palettised PNG written a row at a time: rows go through the deflater as they come, so no
+// image buffer is kept. Rows are unfiltered, which is what suits palette images best anyway.
+struct IndexedPNGWriter
+{
+	// 'rgb' holds 3 bytes per palette entry; 'transparent' is the index written with alpha 0, -1 for none
+	auto Open(const std::string& fname, int width, int height, const uint8_t* rgb, int colors, int transparent) -> bool;
+	auto WriteRow(const uint8_t* indices) -> void;
+	auto Close() -> bool;
+
+private:
+	auto FlushData(size_t threshold) -> void;
+
+	std::ofstream        dst;
+	Deflater             deflater;
+	std::vector<uint8_t> row;
+	int                  width = 0;
+};
+
+// A whole indexed image deflated once, to be saved with as many palettes as needed
+auto CompressIndexed(int width, int height, const uint8_t* indices) -> std::vector<uint8_t>;
+// Palettised PNG around CompressIndexed() data, built in memory and written at once
+auto SaveIndexedPNG(const std::string& fname, int width, int height, const uint8_t* rgb, int colors, int transparent, const std::vector<uint8_t>& compressed) -> bool;
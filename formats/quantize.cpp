@@ -0,0 +1,148 @@
+/* OpenArcanum truecolor to ART palette mapping */
+
+#include "formats/quantize.h"
+
+#include <algorithm>
+#include <climits>
+
+
+static const int Bayer4[4][4] =
+{
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+static auto PackRGB(int r, int g, int b) -> uint32_t
+{
+	return (static_cast<uint32_t>(r) << 16) | (static_cast<uint32_t>(g) << 8) | static_cast<uint32_t>(b);
+}
+
+PaletteMapper::Memo::Memo()
+{
+	// No colour has the top byte set, so nothing matches until stored
+	std::fill(std::begin(keys), std::end(keys), 0xFFFFFFFFu);
+	std::fill(std::begin(values), std::end(values), 0);
+}
+
+PaletteMapper::PaletteMapper(const CTABLE_255& palette)
+	: transparent(palette.colors[0])
+{
+	// Duplicated colours keep their lowest index
+	struct Entry { int r, g, b; uint8_t index; };
+	std::vector<Entry> entries;
+	for (int i = 1; i < 256; i++)
+	{
+		const COLOR_4B& c = palette.colors[i];
+		uint32_t rgb = PackRGB(c.r, c.g, c.b);
+		if (std::none_of(entries.begin(), entries.end(), [&](const Entry& e) { return PackRGB(e.r, e.g, e.b) == rgb; }))
+		{
+			entries.push_back({ c.r, c.g, c.b, static_cast<uint8_t>(i) });
+			exact.push_back((rgb << 8) | static_cast<uint32_t>(i));
+		}
+	}
+	std::sort(exact.begin(), exact.end());
+
+	// An entry can only be nearest to some colour of a cell if its distance to the cell's box is no
+	// more than the smallest distance any entry has to the box's farthest corner
+	const int step = 256 / CellsPerSide;
+	auto axis_min = [](int v, int lo, int hi) { return v < lo ? lo - v : v > hi ? v - hi : 0; };
+	auto axis_max = [](int v, int lo, int hi) { return std::max(v - lo, hi - v); };
+
+	cell_start.reserve(CellsPerSide * CellsPerSide * CellsPerSide + 1);
+	std::vector<int> dmin(entries.size());
+	for (int cr = 0; cr < CellsPerSide; cr++)
+		for (int cg = 0; cg < CellsPerSide; cg++)
+			for (int cb = 0; cb < CellsPerSide; cb++)
+			{
+				cell_start.push_back(static_cast<int>(cand_index.size()));
+				int rlo = cr * step, glo = cg * step, blo = cb * step;
+				int rhi = rlo + step - 1, ghi = glo + step - 1, bhi = blo + step - 1;
+
+				int bound = INT_MAX;
+				for (size_t i = 0; i < entries.size(); i++)
+				{
+					const Entry& e = entries[i];
+					int dr = axis_min(e.r, rlo, rhi), dg = axis_min(e.g, glo, ghi), db = axis_min(e.b, blo, bhi);
+					dmin[i] = dr * dr + dg * dg + db * db;
+					int fr = axis_max(e.r, rlo, rhi), fg = axis_max(e.g, glo, ghi), fb = axis_max(e.b, blo, bhi);
+					bound = std::min(bound, fr * fr + fg * fg + fb * fb);
+				}
+
+				for (size_t i = 0; i < entries.size(); i++)
+					if (dmin[i] <= bound)
+					{
+						cand_r.push_back(entries[i].r);
+						cand_g.push_back(entries[i].g);
+						cand_b.push_back(entries[i].b);
+						cand_index.push_back(entries[i].index);
+					}
+			}
+	cell_start.push_back(static_cast<int>(cand_index.size()));
+}
+
+auto PaletteMapper::Nearest(int r, int g, int b) const -> unsigned char
+{
+	if (cand_index.empty())
+		return 0;
+
+	int cell = (((r >> (8 - CellBits)) * CellsPerSide) + (g >> (8 - CellBits))) * CellsPerSide + (b >> (8 - CellBits));
+	int start = cell_start[cell];
+	int count = cell_start[cell + 1] - start;
+	const int32_t* pr = cand_r.data() + start;
+	const int32_t* pg = cand_g.data() + start;
+	const int32_t* pb = cand_b.data() + start;
+
+	// Branch-free over plain arrays, so the distances vectorise; the first of equal ones wins
+	int best = 0;
+	int best_dist = INT_MAX;
+	for (int i = 0; i < count; i++)
+	{
+		int dr = pr[i] - r, dg = pg[i] - g, db = pb[i] - b;
+		int dist = dr * dr + dg * dg + db * db;
+		bool closer = dist < best_dist;
+		best_dist = closer ? dist : best_dist;
+		best = closer ? i : best;
+	}
+	return cand_index[start + best];
+}
+
+auto PaletteMapper::Lookup(uint32_t rgb, Memo& memo) const -> unsigned char
+{
+	uint32_t slot = ((rgb * 2654435761u) >> 20) & (Memo::Size - 1);
+	if (memo.keys[slot] == rgb)
+		return memo.values[slot];
+
+	unsigned char index = Nearest(rgb >> 16, (rgb >> 8) & 0xFF, rgb & 0xFF);
+	memo.keys[slot] = rgb;
+	memo.values[slot] = index;
+	return index;
+}
+
+auto PaletteMapper::MapRow(const unsigned char* src, int bytes_per_pixel, bool use_alpha, int width, int y, bool dither, Memo& memo, unsigned char* dst) const -> void
+{
+	const uint32_t key = PackRGB(transparent.r, transparent.g, transparent.b);
+	for (int x = 0; x < width; x++, src += bytes_per_pixel)
+	{
+		int b = src[0], g = src[1], r = src[2];
+		uint32_t rgb = PackRGB(r, g, b);
+		if (rgb == key || (use_alpha && src[3] < 128))
+		{
+			dst[x] = 0;
+			continue;
+		}
+
+		// Colours already in the palette stay exact, only the ones in between are dithered
+		if (dither && !std::binary_search(exact.begin(), exact.end(), rgb << 8, [](uint32_t a, uint32_t b) { return (a >> 8) < (b >> 8); }))
+		{
+			int offset = (Bayer4[y & 3][x & 3] * 2 - 15) * DitherStrength / 32;
+			r = std::min(std::max(r + offset, 0), 255);
+			g = std::min(std::max(g + offset, 0), 255);
+			b = std::min(std::max(b + offset, 0), 255);
+			rgb = PackRGB(r, g, b);
+		}
+
+		dst[x] = Lookup(rgb, memo);
+	}
+}
@@ -0,0 +1,47 @@
+/* OpenArcanum truecolor to ART palette mapping */
+
+#pragma once
+
+#include "formats/art.h"
+
+#include <cstdint>
+#include <vector>
+
+// Nearest palette entry of any RGB colour, exact in squared RGB distance. The colour cube is cut into
+// CellsPerSide^3 cells, each listing only the entries that can be nearest to some colour inside it,
+// so a lookup compares against a handful of entries instead of 255. Index 0 is transparency and is
+// never chosen for an opaque colour. Read-only once built, one mapper serves every thread.
+struct PaletteMapper
+{
+	static const int CellBits = 4;
+	static const int CellsPerSide = 1 << CellBits;
+	static const int DitherStrength = 16;     // spread of the 4x4 ordered dither, in 8-bit channel steps
+
+	// Recently mapped colours, one per calling thread
+	struct Memo
+	{
+		static const int Size = 4096;
+		uint32_t keys[Size];
+		uint8_t  values[Size];
+
+		Memo();
+	};
+
+	explicit PaletteMapper(const CTABLE_255& palette);
+
+	auto Nearest(int r, int g, int b) const -> unsigned char;
+
+	// One row of BGR (3 bytes) or BGRA (4 bytes) pixels to palette indices. The transparent colour, the
+	// one of entry 0, maps to 0, as does alpha below 128 when 'use_alpha'. With 'dither' colours that
+	// are not in the palette get a 4x4 ordered dither, 'y' picks the row of the pattern.
+	auto MapRow(const unsigned char* src, int bytes_per_pixel, bool use_alpha, int width, int y, bool dither, Memo& memo, unsigned char* dst) const -> void;
+
+private:
+	auto Lookup(uint32_t rgb, Memo& memo) const -> unsigned char;
+
+	COLOR_4B transparent;
+	std::vector<uint32_t> exact;              // sorted rgb << 8 | index of every opaque entry
+	std::vector<int>      cell_start;         // candidates of cell c are cell_start[c] .. cell_start[c + 1]
+	std::vector<int32_t>  cand_r, cand_g, cand_b;
+	std::vector<uint8_t>  cand_index;
+};
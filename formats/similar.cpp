@@ -0,0 +1,280 @@
+/* OpenArcanum perceptual frame hashes */
+
+#include "formats/similar.h"
+#include "common/Trace.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+
+static const int HashColumns = 9;
+static const int HashRows = 8;
+
+static const char SimilarIndexMagic[4] = { 'A', 'V', 'P', 'H' };
+static const uint32_t SimilarIndexVersion = 1;
+
+#pragma pack(push, 1)
+struct SimilarIndexHeader
+{
+	char     magic[4];
+	uint32_t version;
+	uint32_t file_count;
+	uint32_t frame_count;
+};
+
+struct SimilarIndexFrame
+{
+	uint64_t hash;
+	uint32_t file;
+	uint32_t frame;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SimilarIndexHeader) == 16, "SimilarIndexHeader must match the index layout");
+static_assert(sizeof(SimilarIndexFrame) == 16, "SimilarIndexFrame must match the index layout");
+
+auto perceptual_hash(int width, int height, const std::function<const unsigned char*(int y)>& row, const CTABLE_255& palette) -> uint64_t
+{
+	// Bounding box first, so margins do not move the cells
+	int left = width, right = -1, top = height, bottom = -1;
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* r = row(y);
+		int first = 0, last = width - 1;
+		while (first < width && r[first] == 0)
+			first++;
+		if (first == width)
+			continue;
+		while (r[last] == 0)
+			last--;
+		left = std::min(left, first);
+		right = std::max(right, last);
+		top = std::min(top, y);
+		bottom = y;
+	}
+	if (right < 0)
+		return 0;
+
+	// Rec. 601 luma of every entry, in 8.8 fixed point
+	uint32_t luma[256];
+	for (int i = 0; i < 256; i++)
+	{
+		const COLOR_3B& c = palette.colors[i];
+		luma[i] = i == 0 ? 0 : 77 * c.r + 150 * c.g + 29 * c.b;
+	}
+
+	const int box_width = right - left + 1;
+	const int box_height = bottom - top + 1;
+	std::vector<int> cell_of_column(box_width);
+	for (int x = 0; x < box_width; x++)
+		cell_of_column[x] = x * HashColumns / box_width;
+
+	uint64_t sum[HashRows][HashColumns] = {};
+	uint32_t count[HashRows][HashColumns] = {};
+	for (int y = 0; y < box_height; y++)
+	{
+		const unsigned char* r = row(top + y) + left;
+		const int cy = y * HashRows / box_height;
+		for (int x = 0; x < box_width; x++)
+		{
+			sum[cy][cell_of_column[x]] += luma[r[x]];
+			count[cy][cell_of_column[x]]++;
+		}
+	}
+
+	// Boxes narrower than the grid leave cells empty, those stay black
+	uint64_t hash = 0;
+	for (int cy = 0; cy < HashRows; cy++)
+		for (int cx = 0; cx + 1 < HashColumns; cx++)
+		{
+			uint64_t a = count[cy][cx] ? sum[cy][cx] / count[cy][cx] : 0;
+			uint64_t b = count[cy][cx + 1] ? sum[cy][cx + 1] / count[cy][cx + 1] : 0;
+			hash = (hash << 1) | (a > b ? 1 : 0);
+		}
+	return hash;
+}
+
+auto perceptual_hash(ArtFrame& frame, const CTABLE_255& palette) -> uint64_t
+{
+	const int width = static_cast<int>(frame.header.width);
+	const int height = static_cast<int>(frame.header.height);
+	if (width <= 0 || height <= 0)
+		return 0;
+
+	bool decoded = !frame.pixels.empty();
+	if (!decoded)
+		frame.Decode();
+	uint64_t hash = perceptual_hash(width, height, [&](int y) { return frame.pixels[y].data(); }, palette);
+	if (!decoded)
+		bytemap().swap(frame.pixels);
+	return hash;
+}
+
+auto get_hash_palette(const ArtFile& art) -> CTABLE_255
+{
+	if (!art.palette_data.empty())
+		return art.palette_data[0];
+
+	CTABLE_255 grey = {};
+	for (int i = 0; i < 256; i++)
+		grey.colors[i] = { static_cast<unsigned char>(i), static_cast<unsigned char>(i), static_cast<unsigned char>(i), 0 };
+	return grey;
+}
+
+auto hamming_distance(uint64_t a, uint64_t b) -> int
+{
+	return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
+auto SimilarityIndex::AddFile(const std::string& name) -> int
+{
+	files.push_back(name);
+	return static_cast<int>(files.size()) - 1;
+}
+
+auto SimilarityIndex::Add(uint64_t hash, int file, int frame) -> void
+{
+	Node node;
+	node.hash = hash;
+	node.file = file;
+	node.frame = frame;
+	const int32_t added = static_cast<int32_t>(nodes.size());
+	nodes.push_back(node);
+	if (added == 0)
+		return;
+
+	// Down the child at the same distance until there is none
+	int32_t at = 0;
+	while (true)
+	{
+		const int d = hamming_distance(hash, nodes[at].hash);
+		if (d == 0)
+		{
+			nodes[added].next_same = nodes[at].next_same;
+			nodes[at].next_same = added;
+			return;
+		}
+
+		int32_t child = nodes[at].first_child;
+		while (child >= 0 && nodes[child].distance != d)
+			child = nodes[child].next_sibling;
+		if (child < 0)
+		{
+			nodes[added].distance = d;
+			nodes[added].next_sibling = nodes[at].first_child;
+			nodes[at].first_child = added;
+			return;
+		}
+		at = child;
+	}
+}
+
+auto SimilarityIndex::Search(uint64_t hash, int radius) const -> std::vector<SimilarFrame>
+{
+	AV_TRACE_SCOPE("SimilarityIndex::Search");
+	std::vector<SimilarFrame> found;
+	if (nodes.empty())
+		return found;
+
+	std::vector<int32_t> pending(1, 0);
+	while (!pending.empty())
+	{
+		const int32_t at = pending.back();
+		pending.pop_back();
+
+		const int d = hamming_distance(hash, nodes[at].hash);
+		if (d <= radius)
+			for (int32_t same = at; same >= 0; same = nodes[same].next_same)
+				found.push_back({ nodes[same].file, nodes[same].frame, d });
+		for (int32_t child = nodes[at].first_child; child >= 0; child = nodes[child].next_sibling)
+			if (nodes[child].distance >= d - radius && nodes[child].distance <= d + radius)
+				pending.push_back(child);
+	}
+
+	std::sort(found.begin(), found.end(), [](const SimilarFrame& a, const SimilarFrame& b)
+	{
+		if (a.distance != b.distance)
+			return a.distance < b.distance;
+		return a.file != b.file ? a.file < b.file : a.frame < b.frame;
+	});
+	return found;
+}
+
+auto SimilarityIndex::Save(const std::string& fname) -> bool
+{
+	SimilarIndexHeader header;
+	memcpy(header.magic, SimilarIndexMagic, sizeof(header.magic));
+	header.version = SimilarIndexVersion;
+	header.file_count = static_cast<uint32_t>(files.size());
+	header.frame_count = static_cast<uint32_t>(nodes.size());
+
+	std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const Node& node : nodes)
+	{
+		SimilarIndexFrame frame = { node.hash, static_cast<uint32_t>(node.file), static_cast<uint32_t>(node.frame) };
+		image.append(reinterpret_cast<const char*>(&frame), sizeof(frame));
+	}
+	for (const auto& name : files)
+	{
+		uint32_t size = static_cast<uint32_t>(name.size());
+		image.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		image += name;
+	}
+
+	std::ofstream dest(fname, std::ios_base::binary | std::ios_base::trunc);
+	dest.write(image.data(), image.size());
+	return static_cast<bool>(dest);
+}
+
+auto SimilarityIndex::Load(const std::string& fname) -> bool
+{
+	AV_TRACE_SCOPE_DETAIL("SimilarityIndex::Load", fname.c_str());
+	files.clear();
+	nodes.clear();
+
+	std::ifstream source(fname, std::ios_base::binary);
+	SimilarIndexHeader header;
+	if (!source.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		memcmp(header.magic, SimilarIndexMagic, sizeof(header.magic)) != 0 || header.version != SimilarIndexVersion)
+		return false;
+
+	// Counts come from the file, they must fit in what is left of it before anything is allocated for them
+	const std::streamoff start = source.tellg();
+	source.seekg(0, std::ios_base::end);
+	const std::streamoff file_end = source.tellg();
+	source.seekg(start);
+	auto left = [&]() -> uint64_t { return static_cast<uint64_t>(file_end - source.tellg()); };
+
+	if (static_cast<uint64_t>(header.frame_count) * sizeof(SimilarIndexFrame) > left())
+		return false;
+	std::vector<SimilarIndexFrame> frames(header.frame_count);
+	if (!source.read(reinterpret_cast<char*>(frames.data()), frames.size() * sizeof(SimilarIndexFrame)))
+		return false;
+	for (uint32_t i = 0; i < header.file_count; i++)
+	{
+		uint32_t size = 0;
+		if (!source.read(reinterpret_cast<char*>(&size), sizeof(size)) || size > left())
+			return false;
+		std::string name(size, '\0');
+		if (!source.read(&name[0], size))
+			return false;
+		files.push_back(std::move(name));
+	}
+
+	// The tree is rebuilt rather than stored, inserting is cheap next to reading the library
+	nodes.reserve(frames.size());
+	for (const auto& frame : frames)
+	{
+		if (frame.file >= header.file_count)
+		{
+			files.clear();
+			nodes.clear();
+			return false;
+		}
+		Add(frame.hash, static_cast<int>(frame.file), static_cast<int>(frame.frame));
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+/* OpenArcanum perceptual frame hashes */
+
+#pragma once
+
+#include "formats/art.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// dHash of a frame as drawn with 'palette': the bounding box of its visible pixels is scaled down to
+// 9x8 cells of luminance, transparent pixels counting as black, and each bit says whether a cell is
+// brighter than its right neighbour. Re-exports, retouches, other margins and recolours that keep the
+// shading come out a few bits apart. 'row' gives top-down rows of 'width' indices.
+auto perceptual_hash(int width, int height, const std::function<const unsigned char*(int y)>& row, const CTABLE_255& palette) -> uint64_t;
+// Decodes the frame for the time being if it is only RLE encoded
+auto perceptual_hash(ArtFrame& frame, const CTABLE_255& palette) -> uint64_t;
+// What frames of 'art' are hashed with: its first palette, a grey ramp when it has none
+auto get_hash_palette(const ArtFile& art) -> CTABLE_255;
+
+auto hamming_distance(uint64_t a, uint64_t b) -> int;
+
+struct SimilarFrame
+{
+	int file;
+	int frame;
+	int distance;
+};
+
+// Frame hashes of a library in a BK-tree. Every node keeps its children by their distance to it, so
+// a search within 'radius' of a hash at distance d from a node only goes on into children at d - radius
+// up to d + radius. Frames with a hash already in the tree, duplicates mostly, join that node's list.
+struct SimilarityIndex
+{
+	std::vector<std::string> files;
+
+	auto AddFile(const std::string& name) -> int;
+	auto Add(uint64_t hash, int file, int frame) -> void;
+	auto GetFrameCount() const -> int { return static_cast<int>(nodes.size()); }
+
+	// Closest first
+	auto Search(uint64_t hash, int radius) const -> std::vector<SimilarFrame>;
+
+	// "AVPH" header, 16 bytes per frame, then the file names; written with a single write
+	auto Save(const std::string& fname) -> bool;
+	auto Load(const std::string& fname) -> bool;
+
+private:
+	struct Node
+	{
+		uint64_t hash;
+		int32_t  file;
+		int32_t  frame;
+		int32_t  first_child = -1;
+		int32_t  next_sibling = -1;
+		int32_t  next_same = -1;     // frames with the same hash
+		int32_t  distance = 0;       // to the parent
+	};
+
+	std::vector<Node> nodes;     // nodes[0] is the root
+};
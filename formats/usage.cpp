@@ -0,0 +1,191 @@
+/* OpenArcanum palette usage index */
+
+#include "formats/usage.h"
+#include "common/Trace.h"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char UsageIndexMagic[4] = { 'A', 'V', 'P', 'U' };
+static const uint32_t UsageIndexVersion = 1;
+
+auto PaletteUsage::FromHistogram(const uint32_t histogram[256]) -> PaletteUsage
+{
+	PaletteUsage usage;
+	for (int word = 0; word < 4; word++)
+	{
+		uint64_t bits = 0;
+		for (int i = 0; i < 64; i++)
+			bits |= static_cast<uint64_t>(histogram[word * 64 + i] != 0) << i;
+		usage.bits[word] = bits;
+	}
+	return usage;
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
+auto UsageIndexWriter::AddFile(const std::string& name, const std::vector<PaletteUsage>& file_frames) -> void
+{
+	UsageIndexFile file = {};
+	for (const PaletteUsage& usage : file_frames)
+		file.usage |= usage;
+	file.first_frame = static_cast<uint32_t>(frames.size());
+	file.frame_count = static_cast<uint32_t>(file_frames.size());
+	file.name_offset = static_cast<uint32_t>(names.size());
+	file.name_size = static_cast<uint32_t>(name.size());
+
+	files.push_back(file);
+	frames.insert(frames.end(), file_frames.begin(), file_frames.end());
+	names += name;
+}
+
+auto UsageIndexWriter::Save(const std::string& fname) -> bool
+{
+	UsageIndexHeader header;
+	memcpy(header.magic, UsageIndexMagic, sizeof(header.magic));
+	header.version = UsageIndexVersion;
+	header.file_count = static_cast<uint32_t>(files.size());
+	header.frame_count = static_cast<uint32_t>(frames.size());
+	header.names_offset = sizeof(header) + files.size() * sizeof(UsageIndexFile) + frames.size() * sizeof(PaletteUsage);
+
+	std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+	image.append(reinterpret_cast<const char*>(files.data()), files.size() * sizeof(UsageIndexFile));
+	image.append(reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(PaletteUsage));
+	image += names;
+
+	std::ofstream dest(fname, std::ios_base::binary | std::ios_base::trunc);
+	dest.write(image.data(), image.size());
+	return static_cast<bool>(dest);
+}
+
+//-----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+
+UsageIndex::~UsageIndex()
+{
+	Close();
+}
+
+auto UsageIndex::Open(const std::string& fname) -> bool
+{
+	AV_TRACE_SCOPE_DETAIL("UsageIndex::Open", fname.c_str());
+	Close();
+
+#if defined(_WIN32)
+	file_handle = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = nullptr;
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+	map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	mapping = map_handle ? MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	size = static_cast<size_t>(st.st_size);
+	mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED)
+		mapping = nullptr;
+	close(fd);
+#endif
+	if (mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	// Everything a query touches is checked once here
+	const char* base = static_cast<const char*>(mapping);
+	header = reinterpret_cast<const UsageIndexHeader*>(base);
+	bool valid = size >= sizeof(UsageIndexHeader) && memcmp(header->magic, UsageIndexMagic, sizeof(UsageIndexMagic)) == 0 &&
+		header->version == UsageIndexVersion &&
+		header->names_offset == sizeof(UsageIndexHeader) + static_cast<uint64_t>(header->file_count) * sizeof(UsageIndexFile) +
+			static_cast<uint64_t>(header->frame_count) * sizeof(PaletteUsage) &&
+		header->names_offset <= size;
+	if (valid)
+	{
+		files = reinterpret_cast<const UsageIndexFile*>(base + sizeof(UsageIndexHeader));
+		frames = reinterpret_cast<const PaletteUsage*>(files + header->file_count);
+		names = base + header->names_offset;
+		for (uint32_t i = 0; i < header->file_count && valid; i++)
+			valid = static_cast<uint64_t>(files[i].first_frame) + files[i].frame_count <= header->frame_count &&
+				header->names_offset + files[i].name_offset + files[i].name_size <= size;
+	}
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+auto UsageIndex::Close() -> void
+{
+#if defined(_WIN32)
+	if (mapping != nullptr)
+		UnmapViewOfFile(mapping);
+	if (map_handle != nullptr)
+		CloseHandle(map_handle);
+	if (file_handle != nullptr)
+		CloseHandle(file_handle);
+	map_handle = file_handle = nullptr;
+#else
+	if (mapping != nullptr)
+		munmap(mapping, size);
+#endif
+	mapping = nullptr;
+	size = 0;
+	header = nullptr;
+	files = nullptr;
+	frames = nullptr;
+	names = nullptr;
+}
+
+auto UsageIndex::GetFileName(int file) const -> std::string
+{
+	return std::string(names + files[file].name_offset, files[file].name_size);
+}
+
+auto UsageIndex::Query(const PaletteUsage& mask, const std::function<void(int file, const std::vector<int>& frames)>& match) const -> void
+{
+	std::vector<int> hits;
+	for (int f = 0; f < GetFileCount(); f++)
+	{
+		if (!files[f].usage.Intersects(mask))
+			continue;
+
+		hits.clear();
+		const PaletteUsage* frame = frames + files[f].first_frame;
+		for (uint32_t i = 0; i < files[f].frame_count; i++)
+			if (frame[i].Intersects(mask))
+				hits.push_back(static_cast<int>(i));
+		match(f, hits);
+	}
+}
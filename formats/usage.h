@@ -0,0 +1,105 @@
+/* OpenArcanum palette usage index */
+
+#pragma once
+
+#include "formats/art.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// One bit per palette index
+struct PaletteUsage
+{
+	uint64_t bits[4] = {};
+
+	auto Set(int index) -> void { bits[index >> 6] |= 1ull << (index & 63); }
+	auto Test(int index) const -> bool { return (bits[index >> 6] >> (index & 63)) & 1; }
+	auto Intersects(const PaletteUsage& other) const -> bool
+	{
+		return ((bits[0] & other.bits[0]) | (bits[1] & other.bits[1]) | (bits[2] & other.bits[2]) | (bits[3] & other.bits[3])) != 0;
+	}
+	auto operator|=(const PaletteUsage& other) -> PaletteUsage&
+	{
+		for (int i = 0; i < 4; i++)
+			bits[i] |= other.bits[i];
+		return *this;
+	}
+
+	// Indices with a non-zero count
+	static auto FromHistogram(const uint32_t histogram[256]) -> PaletteUsage;
+};
+
+static_assert(sizeof(PaletteUsage) == 32, "PaletteUsage must match the index layout");
+
+// Index file, little-endian: the header, one UsageIndexFile per file, one PaletteUsage per frame of
+// all files in order, then the file names. A file's bits are those of its frames or'ed together, so a
+// query only looks at the frames of files that can match.
+#pragma pack(push, 1)
+struct UsageIndexHeader
+{
+	char     magic[4];          // "AVPU"
+	uint32_t version;
+	uint32_t file_count;
+	uint32_t frame_count;
+	uint64_t names_offset;
+};
+
+struct UsageIndexFile
+{
+	PaletteUsage usage;
+	uint32_t     first_frame;
+	uint32_t     frame_count;
+	uint32_t     name_offset;     // from names_offset
+	uint32_t     name_size;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(UsageIndexHeader) == 24, "UsageIndexHeader must match the index layout");
+static_assert(sizeof(UsageIndexFile) == 48, "UsageIndexFile must match the index layout");
+
+struct UsageIndexWriter
+{
+	std::vector<UsageIndexFile> files;
+	std::vector<PaletteUsage>   frames;
+	std::string                 names;
+
+	auto AddFile(const std::string& name, const std::vector<PaletteUsage>& file_frames) -> void;
+	// Written with a single write
+	auto Save(const std::string& fname) -> bool;
+};
+
+// Memory-mapped index, queries read it in place
+struct UsageIndex
+{
+	UsageIndex() = default;
+	~UsageIndex();
+
+	UsageIndex(const UsageIndex&) = delete;
+	UsageIndex& operator=(const UsageIndex&) = delete;
+
+	// False when the file cannot be mapped or is not an index
+	auto Open(const std::string& fname) -> bool;
+	auto Close() -> void;
+
+	auto GetFileCount() const -> int { return header ? static_cast<int>(header->file_count) : 0; }
+	auto GetFrameCount() const -> int { return header ? static_cast<int>(header->frame_count) : 0; }
+	auto GetFileName(int file) const -> std::string;
+
+	// Calls 'match' with every file using any index of 'mask' and the frames of it that do
+	auto Query(const PaletteUsage& mask, const std::function<void(int file, const std::vector<int>& frames)>& match) const -> void;
+
+	const UsageIndexHeader* header = nullptr;
+	const UsageIndexFile*   files = nullptr;
+	const PaletteUsage*     frames = nullptr;
+	const char*             names = nullptr;
+
+private:
+	void*  mapping = nullptr;
+	size_t size = 0;
+#if defined(_WIN32)
+	void*  file_handle = nullptr;
+	void*  map_handle = nullptr;
+#endif
+};
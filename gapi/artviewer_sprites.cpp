@@ -0,0 +1,692 @@
+/* OpenArcanum instanced sprite renderer */
+
+#include "artviewer_sprites.h"
+#include "common/Trace.h"
+
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// SHADERS
+//-----------------------------------------------------------------------------
+
+// sprite.vert, SPIR-V 1.0 equivalent of:
+/*
+#version 450 core
+layout(push_constant) uniform uPushConstant { vec2 uScale; vec2 uTranslate; vec2 uOrigin; float uZoom; } pc;
+
+struct Sprite { vec4 rect; vec2 pos; float palette; uint tint; };
+layout(std430, set = 0, binding = 0) readonly buffer Sprites { Sprite sprites[]; };
+
+out gl_PerVertex { vec4 gl_Position; };
+layout(location = 0) out vec4 Color;
+layout(location = 1) out vec2 UV;
+layout(location = 2) flat out float Palette;
+
+void main()
+{
+    // 4 vertex triangle strip, no vertex buffer
+    Sprite s = sprites[gl_InstanceIndex];
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+    vec2 local = corner * s.rect.zw;
+    Color = unpackUnorm4x8(s.tint);
+    UV = s.rect.xy + local;
+    Palette = s.palette;
+    vec2 screen = pc.uOrigin + (s.pos + local) * pc.uZoom;
+    gl_Position = vec4(screen * pc.uScale + pc.uTranslate, 0, 1);
+}
+*/
+static uint32_t __glsl_shader_sprite_vert_spv[] =
+{
+    0x07230203,0x00010000,0x00000000,0x0000004d,0x00000000,0x00020011,0x00000001,0x0006000b,
+    0x00000001,0x4c534c47,0x6474732e,0x3035342e,0x00000000,0x0003000e,0x00000000,0x00000001,
+    0x000b000f,0x00000000,0x00000002,0x6e69616d,0x00000000,0x00000003,0x00000004,0x00000005,
+    0x00000006,0x00000007,0x00000008,0x00030003,0x00000002,0x000001c2,0x00040005,0x00000002,
+    0x6e69616d,0x00000000,0x00040005,0x00000009,0x69727053,0x00006574,0x00050006,0x00000009,
+    0x00000000,0x74636572,0x00000000,0x00040006,0x00000009,0x00000001,0x00736f70,0x00050006,
+    0x00000009,0x00000002,0x656c6170,0x00657474,0x00050006,0x00000009,0x00000003,0x746e6974,
+    0x00000000,0x00040005,0x0000000a,0x69727053,0x00736574,0x00050006,0x0000000a,0x00000000,
+    0x69727073,0x00736574,0x00030005,0x0000000b,0x00000000,0x00060005,0x0000000c,0x73755075,
+    0x6e6f4368,0x6e617473,0x00000074,0x00050006,0x0000000c,0x00000000,0x61635375,0x0000656c,
+    0x00060006,0x0000000c,0x00000001,0x61725475,0x616c736e,0x00006574,0x00050006,0x0000000c,
+    0x00000002,0x69724f75,0x006e6967,0x00050006,0x0000000c,0x00000003,0x6f6f5a75,0x0000006d,
+    0x00030005,0x0000000d,0x00006370,0x00040047,0x00000003,0x0000000b,0x0000002a,0x00040047,
+    0x00000004,0x0000000b,0x0000002b,0x00040047,0x00000008,0x0000000b,0x00000000,0x00040047,
+    0x00000005,0x0000001e,0x00000000,0x00040047,0x00000006,0x0000001e,0x00000001,0x00030047,
+    0x00000007,0x0000000e,0x00040047,0x00000007,0x0000001e,0x00000002,0x00050048,0x00000009,
+    0x00000000,0x00000023,0x00000000,0x00050048,0x00000009,0x00000001,0x00000023,0x00000010,
+    0x00050048,0x00000009,0x00000002,0x00000023,0x00000018,0x00050048,0x00000009,0x00000003,
+    0x00000023,0x0000001c,0x00040047,0x0000000e,0x00000006,0x00000020,0x00040048,0x0000000a,
+    0x00000000,0x00000018,0x00050048,0x0000000a,0x00000000,0x00000023,0x00000000,0x00030047,
+    0x0000000a,0x00000003,0x00040047,0x0000000b,0x00000022,0x00000000,0x00040047,0x0000000b,
+    0x00000021,0x00000000,0x00050048,0x0000000c,0x00000000,0x00000023,0x00000000,0x00050048,
+    0x0000000c,0x00000001,0x00000023,0x00000008,0x00050048,0x0000000c,0x00000002,0x00000023,
+    0x00000010,0x00050048,0x0000000c,0x00000003,0x00000023,0x00000018,0x00030047,0x0000000c,
+    0x00000002,0x00020013,0x0000000f,0x00030021,0x00000010,0x0000000f,0x00030016,0x00000011,
+    0x00000020,0x00040015,0x00000012,0x00000020,0x00000001,0x00040015,0x00000013,0x00000020,
+    0x00000000,0x00040017,0x00000014,0x00000011,0x00000002,0x00040017,0x00000015,0x00000011,
+    0x00000004,0x0006001e,0x00000009,0x00000015,0x00000014,0x00000011,0x00000013,0x0003001d,
+    0x0000000e,0x00000009,0x0003001e,0x0000000a,0x0000000e,0x00040020,0x00000016,0x00000002,
+    0x0000000a,0x0004003b,0x00000016,0x0000000b,0x00000002,0x00040020,0x00000017,0x00000002,
+    0x00000015,0x00040020,0x00000018,0x00000002,0x00000014,0x00040020,0x00000019,0x00000002,
+    0x00000011,0x00040020,0x0000001a,0x00000002,0x00000013,0x0006001e,0x0000000c,0x00000014,
+    0x00000014,0x00000014,0x00000011,0x00040020,0x0000001b,0x00000009,0x0000000c,0x0004003b,
+    0x0000001b,0x0000000d,0x00000009,0x00040020,0x0000001c,0x00000009,0x00000014,0x00040020,
+    0x0000001d,0x00000009,0x00000011,0x00040020,0x0000001e,0x00000001,0x00000012,0x0004003b,
+    0x0000001e,0x00000003,0x00000001,0x0004003b,0x0000001e,0x00000004,0x00000001,0x00040020,
+    0x0000001f,0x00000003,0x00000015,0x00040020,0x00000020,0x00000003,0x00000014,0x00040020,
+    0x00000021,0x00000003,0x00000011,0x0004003b,0x0000001f,0x00000005,0x00000003,0x0004003b,
+    0x00000020,0x00000006,0x00000003,0x0004003b,0x00000021,0x00000007,0x00000003,0x0004003b,
+    0x0000001f,0x00000008,0x00000003,0x0004002b,0x00000012,0x00000022,0x00000000,0x0004002b,
+    0x00000012,0x00000023,0x00000001,0x0004002b,0x00000012,0x00000024,0x00000002,0x0004002b,
+    0x00000012,0x00000025,0x00000003,0x0004002b,0x00000011,0x00000026,0x00000000,0x0004002b,
+    0x00000011,0x00000027,0x3f800000,0x00050036,0x0000000f,0x00000002,0x00000000,0x00000010,
+    0x000200f8,0x00000028,0x0004003d,0x00000012,0x00000029,0x00000003,0x0004003d,0x00000012,
+    0x0000002a,0x00000004,0x000500c7,0x00000012,0x0000002b,0x00000029,0x00000023,0x000500c3,
+    0x00000012,0x0000002c,0x00000029,0x00000023,0x0004006f,0x00000011,0x0000002d,0x0000002b,
+    0x0004006f,0x00000011,0x0000002e,0x0000002c,0x00050050,0x00000014,0x0000002f,0x0000002d,
+    0x0000002e,0x00070041,0x00000017,0x00000030,0x0000000b,0x00000022,0x0000002a,0x00000022,
+    0x0004003d,0x00000015,0x00000031,0x00000030,0x00070041,0x00000018,0x00000032,0x0000000b,
+    0x00000022,0x0000002a,0x00000023,0x0004003d,0x00000014,0x00000033,0x00000032,0x00070041,
+    0x00000019,0x00000034,0x0000000b,0x00000022,0x0000002a,0x00000024,0x0004003d,0x00000011,
+    0x00000035,0x00000034,0x00070041,0x0000001a,0x00000036,0x0000000b,0x00000022,0x0000002a,
+    0x00000025,0x0004003d,0x00000013,0x00000037,0x00000036,0x0006000c,0x00000015,0x00000038,
+    0x00000001,0x00000040,0x00000037,0x0003003e,0x00000005,0x00000038,0x0007004f,0x00000014,
+    0x00000039,0x00000031,0x00000031,0x00000000,0x00000001,0x0007004f,0x00000014,0x0000003a,
+    0x00000031,0x00000031,0x00000002,0x00000003,0x00050085,0x00000014,0x0000003b,0x0000002f,
+    0x0000003a,0x00050081,0x00000014,0x0000003c,0x00000039,0x0000003b,0x0003003e,0x00000006,
+    0x0000003c,0x0003003e,0x00000007,0x00000035,0x00050081,0x00000014,0x0000003d,0x00000033,
+    0x0000003b,0x00050041,0x0000001d,0x0000003e,0x0000000d,0x00000025,0x0004003d,0x00000011,
+    0x0000003f,0x0000003e,0x0005008e,0x00000014,0x00000040,0x0000003d,0x0000003f,0x00050041,
+    0x0000001c,0x00000041,0x0000000d,0x00000024,0x0004003d,0x00000014,0x00000042,0x00000041,
+    0x00050081,0x00000014,0x00000043,0x00000042,0x00000040,0x00050041,0x0000001c,0x00000044,
+    0x0000000d,0x00000022,0x0004003d,0x00000014,0x00000045,0x00000044,0x00050041,0x0000001c,
+    0x00000046,0x0000000d,0x00000023,0x0004003d,0x00000014,0x00000047,0x00000046,0x00050085,
+    0x00000014,0x00000048,0x00000043,0x00000045,0x00050081,0x00000014,0x00000049,0x00000048,
+    0x00000047,0x00050051,0x00000011,0x0000004a,0x00000049,0x00000000,0x00050051,0x00000011,
+    0x0000004b,0x00000049,0x00000001,0x00070050,0x00000015,0x0000004c,0x0000004a,0x0000004b,
+    0x00000026,0x00000027,0x0003003e,0x00000008,0x0000004c,0x000100fd,0x00010038
+};
+
+// sprite.frag, SPIR-V 1.0 equivalent of:
+/*
+#version 450 core
+layout(set = 1, binding = 0) uniform sampler2D sAtlas;
+layout(set = 1, binding = 1) uniform sampler2D sPalette;
+
+layout(location = 0) out vec4 fColor;
+layout(location = 0) in vec4 Color;
+layout(location = 1) in vec2 UV;
+layout(location = 2) flat in float Palette;
+
+void main()
+{
+    int index = int(texelFetch(sAtlas, ivec2(floor(UV)), 0).r * 255.0 + 0.5);
+    if (index == 0)
+        discard;
+    fColor = Color * texelFetch(sPalette, ivec2(index, int(Palette)), 0);
+}
+*/
+static uint32_t __glsl_shader_sprite_frag_spv[] =
+{
+    0x07230203,0x00010000,0x00000000,0x00000031,0x00000000,0x00020011,0x00000001,0x0006000b,
+    0x00000001,0x4c534c47,0x6474732e,0x3035342e,0x00000000,0x0003000e,0x00000000,0x00000001,
+    0x0009000f,0x00000004,0x00000002,0x6e69616d,0x00000000,0x00000003,0x00000004,0x00000005,
+    0x00000006,0x00030010,0x00000002,0x00000007,0x00030003,0x00000002,0x000001c2,0x00040005,
+    0x00000002,0x6e69616d,0x00000000,0x00040005,0x00000003,0x6c6f4366,0x0000726f,0x00040005,
+    0x00000007,0x6c744173,0x00007361,0x00050005,0x00000008,0x6c615073,0x65747465,0x00000000,
+    0x00040047,0x00000003,0x0000001e,0x00000000,0x00040047,0x00000004,0x0000001e,0x00000000,
+    0x00040047,0x00000005,0x0000001e,0x00000001,0x00030047,0x00000006,0x0000000e,0x00040047,
+    0x00000006,0x0000001e,0x00000002,0x00040047,0x00000007,0x00000022,0x00000001,0x00040047,
+    0x00000007,0x00000021,0x00000000,0x00040047,0x00000008,0x00000022,0x00000001,0x00040047,
+    0x00000008,0x00000021,0x00000001,0x00020013,0x00000009,0x00030021,0x0000000a,0x00000009,
+    0x00020014,0x0000000b,0x00030016,0x0000000c,0x00000020,0x00040015,0x0000000d,0x00000020,
+    0x00000001,0x00040017,0x0000000e,0x0000000c,0x00000002,0x00040017,0x0000000f,0x0000000c,
+    0x00000004,0x00040017,0x00000010,0x0000000d,0x00000002,0x00090019,0x00000011,0x0000000c,
+    0x00000001,0x00000000,0x00000000,0x00000000,0x00000001,0x00000000,0x0003001b,0x00000012,
+    0x00000011,0x00040020,0x00000013,0x00000000,0x00000012,0x0004003b,0x00000013,0x00000007,
+    0x00000000,0x0004003b,0x00000013,0x00000008,0x00000000,0x00040020,0x00000014,0x00000001,
+    0x0000000f,0x00040020,0x00000015,0x00000001,0x0000000e,0x00040020,0x00000016,0x00000001,
+    0x0000000c,0x00040020,0x00000017,0x00000003,0x0000000f,0x0004003b,0x00000014,0x00000004,
+    0x00000001,0x0004003b,0x00000015,0x00000005,0x00000001,0x0004003b,0x00000016,0x00000006,
+    0x00000001,0x0004003b,0x00000017,0x00000003,0x00000003,0x0004002b,0x0000000d,0x00000018,
+    0x00000000,0x0004002b,0x0000000c,0x00000019,0x437f0000,0x0004002b,0x0000000c,0x0000001a,
+    0x3f000000,0x00050036,0x00000009,0x00000002,0x00000000,0x0000000a,0x000200f8,0x0000001b,
+    0x0004003d,0x0000000e,0x0000001c,0x00000005,0x0006000c,0x0000000e,0x0000001d,0x00000001,
+    0x00000008,0x0000001c,0x0004006e,0x00000010,0x0000001e,0x0000001d,0x0004003d,0x00000012,
+    0x0000001f,0x00000007,0x00040064,0x00000011,0x00000020,0x0000001f,0x0007005f,0x0000000f,
+    0x00000021,0x00000020,0x0000001e,0x00000002,0x00000018,0x00050051,0x0000000c,0x00000022,
+    0x00000021,0x00000000,0x00050085,0x0000000c,0x00000023,0x00000022,0x00000019,0x00050081,
+    0x0000000c,0x00000024,0x00000023,0x0000001a,0x0004006e,0x0000000d,0x00000025,0x00000024,
+    0x000500aa,0x0000000b,0x00000026,0x00000025,0x00000018,0x000300f7,0x00000027,0x00000000,
+    0x000400fa,0x00000026,0x00000028,0x00000027,0x000200f8,0x00000028,0x000100fc,0x000200f8,
+    0x00000027,0x0004003d,0x0000000c,0x00000029,0x00000006,0x0004006e,0x0000000d,0x0000002a,
+    0x00000029,0x00050050,0x00000010,0x0000002b,0x00000025,0x0000002a,0x0004003d,0x00000012,
+    0x0000002c,0x00000008,0x00040064,0x00000011,0x0000002d,0x0000002c,0x0007005f,0x0000000f,
+    0x0000002e,0x0000002d,0x0000002b,0x00000002,0x00000018,0x0004003d,0x0000000f,0x0000002f,
+    0x00000004,0x00050085,0x0000000f,0x00000030,0x0000002f,0x0000002e,0x0003003e,0x00000003,
+    0x00000030,0x000100fd,0x00010038
+};
+
+
+namespace
+{
+	// Instance buffers start this big and double, so a steady scene stops reallocating quickly
+	const size_t MinInstanceCapacity = 4096;
+}
+
+
+SpriteRenderer::SpriteRenderer(VulkanController* vkCtrl, VkRenderPass renderPass)
+	: mVkCtrl(vkCtrl)
+{
+	VkDevice device = mVkCtrl->GetVkDevice();
+	VkAllocationCallbacks* allocator = mVkCtrl->GetVkAllocationCallbacks();
+
+	// Set 0: instance storage buffer, one per swapchain frame
+	{
+		VkDescriptorSetLayoutBinding binding[1] = {};
+		binding[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		binding[0].descriptorCount = 1;
+		binding[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		VkDescriptorSetLayoutCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		info.bindingCount = 1;
+		info.pBindings = binding;
+		if (VulkanController::VulkanError(vkCreateDescriptorSetLayout(device, &info, allocator, &mInstanceSetLayout)))
+			return;
+	}
+
+	// Set 1: atlas and palette table of a sheet
+	{
+		VkDescriptorSetLayoutBinding binding[2] = {};
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			binding[i].binding = i;
+			binding[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			binding[i].descriptorCount = 1;
+			binding[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		}
+		VkDescriptorSetLayoutCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		info.bindingCount = 2;
+		info.pBindings = binding;
+		if (VulkanController::VulkanError(vkCreateDescriptorSetLayout(device, &info, allocator, &mSheetSetLayout)))
+			return;
+	}
+
+	// Constants: scale and translate as in the ImGui pipeline, plus batch origin and zoom
+	{
+		VkPushConstantRange push_constants[1] = {};
+		push_constants[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_constants[0].offset = 0;
+		push_constants[0].size = sizeof(float) * 7;
+		VkDescriptorSetLayout set_layout[2] = { mInstanceSetLayout, mSheetSetLayout };
+		VkPipelineLayoutCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		info.setLayoutCount = 2;
+		info.pSetLayouts = set_layout;
+		info.pushConstantRangeCount = 1;
+		info.pPushConstantRanges = push_constants;
+		if (VulkanController::VulkanError(vkCreatePipelineLayout(device, &info, allocator, &mPipelineLayout)))
+			return;
+	}
+
+	CreatePipeline(renderPass);
+}
+
+
+SpriteRenderer::~SpriteRenderer()
+{
+	VkDevice device = mVkCtrl->GetVkDevice();
+	VkAllocationCallbacks* allocator = mVkCtrl->GetVkAllocationCallbacks();
+
+	// Only called with the device idle, frame buffers can go right away
+	for (auto& fb : mFrames)
+		DestroyFrameBuffer(fb);
+
+	vkDestroyPipeline(device, mPipeline, allocator);
+	vkDestroyPipelineLayout(device, mPipelineLayout, allocator);
+	vkDestroyDescriptorSetLayout(device, mSheetSetLayout, allocator);
+	vkDestroyDescriptorSetLayout(device, mInstanceSetLayout, allocator);
+}
+
+
+bool SpriteRenderer::CreatePipeline(VkRenderPass renderPass)
+{
+	VkDevice device = mVkCtrl->GetVkDevice();
+	VkAllocationCallbacks* allocator = mVkCtrl->GetVkAllocationCallbacks();
+
+	VkShaderModule vert_module = VK_NULL_HANDLE;
+	VkShaderModule frag_module = VK_NULL_HANDLE;
+	{
+		VkShaderModuleCreateInfo vert_info = {};
+		vert_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		vert_info.codeSize = sizeof(__glsl_shader_sprite_vert_spv);
+		vert_info.pCode = __glsl_shader_sprite_vert_spv;
+		VkShaderModuleCreateInfo frag_info = {};
+		frag_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		frag_info.codeSize = sizeof(__glsl_shader_sprite_frag_spv);
+		frag_info.pCode = __glsl_shader_sprite_frag_spv;
+		if (VulkanController::VulkanError(vkCreateShaderModule(device, &vert_info, allocator, &vert_module)) ||
+			VulkanController::VulkanError(vkCreateShaderModule(device, &frag_info, allocator, &frag_module)))
+		{
+			vkDestroyShaderModule(device, vert_module, allocator);
+			return false;
+		}
+	}
+
+	VkPipelineShaderStageCreateInfo stage[2] = {};
+	stage[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stage[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stage[0].module = vert_module;
+	stage[0].pName = "main";
+	stage[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stage[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stage[1].module = frag_module;
+	stage[1].pName = "main";
+
+	// Quad corners come from gl_VertexIndex, everything else from the storage buffer
+	VkPipelineVertexInputStateCreateInfo vertex_info = {};
+	vertex_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo ia_info = {};
+	ia_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	ia_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+
+	VkPipelineViewportStateCreateInfo viewport_info = {};
+	viewport_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_info.viewportCount = 1;
+	viewport_info.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo raster_info = {};
+	raster_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	raster_info.polygonMode = VK_POLYGON_MODE_FILL;
+	raster_info.cullMode = VK_CULL_MODE_NONE;
+	raster_info.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	raster_info.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo ms_info = {};
+	ms_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	ms_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Same blending as the ImGui pipeline so a tint alpha fades sprites into the window background
+	VkPipelineColorBlendAttachmentState color_attachment[1] = {};
+	color_attachment[0].blendEnable = VK_TRUE;
+	color_attachment[0].srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	color_attachment[0].dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	color_attachment[0].colorBlendOp = VK_BLEND_OP_ADD;
+	color_attachment[0].srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	color_attachment[0].dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	color_attachment[0].alphaBlendOp = VK_BLEND_OP_ADD;
+	color_attachment[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineDepthStencilStateCreateInfo depth_info = {};
+	depth_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+
+	VkPipelineColorBlendStateCreateInfo blend_info = {};
+	blend_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	blend_info.attachmentCount = 1;
+	blend_info.pAttachments = color_attachment;
+
+	VkDynamicState dynamic_states[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamic_state = {};
+	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.dynamicStateCount = (uint32_t)IM_ARRAYSIZE(dynamic_states);
+	dynamic_state.pDynamicStates = dynamic_states;
+
+	VkGraphicsPipelineCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	info.stageCount = 2;
+	info.pStages = stage;
+	info.pVertexInputState = &vertex_info;
+	info.pInputAssemblyState = &ia_info;
+	info.pViewportState = &viewport_info;
+	info.pRasterizationState = &raster_info;
+	info.pMultisampleState = &ms_info;
+	info.pDepthStencilState = &depth_info;
+	info.pColorBlendState = &blend_info;
+	info.pDynamicState = &dynamic_state;
+	info.layout = mPipelineLayout;
+	info.renderPass = renderPass;
+
+	bool failed = VulkanController::VulkanError(vkCreateGraphicsPipelines(device, mVkCtrl->GetVkPipelineCache(), 1, &info, allocator, &mPipeline));
+
+	vkDestroyShaderModule(device, vert_module, allocator);
+	vkDestroyShaderModule(device, frag_module, allocator);
+
+	return !failed;
+}
+
+
+SpriteSheet* SpriteRenderer::CreateSheet(int width, int height, const uint8_t* indices, int paletteCount, const uint32_t* palettes)
+{
+	if (!isReady())
+		return nullptr;
+
+	AV_TRACE_SCOPE("SpriteRenderer::CreateSheet");
+
+	SpriteSheet* sheet = new SpriteSheet();
+	sheet->paletteCount = paletteCount;
+	sheet->atlas = mVkCtrl->CreateTexture(width, height, VK_FORMAT_R8_UNORM, indices);
+	sheet->palettes = mVkCtrl->CreateTexture(256, paletteCount, VK_FORMAT_R8G8B8A8_UNORM, palettes);
+	if (sheet->atlas == nullptr || sheet->palettes == nullptr || !CreateSheetDescriptor(sheet))
+	{
+		DestroySheet(sheet);
+		return nullptr;
+	}
+
+	return sheet;
+}
+
+
+SpriteSheet* SpriteRenderer::CreateSheet(VulkanTexture* atlas, int paletteCount, const uint32_t* palettes)
+{
+	if (!isReady() || atlas == nullptr)
+		return nullptr;
+
+	AV_TRACE_SCOPE("SpriteRenderer::CreateSheet");
+
+	SpriteSheet* sheet = new SpriteSheet();
+	sheet->paletteCount = paletteCount;
+	sheet->atlas = atlas;
+	sheet->ownsAtlas = false;
+	sheet->palettes = mVkCtrl->CreateTexture(256, paletteCount, VK_FORMAT_R8G8B8A8_UNORM, palettes);
+	if (sheet->palettes == nullptr || !CreateSheetDescriptor(sheet))
+	{
+		DestroySheet(sheet);
+		return nullptr;
+	}
+
+	return sheet;
+}
+
+
+bool SpriteRenderer::CreateSheetDescriptor(SpriteSheet* sheet)
+{
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = mVkCtrl->GetVkDescriptorPool();
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &mSheetSetLayout;
+	if (VulkanController::VulkanError(vkAllocateDescriptorSets(mVkCtrl->GetVkDevice(), &alloc_info, &sheet->descriptor)))
+	{
+		sheet->descriptor = VK_NULL_HANDLE;
+		return false;
+	}
+
+	// Both images are read with texelFetch, the sampler only has to exist
+	VkDescriptorImageInfo image_info[2] = {};
+	image_info[0].sampler = mVkCtrl->GetNearestSampler();
+	image_info[0].imageView = sheet->atlas->view;
+	image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_info[1].sampler = mVkCtrl->GetNearestSampler();
+	image_info[1].imageView = sheet->palettes->view;
+	image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write[1] = {};
+	write[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write[0].dstSet = sheet->descriptor;
+	write[0].dstBinding = 0;
+	write[0].descriptorCount = 2;
+	write[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write[0].pImageInfo = image_info;
+	vkUpdateDescriptorSets(mVkCtrl->GetVkDevice(), 1, write, 0, NULL);
+
+	return true;
+}
+
+
+bool SpriteRenderer::ReplacePalettes(SpriteSheet* sheet, int paletteCount, const uint32_t* palettes)
+{
+	VulkanTexture* texture = mVkCtrl->CreateTexture(256, paletteCount, VK_FORMAT_R8G8B8A8_UNORM, palettes);
+	if (texture == nullptr)
+		return false;
+
+	// Frames in flight keep the old set and table, both are released after them
+	mVkCtrl->DestroyDescriptorSet(sheet->descriptor);
+	mVkCtrl->DestroyTexture(sheet->palettes);
+	sheet->palettes = texture;
+	sheet->paletteCount = paletteCount;
+	return CreateSheetDescriptor(sheet);
+}
+
+
+void SpriteRenderer::DestroySheet(SpriteSheet* sheet)
+{
+	if (sheet == nullptr)
+		return;
+
+	mVkCtrl->DestroyDescriptorSet(sheet->descriptor);
+	if (sheet->ownsAtlas)
+		mVkCtrl->DestroyTexture(sheet->atlas);
+	mVkCtrl->DestroyTexture(sheet->palettes);
+	delete sheet;
+}
+
+
+bool SpriteRenderer::UpdateSheet(SpriteSheet* sheet, int x, int y, int width, int height, const uint8_t* indices)
+{
+	if (sheet == nullptr || width <= 0 || height <= 0)
+		return false;
+
+	return mVkCtrl->UpdateTexture(sheet->atlas, x, y, width, height, indices);
+}
+
+
+void SpriteRenderer::AddBatch(ImDrawList* drawList, SpriteSheet* sheet, const SpriteInstance* instances, int count, ImVec2 origin, float zoom)
+{
+	if (sheet == nullptr || count <= 0 || !isReady())
+		return;
+
+	// A frame that was built but never rendered (minimized window) leaves its batches behind
+	if (mBuildFrame != ImGui::GetFrameCount())
+	{
+		mBuildFrame = ImGui::GetFrameCount();
+		mInstances.clear();
+		mBatches.clear();
+	}
+
+	Batch batch = { this, sheet->descriptor, (uint32_t)mInstances.size(), (uint32_t)count, origin, zoom };
+	mInstances.insert(mInstances.end(), instances, instances + count);
+	mBatches.push_back(batch);
+
+	// Our pipeline replaces the ImGui one, the backend has to bind its state again afterwards
+	drawList->AddCallback(DrawCallback, &mBatches.back());
+	drawList->AddCallback(ImDrawCallback_ResetRenderState, NULL);
+}
+
+
+void SpriteRenderer::PrepareFrame(uint32_t frameIndex, VkCommandBuffer cmd, ImDrawData* drawData)
+{
+	AV_TRACE_SCOPE("SpriteRenderer::PrepareFrame");
+
+	mCommandBuffer = VK_NULL_HANDLE;
+	mCurrentFrame = nullptr;
+
+	if (mBuildFrame != ImGui::GetFrameCount())
+	{
+		mInstances.clear();
+		mBatches.clear();
+	}
+
+	mLastInstanceCount = (int)mInstances.size();
+	mLastBatchCount = (int)mBatches.size();
+	if (mInstances.empty())
+		return;
+
+	// The caller waited on this frame's fence, nothing on the GPU reads its buffer anymore
+	if (mFrames.size() <= frameIndex)
+		mFrames.resize(frameIndex + 1);
+	FrameBuffer& fb = mFrames[frameIndex];
+	if (!ReserveFrameBuffer(fb, mInstances.size()))
+		return;
+
+	memcpy(fb.mapped, mInstances.data(), mInstances.size() * sizeof(SpriteInstance));
+
+	mCommandBuffer = cmd;
+	mCurrentFrame = &fb;
+	mDrawData = drawData;
+}
+
+
+void SpriteRenderer::FinishFrame()
+{
+	mCommandBuffer = VK_NULL_HANDLE;
+	mCurrentFrame = nullptr;
+	mDrawData = nullptr;
+
+	mInstances.clear();
+	mBatches.clear();
+}
+
+
+void SpriteRenderer::DrawCallback(const ImDrawList* parentList, const ImDrawCmd* cmd)
+{
+	IM_UNUSED(parentList);
+
+	const Batch* batch = (const Batch*)cmd->UserCallbackData;
+	batch->owner->RecordBatch(*batch, cmd->ClipRect);
+}
+
+
+void SpriteRenderer::RecordBatch(const Batch& batch, const ImVec4& clipRect)
+{
+	if (mCommandBuffer == VK_NULL_HANDLE)
+		return;
+
+	// Project the clip rectangle into framebuffer space, same as the ImGui backend does
+	ImVec2 clip_off = mDrawData->DisplayPos;
+	ImVec2 clip_scale = mDrawData->FramebufferScale;
+	float fb_width = mDrawData->DisplaySize.x * clip_scale.x;
+	float fb_height = mDrawData->DisplaySize.y * clip_scale.y;
+
+	ImVec4 clip_rect((clipRect.x - clip_off.x) * clip_scale.x, (clipRect.y - clip_off.y) * clip_scale.y,
+		(clipRect.z - clip_off.x) * clip_scale.x, (clipRect.w - clip_off.y) * clip_scale.y);
+	if (clip_rect.x < 0.0f)
+		clip_rect.x = 0.0f;
+	if (clip_rect.y < 0.0f)
+		clip_rect.y = 0.0f;
+	if (clip_rect.x >= fb_width || clip_rect.y >= fb_height || clip_rect.z <= clip_rect.x || clip_rect.w <= clip_rect.y)
+		return;
+
+	VkDescriptorSet sets[2] = { mCurrentFrame->descriptor, batch.sheet };
+	vkCmdBindPipeline(mCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipeline);
+	vkCmdBindDescriptorSets(mCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPipelineLayout, 0, 2, sets, 0, NULL);
+
+	VkViewport viewport;
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = fb_width;
+	viewport.height = fb_height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(mCommandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor;
+	scissor.offset.x = (int32_t)clip_rect.x;
+	scissor.offset.y = (int32_t)clip_rect.y;
+	scissor.extent.width = (uint32_t)(clip_rect.z - clip_rect.x);
+	scissor.extent.height = (uint32_t)(clip_rect.w - clip_rect.y);
+	vkCmdSetScissor(mCommandBuffer, 0, 1, &scissor);
+
+	float constants[7];
+	constants[0] = 2.0f / mDrawData->DisplaySize.x;
+	constants[1] = 2.0f / mDrawData->DisplaySize.y;
+	constants[2] = -1.0f - mDrawData->DisplayPos.x * constants[0];
+	constants[3] = -1.0f - mDrawData->DisplayPos.y * constants[1];
+	constants[4] = batch.origin.x;
+	constants[5] = batch.origin.y;
+	constants[6] = batch.zoom;
+	vkCmdPushConstants(mCommandBuffer, mPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), constants);
+
+	// gl_InstanceIndex starts at firstInstance, which is where the batch sits in the buffer
+	vkCmdDraw(mCommandBuffer, 4, batch.count, 0, batch.first);
+}
+
+
+bool SpriteRenderer::ReserveFrameBuffer(FrameBuffer& fb, size_t count)
+{
+	if (fb.capacity >= count)
+		return true;
+
+	size_t capacity = fb.capacity > 0 ? fb.capacity : MinInstanceCapacity;
+	while (capacity < count)
+		capacity *= 2;
+
+	VkDescriptorSet descriptor = fb.descriptor;
+	fb.descriptor = VK_NULL_HANDLE;
+	DestroyFrameBuffer(fb);
+	fb.descriptor = descriptor;
+
+	VkDevice device = mVkCtrl->GetVkDevice();
+	VkAllocationCallbacks* allocator = mVkCtrl->GetVkAllocationCallbacks();
+
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = capacity * sizeof(SpriteInstance);
+	buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (VulkanController::VulkanError(vkCreateBuffer(device, &buffer_info, allocator, &fb.buffer)))
+		return false;
+
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(device, fb.buffer, &req);
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = req.size;
+	alloc_info.memoryTypeIndex = mVkCtrl->FindMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, req.memoryTypeBits);
+	if (VulkanController::VulkanError(vkAllocateMemory(device, &alloc_info, allocator, &fb.memory)) ||
+		VulkanController::VulkanError(vkBindBufferMemory(device, fb.buffer, fb.memory, 0)) ||
+		VulkanController::VulkanError(vkMapMemory(device, fb.memory, 0, VK_WHOLE_SIZE, 0, &fb.mapped)))
+	{
+		DestroyFrameBuffer(fb);
+		return false;
+	}
+
+	if (fb.descriptor == VK_NULL_HANDLE)
+	{
+		VkDescriptorSetAllocateInfo set_info = {};
+		set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		set_info.descriptorPool = mVkCtrl->GetVkDescriptorPool();
+		set_info.descriptorSetCount = 1;
+		set_info.pSetLayouts = &mInstanceSetLayout;
+		if (VulkanController::VulkanError(vkAllocateDescriptorSets(device, &set_info, &fb.descriptor)))
+		{
+			DestroyFrameBuffer(fb);
+			return false;
+		}
+	}
+
+	VkDescriptorBufferInfo desc_buffer = {};
+	desc_buffer.buffer = fb.buffer;
+	desc_buffer.offset = 0;
+	desc_buffer.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet write[1] = {};
+	write[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write[0].dstSet = fb.descriptor;
+	write[0].dstBinding = 0;
+	write[0].descriptorCount = 1;
+	write[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write[0].pBufferInfo = &desc_buffer;
+	vkUpdateDescriptorSets(device, 1, write, 0, NULL);
+
+	fb.capacity = capacity;
+	return true;
+}
+
+
+void SpriteRenderer::DestroyFrameBuffer(FrameBuffer& fb)
+{
+	VkDevice device = mVkCtrl->GetVkDevice();
+	VkAllocationCallbacks* allocator = mVkCtrl->GetVkAllocationCallbacks();
+
+	if (fb.mapped != nullptr)
+		vkUnmapMemory(device, fb.memory);
+	vkDestroyBuffer(device, fb.buffer, allocator);
+	vkFreeMemory(device, fb.memory, allocator);
+	if (fb.descriptor != VK_NULL_HANDLE)
+		vkFreeDescriptorSets(device, mVkCtrl->GetVkDescriptorPool(), 1, &fb.descriptor);
+
+	fb = FrameBuffer();
+}
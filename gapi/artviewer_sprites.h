@@ -0,0 +1,114 @@
+/* OpenArcanum instanced sprite renderer */
+
+#pragma once
+
+#include "artviewer_vulkan.h"
+
+#include <deque>
+#include <vector>
+
+// One sprite as the vertex shader reads it from the instance storage buffer (std430 layout)
+struct SpriteInstance
+{
+	float    rect[4];      // atlas texels: x, y, width, height
+	float    pos[2];       // top-left corner in canvas units, scaled by the batch zoom
+	float    palette;      // row of the sheet palette table
+	uint32_t tint;         // IM_COL32, multiplied with the palette colour
+};
+
+static_assert(sizeof(SpriteInstance) == 32, "SpriteInstance must match the std430 layout of the sprite shader");
+
+// Indexed atlas plus its palettes, the palette lookup happens in the fragment shader
+struct SpriteSheet
+{
+	VulkanTexture*  atlas = nullptr;      // R8, palette index per texel, 0 is transparent
+	VulkanTexture*  palettes = nullptr;   // RGBA8, 256 wide, one row per palette
+	VkDescriptorSet descriptor = VK_NULL_HANDLE;
+	int             paletteCount = 0;
+	bool            ownsAtlas = true;     // false when borrowed from whoever created it, see FrameStore
+};
+
+// Draws any number of sprites with one instanced draw per batch.
+// Batches are queued while building the ImGui frame and recorded from a draw list callback, so they
+// keep their place in the ImGui draw order and clipping; FrameRender() uploads the instances of the
+// frame in one go before the render pass begins.
+class SpriteRenderer
+{
+public:
+	SpriteRenderer(VulkanController* vkCtrl, VkRenderPass renderPass);
+	~SpriteRenderer();
+
+	SpriteRenderer(const SpriteRenderer&) = delete;
+	SpriteRenderer(SpriteRenderer&&) = delete;
+
+	bool isReady() { return mPipeline != VK_NULL_HANDLE; }
+
+	SpriteSheet* CreateSheet(int width, int height, const uint8_t* indices, int paletteCount, const uint32_t* palettes);
+	// Draws from an atlas texture owned elsewhere with palettes of its own; the atlas must outlive the sheet
+	SpriteSheet* CreateSheet(VulkanTexture* atlas, int paletteCount, const uint32_t* palettes);
+	void DestroySheet(SpriteSheet* sheet);
+	// Replaces part of the atlas, e.g. a slot of a tile cache
+	bool UpdateSheet(SpriteSheet* sheet, int x, int y, int width, int height, const uint8_t* indices);
+	// Same atlas, another palette table
+	bool ReplacePalettes(SpriteSheet* sheet, int paletteCount, const uint32_t* palettes);
+
+	// Instances are copied, positions are relative to 'origin' in screen space
+	void AddBatch(ImDrawList* drawList, SpriteSheet* sheet, const SpriteInstance* instances, int count, ImVec2 origin, float zoom);
+
+	void PrepareFrame(uint32_t frameIndex, VkCommandBuffer cmd, ImDrawData* drawData);
+	void FinishFrame();
+
+	int GetInstanceCount() { return mLastInstanceCount; }
+	int GetBatchCount() { return mLastBatchCount; }
+
+protected:
+	struct Batch
+	{
+		SpriteRenderer* owner;
+		VkDescriptorSet sheet;
+		uint32_t        first;
+		uint32_t        count;
+		ImVec2          origin;
+		float           zoom;
+	};
+
+	// Instance buffer of one swapchain frame, persistently mapped
+	struct FrameBuffer
+	{
+		VkBuffer        buffer = VK_NULL_HANDLE;
+		VkDeviceMemory  memory = VK_NULL_HANDLE;
+		void*           mapped = nullptr;
+		size_t          capacity = 0;
+		VkDescriptorSet descriptor = VK_NULL_HANDLE;
+	};
+
+	bool CreateSheetDescriptor(SpriteSheet* sheet);
+
+	static void DrawCallback(const ImDrawList* parentList, const ImDrawCmd* cmd);
+	void RecordBatch(const Batch& batch, const ImVec4& clipRect);
+
+	bool CreatePipeline(VkRenderPass renderPass);
+	bool ReserveFrameBuffer(FrameBuffer& fb, size_t count);
+	void DestroyFrameBuffer(FrameBuffer& fb);
+
+protected:
+	VulkanController*     mVkCtrl;
+
+	VkDescriptorSetLayout mInstanceSetLayout = VK_NULL_HANDLE;
+	VkDescriptorSetLayout mSheetSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout      mPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline            mPipeline = VK_NULL_HANDLE;
+
+	std::vector<FrameBuffer>    mFrames;
+	std::vector<SpriteInstance> mInstances;
+	std::deque<Batch>           mBatches;          // deque: draw commands keep pointers to their batch
+	int                         mBuildFrame = -1;
+
+	// Valid between PrepareFrame() and FinishFrame()
+	VkCommandBuffer mCommandBuffer = VK_NULL_HANDLE;
+	FrameBuffer*    mCurrentFrame = nullptr;
+	ImDrawData*     mDrawData = nullptr;
+
+	int mLastInstanceCount = 0;
+	int mLastBatchCount = 0;
+};
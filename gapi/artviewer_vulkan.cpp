@@ -1,8 +1,60 @@
 /* OpenArcanum Vulkan init routines */
 
 #include "artviewer_vulkan.h"
+#include "artviewer_sprites.h"
+#include "common/Trace.h"
 #include <stdio.h>          // printf, fprintf
 #include <stdlib.h>         // abort
+#include <string.h>         // memcmp
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+
+namespace
+{
+	// Written in front of the driver blob. The blob header only carries vendor, device and cache UUID,
+	// so the driver version is kept here to throw away caches left behind by a driver update.
+	struct PipelineCacheFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+		uint32_t dataSize;
+	};
+
+	const uint32_t PipelineCacheMagic = 0x43505641; // "AVPC"
+	const uint32_t PipelineCacheVersion = 1;
+
+	// Layout of VkPipelineCacheHeaderVersionOne, which older SDK headers do not declare
+	const size_t   PipelineCacheBlobHeaderSize = 16 + VK_UUID_SIZE;
+
+	bool ValidPipelineCache(const VkPhysicalDeviceProperties& props, const PipelineCacheFileHeader& header, const std::vector<char>& blob)
+	{
+		if (header.magic != PipelineCacheMagic || header.version != PipelineCacheVersion)
+			return false;
+
+		if (header.vendorID != props.vendorID || header.deviceID != props.deviceID || header.driverVersion != props.driverVersion ||
+			memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+			return false;
+
+		if (blob.size() != header.dataSize || blob.size() < PipelineCacheBlobHeaderSize)
+			return false;
+
+		uint32_t blob_header[4];
+		memcpy(blob_header, blob.data(), sizeof(blob_header));
+
+		return blob_header[0] >= PipelineCacheBlobHeaderSize &&
+			blob_header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+			blob_header[2] == props.vendorID &&
+			blob_header[3] == props.deviceID &&
+			memcmp(blob.data() + sizeof(blob_header), props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+}
 
 
 bool VulkanController::VulkanError(VkResult err)
@@ -20,7 +72,8 @@ void VulkanController::VulkanErrorStatic(VkResult err)
 }
 
 
-VulkanController::VulkanController(const char** extensions, uint32_t extensions_count)
+VulkanController::VulkanController(const char** extensions, uint32_t extensions_count, bool headless)
+	: mHeadless(headless)
 {
 	// Create Vulkan Instance
 	{
@@ -67,13 +120,15 @@ VulkanController::VulkanController(const char** extensions, uint32_t extensions_
 				g_QueueFamily = i;
 				break;
 			}
+		if (g_QueueFamily != (uint32_t)-1 && queues[g_QueueFamily].timestampValidBits > 0)
+			mTimestampMask = queues[g_QueueFamily].timestampValidBits >= 64 ? ~0ull : (1ull << queues[g_QueueFamily].timestampValidBits) - 1;
 		free(queues);
 		IM_ASSERT(g_QueueFamily != (uint32_t)-1);
 	}
 
 	// Create Logical Device (with 1 queue)
 	{
-		int device_extension_count = 1;
+		int device_extension_count = mHeadless ? 0 : 1;
 		const char* device_extensions[] = { "VK_KHR_swapchain" };
 		const float queue_priority[] = { 1.0f };
 		VkDeviceQueueCreateInfo queue_info[1] = {};
@@ -120,6 +175,40 @@ VulkanController::VulkanController(const char** extensions, uint32_t extensions_
 		if (VulkanError(vkCreateDescriptorPool(g_Device, &pool_info, g_Allocator, &g_DescriptorPool)))
 			return;
 	}
+
+	// Create Sampler for ART textures, pixel art is only ever scaled by nearest neighbour
+	{
+		VkSamplerCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		info.magFilter = VK_FILTER_NEAREST;
+		info.minFilter = VK_FILTER_NEAREST;
+		info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		info.minLod = -1000;
+		info.maxLod = 1000;
+		info.maxAnisotropy = 1.0f;
+
+		if (VulkanError(vkCreateSampler(g_Device, &info, g_Allocator, &mNearestSampler)))
+			return;
+	}
+
+	// Create timestamp queries for the profiler, optional: without them only CPU times are shown
+	if (mTimestampMask != 0)
+	{
+		VkPhysicalDeviceProperties props;
+		vkGetPhysicalDeviceProperties(g_PhysicalDevice, &props);
+		mTimestampPeriod = props.limits.timestampPeriod;
+
+		VkQueryPoolCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		info.queryCount = TimestampFrames * 2;
+
+		if (VulkanError(vkCreateQueryPool(g_Device, &info, g_Allocator, &mTimestampPool)))
+			mTimestampPool = VK_NULL_HANDLE;
+	}
 }
 
 
@@ -131,7 +220,7 @@ VulkanController::~VulkanController()
 
 // All the ImGui_ImplVulkanH_XXX structures/functions are optional helpers used by the demo.
 // Your real engine/app may not use them.
-void VulkanController::SetupVulkanWindow(ImGui_ImplVulkanH_Window* wd, VkSurfaceKHR surface, int width, int height, int minImageCount)
+void VulkanController::SetupVulkanWindow(ImGui_ImplVulkanH_Window* wd, VkSurfaceKHR surface, int width, int height, int minImageCount, VkPresentModeKHR presentMode)
 {
 	wd->Surface = surface;
 
@@ -150,9 +239,7 @@ void VulkanController::SetupVulkanWindow(ImGui_ImplVulkanH_Window* wd, VkSurface
 	wd->SurfaceFormat = ImGui_ImplVulkanH_SelectSurfaceFormat(g_PhysicalDevice, wd->Surface, requestSurfaceImageFormat, (size_t)IM_ARRAYSIZE(requestSurfaceImageFormat), requestSurfaceColorSpace);
 
 	// Select Present Mode
-	VkPresentModeKHR present_modes[] = { VK_PRESENT_MODE_FIFO_KHR };
-	wd->PresentMode = ImGui_ImplVulkanH_SelectPresentMode(g_PhysicalDevice, wd->Surface, &present_modes[0], IM_ARRAYSIZE(present_modes));
-	//printf("[vulkan] Selected PresentMode = %d\n", wd->PresentMode);
+	SelectPresentMode(wd, presentMode);
 
 	// Create SwapChain, RenderPass, Framebuffer, etc.
 	IM_ASSERT(minImageCount >= 2);
@@ -160,8 +247,35 @@ void VulkanController::SetupVulkanWindow(ImGui_ImplVulkanH_Window* wd, VkSurface
 }
 
 
+// Takes effect on the next ImGui_ImplVulkanH_CreateOrResizeWindow(), falls back to FIFO which is always supported
+void VulkanController::SelectPresentMode(ImGui_ImplVulkanH_Window* wd, VkPresentModeKHR presentMode)
+{
+	VkPresentModeKHR present_modes[] = { presentMode, VK_PRESENT_MODE_FIFO_KHR };
+	wd->PresentMode = ImGui_ImplVulkanH_SelectPresentMode(g_PhysicalDevice, wd->Surface, &present_modes[0], IM_ARRAYSIZE(present_modes));
+
+	if (wd->PresentMode != presentMode)
+		fprintf(stderr, "[vulkan] PresentMode %d not supported, using %d\n", presentMode, wd->PresentMode);
+}
+
+
 void VulkanController::CleanupVulkan()
 {
+	for (auto& upload : mPendingUploads)
+		mRetired.push_back({ 0, upload.update ? NULL : upload.texture, upload.buffer, upload.memory, VK_NULL_HANDLE });
+	mPendingUploads.clear();
+
+	// Sheets still alive retire their textures into mRetired
+	delete mSprites;
+	mSprites = nullptr;
+
+	ReleaseRetired(true);
+
+	vkDestroySampler(g_Device, mNearestSampler, g_Allocator);
+	vkDestroyQueryPool(g_Device, mTimestampPool, g_Allocator);
+
+	SavePipelineCache();
+	vkDestroyPipelineCache(g_Device, g_PipelineCache, g_Allocator);
+
 	vkDestroyDescriptorPool(g_Device, g_DescriptorPool, g_Allocator);
 
 	vkDestroyDevice(g_Device, g_Allocator);
@@ -174,7 +288,10 @@ void VulkanController::FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* dra
 	VkSemaphore image_acquired_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].ImageAcquiredSemaphore;
 	VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
 
-	if (VulkanError(vkAcquireNextImageKHR(g_Device, wd->Swapchain, UINT64_MAX, image_acquired_semaphore, VK_NULL_HANDLE, &wd->FrameIndex)))
+	// Offscreen images are simply used in turn, the per-frame fence below keeps them from being overwritten in flight
+	if (mHeadless)
+		wd->FrameIndex = (wd->FrameIndex + 1) % wd->ImageCount;
+	else if (VulkanError(vkAcquireNextImageKHR(g_Device, wd->Swapchain, UINT64_MAX, image_acquired_semaphore, VK_NULL_HANDLE, &wd->FrameIndex)))
 		return;
 
 	ImGui_ImplVulkanH_Frame* fd = &wd->Frames[wd->FrameIndex];
@@ -183,6 +300,23 @@ void VulkanController::FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* dra
 		VulkanError(vkResetFences(g_Device, 1, &fd->Fence)))
 		return;
 
+	// The queue retires submissions in order, so everything up to this frame's last submission is done
+	if (mFrameSerials.size() < wd->ImageCount)
+		mFrameSerials.resize(wd->ImageCount, 0);
+	if (mFrameSerials[wd->FrameIndex] > mCompletedSerial)
+		mCompletedSerial = mFrameSerials[wd->FrameIndex];
+	ReleaseRetired(false);
+
+	// The fence also covers the timestamps this frame wrote last time round
+	const bool timestamps = mTimestampPool != VK_NULL_HANDLE && wd->FrameIndex < TimestampFrames;
+	const uint32_t first_query = wd->FrameIndex * 2;
+	if (timestamps && mTimestampWritten[wd->FrameIndex])
+	{
+		uint64_t ticks[2] = {};
+		if (vkGetQueryPoolResults(g_Device, mTimestampPool, first_query, 2, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+			mGpuFrameTimeMs = (float)((double)((ticks[1] - ticks[0]) & mTimestampMask) * mTimestampPeriod / 1000000.0);
+	}
+
 	{
 		if (VulkanError(vkResetCommandPool(g_Device, fd->CommandPool, 0)))
 			return;
@@ -194,6 +328,19 @@ void VulkanController::FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* dra
 		if (VulkanError(vkBeginCommandBuffer(fd->CommandBuffer, &info)))
 			return;
 	}
+
+	if (timestamps)
+		vkCmdResetQueryPool(fd->CommandBuffer, mTimestampPool, first_query, 2);
+
+	RecordUploads(fd->CommandBuffer);
+
+	// Sprite instances of the whole frame go to the GPU in one copy, batches are drawn from ImGui callbacks
+	if (mSprites)
+		mSprites->PrepareFrame(wd->FrameIndex, fd->CommandBuffer, draw_data);
+
+	if (timestamps)
+		vkCmdWriteTimestamp(fd->CommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mTimestampPool, first_query);
+
 	{
 		VkRenderPassBeginInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -209,29 +356,41 @@ void VulkanController::FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* dra
 	// Record dear imgui primitives into command buffer
 	ImGui_ImplVulkan_RenderDrawData(draw_data, fd->CommandBuffer);
 
+	if (mSprites)
+		mSprites->FinishFrame();
+
 	// Submit command buffer
 	vkCmdEndRenderPass(fd->CommandBuffer);
+	if (timestamps)
+		vkCmdWriteTimestamp(fd->CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mTimestampPool, first_query + 1);
 	{
 		VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		VkSubmitInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		info.waitSemaphoreCount = 1;
+		info.waitSemaphoreCount = mHeadless ? 0 : 1;
 		info.pWaitSemaphores = &image_acquired_semaphore;
 		info.pWaitDstStageMask = &wait_stage;
 		info.commandBufferCount = 1;
 		info.pCommandBuffers = &fd->CommandBuffer;
-		info.signalSemaphoreCount = 1;
+		info.signalSemaphoreCount = mHeadless ? 0 : 1;
 		info.pSignalSemaphores = &render_complete_semaphore;
 
 		if (VulkanError(vkEndCommandBuffer(fd->CommandBuffer)) ||
 			VulkanError(vkQueueSubmit(g_Queue, 1, &info, fd->Fence)))
 			return;
+
+		mFrameSerials[wd->FrameIndex] = ++mSubmittedSerial;
+		if (timestamps)
+			mTimestampWritten[wd->FrameIndex] = true;
 	}
 }
 
 
 void VulkanController::FramePresent(ImGui_ImplVulkanH_Window* wd)
 {
+	if (mHeadless)
+		return;
+
 	VkSemaphore render_complete_semaphore = wd->FrameSemaphores[wd->SemaphoreIndex].RenderCompleteSemaphore;
 	VkPresentInfoKHR info = {};
 	info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -248,6 +407,298 @@ void VulkanController::FramePresent(ImGui_ImplVulkanH_Window* wd)
 }
 
 
+bool VulkanController::CreateOffscreenWindow(ImGui_ImplVulkanH_Window* wd, int width, int height, uint32_t imageCount)
+{
+	IM_ASSERT(mHeadless && wd->Frames == NULL);
+
+	wd->Width = width;
+	wd->Height = height;
+	wd->SurfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+	wd->SurfaceFormat.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+	wd->PresentMode = VK_PRESENT_MODE_FIFO_KHR;
+	wd->ImageCount = imageCount;
+	wd->FrameIndex = 0;
+	wd->Frames = (ImGui_ImplVulkanH_Frame*)IM_ALLOC(sizeof(ImGui_ImplVulkanH_Frame) * imageCount);
+	wd->FrameSemaphores = (ImGui_ImplVulkanH_FrameSemaphores*)IM_ALLOC(sizeof(ImGui_ImplVulkanH_FrameSemaphores) * imageCount);
+	memset(wd->Frames, 0, sizeof(wd->Frames[0]) * imageCount);
+	memset(wd->FrameSemaphores, 0, sizeof(wd->FrameSemaphores[0]) * imageCount);
+
+	// Same pass as the swapchain one, except that the image ends up ready to be copied out
+	{
+		VkAttachmentDescription attachment = {};
+		attachment.format = wd->SurfaceFormat.format;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = wd->ClearEnable ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		attachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		VkAttachmentReference color_attachment = {};
+		color_attachment.attachment = 0;
+		color_attachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &color_attachment;
+		VkSubpassDependency dependency = {};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependency.srcAccessMask = 0;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		VkRenderPassCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		info.attachmentCount = 1;
+		info.pAttachments = &attachment;
+		info.subpassCount = 1;
+		info.pSubpasses = &subpass;
+		info.dependencyCount = 1;
+		info.pDependencies = &dependency;
+		if (VulkanError(vkCreateRenderPass(g_Device, &info, g_Allocator, &wd->RenderPass)))
+			return false;
+	}
+
+	mOffscreenImages.resize(imageCount, { VK_NULL_HANDLE, VK_NULL_HANDLE });
+	for (uint32_t i = 0; i < imageCount; i++)
+	{
+		ImGui_ImplVulkanH_Frame* fd = &wd->Frames[i];
+		OffscreenImage& target = mOffscreenImages[i];
+
+		{
+			VkImageCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			info.imageType = VK_IMAGE_TYPE_2D;
+			info.format = wd->SurfaceFormat.format;
+			info.extent.width = width;
+			info.extent.height = height;
+			info.extent.depth = 1;
+			info.mipLevels = 1;
+			info.arrayLayers = 1;
+			info.samples = VK_SAMPLE_COUNT_1_BIT;
+			info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (VulkanError(vkCreateImage(g_Device, &info, g_Allocator, &target.image)))
+				return false;
+
+			VkMemoryRequirements req;
+			vkGetImageMemoryRequirements(g_Device, target.image, &req);
+			VkMemoryAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			alloc_info.allocationSize = req.size;
+			alloc_info.memoryTypeIndex = FindMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, req.memoryTypeBits);
+			if (VulkanError(vkAllocateMemory(g_Device, &alloc_info, g_Allocator, &target.memory)) ||
+				VulkanError(vkBindImageMemory(g_Device, target.image, target.memory, 0)))
+				return false;
+			fd->Backbuffer = target.image;
+		}
+		{
+			VkImageViewCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			info.image = fd->Backbuffer;
+			info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			info.format = wd->SurfaceFormat.format;
+			info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			info.subresourceRange.levelCount = 1;
+			info.subresourceRange.layerCount = 1;
+			if (VulkanError(vkCreateImageView(g_Device, &info, g_Allocator, &fd->BackbufferView)))
+				return false;
+		}
+		{
+			VkFramebufferCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			info.renderPass = wd->RenderPass;
+			info.attachmentCount = 1;
+			info.pAttachments = &fd->BackbufferView;
+			info.width = width;
+			info.height = height;
+			info.layers = 1;
+			if (VulkanError(vkCreateFramebuffer(g_Device, &info, g_Allocator, &fd->Framebuffer)))
+				return false;
+		}
+		{
+			VkCommandPoolCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+			info.queueFamilyIndex = g_QueueFamily;
+			if (VulkanError(vkCreateCommandPool(g_Device, &info, g_Allocator, &fd->CommandPool)))
+				return false;
+		}
+		{
+			VkCommandBufferAllocateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			info.commandPool = fd->CommandPool;
+			info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			info.commandBufferCount = 1;
+			if (VulkanError(vkAllocateCommandBuffers(g_Device, &info, &fd->CommandBuffer)))
+				return false;
+		}
+		{
+			VkFenceCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+			if (VulkanError(vkCreateFence(g_Device, &info, g_Allocator, &fd->Fence)))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+void VulkanController::DestroyOffscreenWindow(ImGui_ImplVulkanH_Window* wd)
+{
+	VulkanError(vkDeviceWaitIdle(g_Device));
+
+	for (uint32_t i = 0; i < wd->ImageCount && wd->Frames; i++)
+	{
+		ImGui_ImplVulkanH_Frame* fd = &wd->Frames[i];
+		vkDestroyFence(g_Device, fd->Fence, g_Allocator);
+		if (fd->CommandBuffer != VK_NULL_HANDLE)
+			vkFreeCommandBuffers(g_Device, fd->CommandPool, 1, &fd->CommandBuffer);
+		vkDestroyCommandPool(g_Device, fd->CommandPool, g_Allocator);
+		vkDestroyFramebuffer(g_Device, fd->Framebuffer, g_Allocator);
+		vkDestroyImageView(g_Device, fd->BackbufferView, g_Allocator);
+	}
+	for (auto& target : mOffscreenImages)
+	{
+		vkDestroyImage(g_Device, target.image, g_Allocator);
+		vkFreeMemory(g_Device, target.memory, g_Allocator);
+	}
+	mOffscreenImages.clear();
+
+	IM_FREE(wd->Frames);
+	IM_FREE(wd->FrameSemaphores);
+	vkDestroyRenderPass(g_Device, wd->RenderPass, g_Allocator);
+
+	*wd = ImGui_ImplVulkanH_Window();
+}
+
+
+bool VulkanController::ReadbackFrame(ImGui_ImplVulkanH_Window* wd, std::vector<uint32_t>& pixels)
+{
+	IM_ASSERT(mHeadless);
+
+	// An image no frame was rendered to yet is still UNDEFINED, there is nothing to read back
+	if (wd->FrameIndex >= mFrameSerials.size() || mFrameSerials[wd->FrameIndex] == 0)
+		return false;
+
+	const VkDeviceSize size = (VkDeviceSize)wd->Width * wd->Height * 4;
+	VkImage image = wd->Frames[wd->FrameIndex].Backbuffer;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkCommandPool pool = VK_NULL_HANDLE;
+	VkCommandBuffer cmd = VK_NULL_HANDLE;
+	bool ok = false;
+
+	do
+	{
+		{
+			VkBufferCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			info.size = size;
+			info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			if (VulkanError(vkCreateBuffer(g_Device, &info, g_Allocator, &buffer)))
+				break;
+
+			VkMemoryRequirements req;
+			vkGetBufferMemoryRequirements(g_Device, buffer, &req);
+			VkMemoryAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			alloc_info.allocationSize = req.size;
+			alloc_info.memoryTypeIndex = FindMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, req.memoryTypeBits);
+			if (VulkanError(vkAllocateMemory(g_Device, &alloc_info, g_Allocator, &memory)) ||
+				VulkanError(vkBindBufferMemory(g_Device, buffer, memory, 0)))
+				break;
+		}
+		{
+			VkCommandPoolCreateInfo info = {};
+			info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			info.queueFamilyIndex = g_QueueFamily;
+			if (VulkanError(vkCreateCommandPool(g_Device, &info, g_Allocator, &pool)))
+				break;
+
+			VkCommandBufferAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = pool;
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			alloc_info.commandBufferCount = 1;
+			if (VulkanError(vkAllocateCommandBuffers(g_Device, &alloc_info, &cmd)))
+				break;
+
+			VkCommandBufferBeginInfo begin_info = {};
+			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			if (VulkanError(vkBeginCommandBuffer(cmd, &begin_info)))
+				break;
+		}
+
+		// The render pass left the image in TRANSFER_SRC_OPTIMAL, only its writes need to be made visible
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+		VkBufferImageCopy region = {};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent.width = wd->Width;
+		region.imageExtent.height = wd->Height;
+		region.imageExtent.depth = 1;
+		vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+		VkBufferMemoryBarrier host_barrier = {};
+		host_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		host_barrier.buffer = buffer;
+		host_barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &host_barrier, 0, NULL);
+
+		VkSubmitInfo submit = {};
+		submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit.commandBufferCount = 1;
+		submit.pCommandBuffers = &cmd;
+		if (VulkanError(vkEndCommandBuffer(cmd)) ||
+			VulkanError(vkQueueSubmit(g_Queue, 1, &submit, VK_NULL_HANDLE)) ||
+			VulkanError(vkQueueWaitIdle(g_Queue)))
+			break;
+
+		void* mapped = NULL;
+		if (VulkanError(vkMapMemory(g_Device, memory, 0, size, 0, &mapped)))
+			break;
+		pixels.resize((size_t)wd->Width * wd->Height);
+		memcpy(pixels.data(), mapped, (size_t)size);
+		vkUnmapMemory(g_Device, memory);
+		ok = true;
+	} while (false);
+
+	if (cmd != VK_NULL_HANDLE)
+		vkFreeCommandBuffers(g_Device, pool, 1, &cmd);
+	vkDestroyCommandPool(g_Device, pool, g_Allocator);
+	vkDestroyBuffer(g_Device, buffer, g_Allocator);
+	vkFreeMemory(g_Device, memory, g_Allocator);
+	return ok;
+}
+
+
 ImGui_ImplVulkan_InitInfo VulkanController::GetImGuiInitInfo()
 {
 	ImGui_ImplVulkan_InitInfo init_info = {};
@@ -311,3 +762,417 @@ void VulkanController::UploadFonts(ImGui_ImplVulkanH_Window* wd)
 
 	ImGui_ImplVulkan_DestroyFontUploadObjects();
 }
+
+
+bool VulkanController::CreateSpriteRenderer(ImGui_ImplVulkanH_Window* wd)
+{
+	// Render passes recreated with the swapchain stay compatible, the pipeline survives resizes
+	mSprites = new SpriteRenderer(this, wd->RenderPass);
+	if (!mSprites->isReady())
+	{
+		delete mSprites;
+		mSprites = nullptr;
+		return false;
+	}
+	return true;
+}
+
+
+void VulkanController::LoadPipelineCache(const std::string& path)
+{
+	mPipelineCachePath = path;
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(g_PhysicalDevice, &props);
+
+	std::vector<char> blob;
+	std::ifstream src(path, std::ios_base::binary);
+	if (src)
+	{
+		PipelineCacheFileHeader header = {};
+		src.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (src && header.dataSize > 0)
+		{
+			blob.resize(header.dataSize);
+			src.read(blob.data(), blob.size());
+			blob.resize(static_cast<size_t>(src.gcount()));
+		}
+
+		if (!ValidPipelineCache(props, header, blob))
+		{
+			fprintf(stderr, "[vulkan] Discarding stale pipeline cache %s\n", path.c_str());
+			blob.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	info.initialDataSize = blob.size();
+	info.pInitialData = blob.empty() ? NULL : blob.data();
+
+	VkResult err = vkCreatePipelineCache(g_Device, &info, g_Allocator, &g_PipelineCache);
+	if (err != VK_SUCCESS && !blob.empty())
+	{
+		// Driver refused the blob despite a matching header, start over with an empty cache
+		info.initialDataSize = 0;
+		info.pInitialData = NULL;
+		err = vkCreatePipelineCache(g_Device, &info, g_Allocator, &g_PipelineCache);
+	}
+
+	if (VulkanError(err))
+		g_PipelineCache = VK_NULL_HANDLE;
+}
+
+
+void VulkanController::SavePipelineCache()
+{
+	if (g_PipelineCache == VK_NULL_HANDLE || mPipelineCachePath.empty())
+		return;
+
+	size_t size = 0;
+	if (VulkanError(vkGetPipelineCacheData(g_Device, g_PipelineCache, &size, NULL)) || size == 0)
+		return;
+
+	std::vector<char> blob(size);
+	if (VulkanError(vkGetPipelineCacheData(g_Device, g_PipelineCache, &size, blob.data())))
+		return;
+	blob.resize(size);
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(g_PhysicalDevice, &props);
+
+	PipelineCacheFileHeader header = {};
+	header.magic = PipelineCacheMagic;
+	header.version = PipelineCacheVersion;
+	header.vendorID = props.vendorID;
+	header.deviceID = props.deviceID;
+	header.driverVersion = props.driverVersion;
+	memcpy(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = static_cast<uint32_t>(blob.size());
+
+	// Write next to the target and swap in, so a crash mid-write never leaves a torn cache behind
+	std::error_code ec;
+	std::filesystem::path target(mPipelineCachePath);
+	std::filesystem::path temp(mPipelineCachePath + ".tmp");
+	if (target.has_parent_path())
+		std::filesystem::create_directories(target.parent_path(), ec);
+
+	{
+		std::ofstream dst(temp, std::ios_base::binary | std::ios_base::trunc);
+		dst.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		dst.write(blob.data(), blob.size());
+		if (!dst)
+		{
+			fprintf(stderr, "[vulkan] Failed to write pipeline cache %s\n", temp.string().c_str());
+			return;
+		}
+	}
+
+	std::filesystem::rename(temp, target, ec);
+	if (ec)
+		fprintf(stderr, "[vulkan] Failed to store pipeline cache %s: %s\n", target.string().c_str(), ec.message().c_str());
+}
+
+
+uint32_t VulkanController::FindMemoryType(VkMemoryPropertyFlags properties, uint32_t typeBits)
+{
+	VkPhysicalDeviceMemoryProperties prop;
+	vkGetPhysicalDeviceMemoryProperties(g_PhysicalDevice, &prop);
+	for (uint32_t i = 0; i < prop.memoryTypeCount; i++)
+		if ((prop.memoryTypes[i].propertyFlags & properties) == properties && typeBits & (1 << i))
+			return i;
+
+	return 0xFFFFFFFF; // Unable to find memoryType
+}
+
+
+VulkanTexture* VulkanController::CreateTexture(int width, int height, VkFormat format, const void* pixels)
+{
+	AV_TRACE_SCOPE("CreateTexture");
+	IM_ASSERT(format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8_UNORM);
+	VkDeviceSize upload_size = (VkDeviceSize)width * height * (format == VK_FORMAT_R8_UNORM ? 1 : 4);
+
+	VulkanTexture* texture = new VulkanTexture();
+	texture->format = format;
+	texture->width = width;
+	texture->height = height;
+
+	// Create the Image
+	{
+		VkImageCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		info.imageType = VK_IMAGE_TYPE_2D;
+		info.format = format;
+		info.extent.width = width;
+		info.extent.height = height;
+		info.extent.depth = 1;
+		info.mipLevels = 1;
+		info.arrayLayers = 1;
+		info.samples = VK_SAMPLE_COUNT_1_BIT;
+		info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (VulkanError(vkCreateImage(g_Device, &info, g_Allocator, &texture->image)))
+		{
+			ReleaseTexture(texture);
+			return NULL;
+		}
+
+		VkMemoryRequirements req;
+		vkGetImageMemoryRequirements(g_Device, texture->image, &req);
+		VkMemoryAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize = req.size;
+		alloc_info.memoryTypeIndex = FindMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, req.memoryTypeBits);
+
+		if (VulkanError(vkAllocateMemory(g_Device, &alloc_info, g_Allocator, &texture->memory)) ||
+			VulkanError(vkBindImageMemory(g_Device, texture->image, texture->memory, 0)))
+		{
+			ReleaseTexture(texture);
+			return NULL;
+		}
+	}
+
+	// Create the Image View and register it with the ImGui backend
+	{
+		VkImageViewCreateInfo info = {};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		info.image = texture->image;
+		info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		info.format = format;
+		info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		info.subresourceRange.levelCount = 1;
+		info.subresourceRange.layerCount = 1;
+
+		if (VulkanError(vkCreateImageView(g_Device, &info, g_Allocator, &texture->view)))
+		{
+			ReleaseTexture(texture);
+			return NULL;
+		}
+
+		texture->descriptor = ImGui_ImplVulkan_AddTexture(mNearestSampler, texture->view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		if (texture->descriptor == VK_NULL_HANDLE)
+		{
+			ReleaseTexture(texture);
+			return NULL;
+		}
+	}
+
+	// Create the Upload Buffer and fill it
+	StagingUpload upload = { texture, VK_NULL_HANDLE, VK_NULL_HANDLE };
+	{
+		void* map = NULL;
+		if (!CreateStagingBuffer(upload_size, upload.buffer, upload.memory) ||
+			VulkanError(vkMapMemory(g_Device, upload.memory, 0, upload_size, 0, &map)))
+		{
+			vkDestroyBuffer(g_Device, upload.buffer, g_Allocator);
+			vkFreeMemory(g_Device, upload.memory, g_Allocator);
+			ReleaseTexture(texture);
+			return NULL;
+		}
+
+		memcpy(map, pixels, (size_t)upload_size);
+		vkUnmapMemory(g_Device, upload.memory);
+	}
+
+	upload.width = width;
+	upload.height = height;
+	mPendingUploads.push_back(upload);
+	return texture;
+}
+
+
+bool VulkanController::UpdateTexture(VulkanTexture* texture, int x, int y, int width, int height, const void* pixels)
+{
+	IM_ASSERT(x >= 0 && y >= 0 && x + width <= texture->width && y + height <= texture->height);
+	const size_t texel_size = texture->format == VK_FORMAT_R8_UNORM ? 1 : 4;
+	const size_t row_size = (size_t)width * texel_size;
+
+	// Created this frame and not uploaded yet: the region goes straight into its staging buffer
+	for (auto& pending : mPendingUploads)
+		if (pending.texture == texture && !pending.update)
+		{
+			void* map = NULL;
+			if (VulkanError(vkMapMemory(g_Device, pending.memory, 0, VK_WHOLE_SIZE, 0, &map)))
+				return false;
+			for (int row = 0; row < height; row++)
+				memcpy((uint8_t*)map + ((size_t)(y + row) * texture->width + x) * texel_size, (const uint8_t*)pixels + row * row_size, row_size);
+			vkUnmapMemory(g_Device, pending.memory);
+			return true;
+		}
+
+	StagingUpload upload = { texture, VK_NULL_HANDLE, VK_NULL_HANDLE };
+	void* map = NULL;
+	if (!CreateStagingBuffer(row_size * height, upload.buffer, upload.memory) ||
+		VulkanError(vkMapMemory(g_Device, upload.memory, 0, row_size * height, 0, &map)))
+	{
+		vkDestroyBuffer(g_Device, upload.buffer, g_Allocator);
+		vkFreeMemory(g_Device, upload.memory, g_Allocator);
+		return false;
+	}
+
+	memcpy(map, pixels, row_size * height);
+	vkUnmapMemory(g_Device, upload.memory);
+
+	upload.update = true;
+	upload.x = x;
+	upload.y = y;
+	upload.width = width;
+	upload.height = height;
+	mPendingUploads.push_back(upload);
+	return true;
+}
+
+
+bool VulkanController::CreateStagingBuffer(VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+	VkBufferCreateInfo buffer_info = {};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.size = size;
+	buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	if (VulkanError(vkCreateBuffer(g_Device, &buffer_info, g_Allocator, &buffer)))
+		return false;
+
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(g_Device, buffer, &req);
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = req.size;
+	alloc_info.memoryTypeIndex = FindMemoryType(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, req.memoryTypeBits);
+
+	return !VulkanError(vkAllocateMemory(g_Device, &alloc_info, g_Allocator, &memory)) &&
+		!VulkanError(vkBindBufferMemory(g_Device, buffer, memory, 0));
+}
+
+
+void VulkanController::DestroyTexture(VulkanTexture* texture)
+{
+	if (texture == NULL)
+		return;
+
+	// Never uploaded: its staging buffers go with it
+	for (auto it = mPendingUploads.begin(); it != mPendingUploads.end();)
+		if (it->texture == texture)
+		{
+			mRetired.push_back({ mSubmittedSerial, NULL, it->buffer, it->memory, VK_NULL_HANDLE });
+			it = mPendingUploads.erase(it);
+		}
+		else
+			++it;
+
+	// The frame being built may still reference it, so wait for that one too
+	mRetired.push_back({ mSubmittedSerial + 1, texture, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE });
+}
+
+
+void VulkanController::DestroyDescriptorSet(VkDescriptorSet descriptor)
+{
+	if (descriptor == VK_NULL_HANDLE)
+		return;
+
+	mRetired.push_back({ mSubmittedSerial + 1, NULL, VK_NULL_HANDLE, VK_NULL_HANDLE, descriptor });
+}
+
+
+void VulkanController::RecordUploads(VkCommandBuffer cmd)
+{
+	if (mPendingUploads.empty())
+		return;
+
+	AV_TRACE_SCOPE("RecordUploads");
+	AV_TRACE_COUNTER("Texture uploads", mPendingUploads.size());
+
+	// One barrier per image: a texture gets either its first upload or any number of region updates.
+	// Updated images may still be read by earlier frames, the fragment stage has to finish with them first.
+	std::vector<VkImageMemoryBarrier> barriers;
+	for (size_t i = 0; i < mPendingUploads.size(); i++)
+	{
+		VkImage image = mPendingUploads[i].texture->image;
+		bool seen = false;
+		for (const auto& other : barriers)
+			seen |= other.image == image;
+		if (seen)
+			continue;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = mPendingUploads[i].update ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		barriers.push_back(barrier);
+	}
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, NULL, 0, NULL, (uint32_t)barriers.size(), barriers.data());
+
+	for (auto& upload : mPendingUploads)
+	{
+		VkBufferImageCopy region = {};
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset.x = upload.x;
+		region.imageOffset.y = upload.y;
+		region.imageExtent.width = upload.width;
+		region.imageExtent.height = upload.height;
+		region.imageExtent.depth = 1;
+		vkCmdCopyBufferToImage(cmd, upload.buffer, upload.texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	}
+
+	for (auto& barrier : barriers)
+	{
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, (uint32_t)barriers.size(), barriers.data());
+
+	// Staging memory is free to go once the submission that follows has completed
+	for (auto& upload : mPendingUploads)
+		mRetired.push_back({ mSubmittedSerial + 1, NULL, upload.buffer, upload.memory, VK_NULL_HANDLE });
+	mPendingUploads.clear();
+}
+
+
+void VulkanController::ReleaseRetired(bool all)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < mRetired.size(); i++)
+	{
+		RetiredResource& res = mRetired[i];
+		if (!all && res.serial > mCompletedSerial)
+		{
+			mRetired[kept++] = res;
+			continue;
+		}
+
+		ReleaseTexture(res.texture);
+		vkDestroyBuffer(g_Device, res.buffer, g_Allocator);
+		vkFreeMemory(g_Device, res.memory, g_Allocator);
+		if (res.descriptor != VK_NULL_HANDLE)
+			vkFreeDescriptorSets(g_Device, g_DescriptorPool, 1, &res.descriptor);
+	}
+	mRetired.resize(kept);
+}
+
+
+void VulkanController::ReleaseTexture(VulkanTexture* texture)
+{
+	if (texture == NULL)
+		return;
+
+	if (texture->descriptor != VK_NULL_HANDLE)
+		vkFreeDescriptorSets(g_Device, g_DescriptorPool, 1, &texture->descriptor);
+	vkDestroyImageView(g_Device, texture->view, g_Allocator);
+	vkDestroyImage(g_Device, texture->image, g_Allocator);
+	vkFreeMemory(g_Device, texture->memory, g_Allocator);
+	delete texture;
+}
@@ -4,10 +4,30 @@
 
 #include "imgui_impl_vulkan.h"
 
+#include <string>
+#include <vector>
+
+// Sampled image registered with the ImGui backend, GetTexID() goes straight into ImDrawList calls
+struct VulkanTexture
+{
+	VkImage         image = VK_NULL_HANDLE;
+	VkDeviceMemory  memory = VK_NULL_HANDLE;
+	VkImageView     view = VK_NULL_HANDLE;
+	VkDescriptorSet descriptor = VK_NULL_HANDLE;
+	VkFormat        format = VK_FORMAT_UNDEFINED;
+	int             width = 0;
+	int             height = 0;
+
+	ImTextureID GetTexID() const { return (ImTextureID)descriptor; }
+};
+
+class SpriteRenderer;
+
 class VulkanController
 {
 public:
-	explicit VulkanController(const char** extensions, uint32_t extensions_count);
+	// 'headless' skips the swapchain device extension, rendering then goes to CreateOffscreenWindow() images
+	explicit VulkanController(const char** extensions, uint32_t extensions_count, bool headless = false);
 	~VulkanController();
 
 	VulkanController(const VulkanController&) = delete;
@@ -16,25 +36,91 @@ public:
 	static bool VulkanError(VkResult err);
 	static void VulkanErrorStatic(VkResult err);
 
-	void SetupVulkanWindow(ImGui_ImplVulkanH_Window* wd, VkSurfaceKHR surface, int width, int height, int minImageCount);
+	void SetupVulkanWindow(ImGui_ImplVulkanH_Window* wd, VkSurfaceKHR surface, int width, int height, int minImageCount, VkPresentModeKHR presentMode);
+	void SelectPresentMode(ImGui_ImplVulkanH_Window* wd, VkPresentModeKHR presentMode);
+
+	// Fills 'wd' with RGBA8 images of our own instead of a swapchain, FrameRender() and FramePresent() then
+	// cycle through them without acquiring or presenting. Release with DestroyOffscreenWindow().
+	bool CreateOffscreenWindow(ImGui_ImplVulkanH_Window* wd, int width, int height, uint32_t imageCount);
+	void DestroyOffscreenWindow(ImGui_ImplVulkanH_Window* wd);
+	bool IsHeadless() { return mHeadless; }
+
+	// Copies the image last rendered by FrameRender() into 'pixels' (RGBA8, top row first); waits for the GPU.
+	// False while that image has not been rendered to yet.
+	bool ReadbackFrame(ImGui_ImplVulkanH_Window* wd, std::vector<uint32_t>& pixels);
 
 	void FrameRender(ImGui_ImplVulkanH_Window* wd, ImDrawData* draw_data);
 	void FramePresent(ImGui_ImplVulkanH_Window* wd);
 
 	void UploadFonts(ImGui_ImplVulkanH_Window* wd);
 
+	// Render pass duration measured with timestamp queries, from the latest frame the GPU has finished.
+	// Negative when the queue does not support timestamps or nothing has completed yet.
+	float GetGpuFrameTime() { return mGpuFrameTimeMs; }
+
+	// Pixels are copied to a staging buffer right away, the GPU copy is recorded at the start of the next FrameRender()
+	VulkanTexture* CreateTexture(int width, int height, VkFormat format, const void* pixels);
+	// Replaces a region, staged and recorded the same way. Frames already submitted keep sampling the old contents.
+	bool UpdateTexture(VulkanTexture* texture, int x, int y, int width, int height, const void* pixels);
+	// Actual release waits until no submitted frame can still sample the texture
+	void DestroyTexture(VulkanTexture* texture);
+
+	// Descriptor sets allocated from our pool by other renderers, freed on the same schedule as textures
+	void DestroyDescriptorSet(VkDescriptorSet descriptor);
+
+	// Instanced sprite pass, recorded from ImGui draw callbacks inside FrameRender()
+	bool CreateSpriteRenderer(ImGui_ImplVulkanH_Window* wd);
+	auto GetSprites() -> SpriteRenderer* { return mSprites; }
+
+	uint32_t FindMemoryType(VkMemoryPropertyFlags properties, uint32_t typeBits);
+
+	// Pipeline cache blob is kept between runs; SavePipelineCache() is also called on cleanup
+	void LoadPipelineCache(const std::string& path);
+	void SavePipelineCache();
+
 	auto GetVkInstance()			-> VkInstance { return g_Instance; }
 	auto GetVkDevice()				-> VkDevice { return g_Device; }
 	auto GetVkPhysicalDevice()		-> VkPhysicalDevice { return g_PhysicalDevice; }
 	auto GetVkQueue()				-> VkQueue { return g_Queue; }
 	auto GetVkAllocationCallbacks()	-> VkAllocationCallbacks* { return g_Allocator; }
 	auto GetVkQueueFamily()			-> uint32_t { return g_QueueFamily; }
+	auto GetVkPipelineCache()		-> VkPipelineCache { return g_PipelineCache; }
+	auto GetVkDescriptorPool()		-> VkDescriptorPool { return g_DescriptorPool; }
+	auto GetNearestSampler()		-> VkSampler { return mNearestSampler; }
 
 	ImGui_ImplVulkan_InitInfo GetImGuiInitInfo();
 
 protected:
 	void CleanupVulkan();
 
+	void RecordUploads(VkCommandBuffer cmd);
+	void ReleaseRetired(bool all);
+	void ReleaseTexture(VulkanTexture* texture);
+	bool CreateStagingBuffer(VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& memory);
+
+	// A whole new texture, or a region of one that is already in use
+	struct StagingUpload
+	{
+		VulkanTexture* texture;
+		VkBuffer       buffer;
+		VkDeviceMemory memory;
+		bool           update = false;
+		int            x = 0;
+		int            y = 0;
+		int            width = 0;
+		int            height = 0;
+	};
+
+	// Resources dropped by the app, freed once frame serial 'serial' has completed on the GPU
+	struct RetiredResource
+	{
+		uint64_t       serial;
+		VulkanTexture* texture;
+		VkBuffer       buffer;
+		VkDeviceMemory memory;
+		VkDescriptorSet descriptor;
+	};
+
 protected:
 	VkAllocationCallbacks*   g_Allocator = NULL;
 	VkInstance               g_Instance = VK_NULL_HANDLE;
@@ -45,4 +131,33 @@ protected:
 	VkDebugReportCallbackEXT g_DebugReport = VK_NULL_HANDLE;
 	VkPipelineCache          g_PipelineCache = VK_NULL_HANDLE;
 	VkDescriptorPool         g_DescriptorPool = VK_NULL_HANDLE;
+
+	std::string              mPipelineCachePath;
+
+	VkSampler                mNearestSampler = VK_NULL_HANDLE;
+
+	SpriteRenderer*          mSprites = nullptr;
+
+	struct OffscreenImage
+	{
+		VkImage        image;
+		VkDeviceMemory memory;
+	};
+
+	bool                        mHeadless = false;
+	std::vector<OffscreenImage> mOffscreenImages;
+
+	// Two timestamps per swapchain frame, read back once that frame's fence has signalled
+	static const uint32_t    TimestampFrames = 16;
+	VkQueryPool              mTimestampPool = VK_NULL_HANDLE;
+	uint64_t                 mTimestampMask = 0;
+	float                    mTimestampPeriod = 0.0f;     // nanoseconds per tick
+	bool                     mTimestampWritten[TimestampFrames] = {};
+	float                    mGpuFrameTimeMs = -1.0f;
+
+	std::vector<StagingUpload>   mPendingUploads;
+	std::vector<RetiredResource> mRetired;
+	std::vector<uint64_t>        mFrameSerials;      // serial last submitted from each swapchain frame
+	uint64_t                     mSubmittedSerial = 0;
+	uint64_t                     mCompletedSerial = 0;
 };
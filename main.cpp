@@ -9,10 +9,16 @@
 // Read comments in imgui_impl_vulkan.h.
 
 #include "app/ArtViewer.h"
+#include "app/Exporter.h"
 
 
 int main(int argC, char** argV)
 {
+	// Batch export needs no window or GPU
+	ExportOptions options;
+	if (Exporter::ParseArgs(argC, argV, options))
+		return Exporter(options).Run();
+
 	ArtViewer app(argC, argV);
 	return app.Run();
 }